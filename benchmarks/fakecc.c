@@ -0,0 +1,313 @@
+/*
+* fakecc.c
+*
+* Copyright (C) Gabriel Taillon, 2026
+*
+* Stand-in C compiler for mace benchmarks.
+*   Sleeps instead of compiling, so builds measure
+*   mace: scheduler, spawn path, pqueue, idle slots.
+*   - -MM, -M:      writes .d of quoted #includes
+*   - -c:           writes fake .o of each source
+*   - -MD, -MMD:    also writes .d next to .o
+*   - otherwise:    links, writes -o output
+*
+* Environment variables:
+*   FAKECC_MS:      mean compile duration [ms], 50
+*   FAKECC_JITTER:  duration +/- percent, 0
+*   FAKECC_LINK_MS: link duration [ms], FAKECC_MS
+*   FAKECC_DEP_MS:  -MM duration [ms], 0
+*   FAKECC_SIZE:    fake object size [bytes], 1024
+*   FAKECC_FAIL:    fail sources containing it
+*   FAKECC_FAIL_PERCENT: fail sources randomly
+*   FAKECC_SEED:    seed of random durations, failures
+*
+* Randomness is seeded by source path: same source,
+* same duration and failure, build after build.
+*
+*/
+
+#define _POSIX_C_SOURCE 199309L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define FAKECC_MAX_INCLUDES 64
+#define FAKECC_MAX_DEPTH    32
+#define FAKECC_LINE       4096
+
+enum FAKECC_MODES {
+    FAKECC_LINK     = 0,
+    FAKECC_COMPILE  = 1,
+    FAKECC_DEPS     = 2
+};
+
+typedef struct Fakecc {
+    int          mode;
+    int          depfile;   /* -MD, -MMD */
+    int          sources_num;
+    int          includes_num;
+    const char  *output;
+    const char  *depout;    /* -MF */
+    const char  *sources[FAKECC_LINE];
+    const char  *includes[FAKECC_MAX_INCLUDES];
+    const char  *forced;    /* -include */
+} Fakecc;
+
+static long fakecc_env(const char *name, long fallback) {
+    const char *value = getenv(name);
+    return ((value != NULL) ? atol(value) : fallback);
+}
+
+/*  djb2 hash of string, seeds randomness. */
+static unsigned long fakecc_hash(const char *str) {
+    unsigned long hash = 5381;
+    while (*str)
+        hash = ((hash << 5) + hash) + (unsigned char)*str++;
+    return (hash);
+}
+
+/*  xorshift, never 0 with non-zero seed. */
+static unsigned long fakecc_rand(unsigned long *state) {
+    unsigned long x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    *state = x & 0xFFFFFFFFul;
+    return (*state);
+}
+
+static void fakecc_sleep(long ms) {
+    struct timespec ts;
+    if (ms <= 0)
+        return;
+    ts.tv_sec  = ms / 1000;
+    ts.tv_nsec = (ms % 1000) * 1000000l;
+    nanosleep(&ts, NULL);
+}
+
+/*  Duration of source, +/- FAKECC_JITTER % */
+static long fakecc_duration(const char *source, long ms) {
+    long          jitter = fakecc_env("FAKECC_JITTER", 0);
+    unsigned long state  = fakecc_hash(source) ^ (unsigned long)fakecc_env("FAKECC_SEED", 1);
+
+    if (state == 0)
+        state = 1;
+    if (jitter <= 0)
+        return (ms);
+    fakecc_rand(&state);
+    return (ms + (ms * jitter / 100) * ((long)(fakecc_rand(&state) % 201) - 100) / 100);
+}
+
+/*  Should compiling source fail. */
+static int fakecc_fails(const char *source) {
+    const char   *fail    = getenv("FAKECC_FAIL");
+    long          percent = fakecc_env("FAKECC_FAIL_PERCENT", 0);
+    unsigned long state   = fakecc_hash(source) ^ ~(unsigned long)fakecc_env("FAKECC_SEED", 1);
+
+    if ((fail != NULL) && (*fail != '\0') && (strstr(source, fail) != NULL))
+        return (1);
+    if (percent <= 0)
+        return (0);
+    if (state == 0)
+        state = 1;
+    return ((long)(fakecc_rand(&state) % 100) < percent);
+}
+
+/*  Find quoted include: next to includer, then -I dirs. */
+static int fakecc_find(const Fakecc *cc, const char *includer,
+                       const char *name, char *path) {
+    int         i;
+    FILE       *fd;
+    const char *slash = strrchr(includer, '/');
+
+    if (slash != NULL)
+        sprintf(path, "%.*s/%s", (int)(slash - includer), includer, name);
+    else
+        sprintf(path, "%s", name);
+    for (i = -1; i < cc->includes_num; i++) {
+        if (i >= 0)
+            sprintf(path, "%s/%s", cc->includes[i], name);
+        if ((fd = fopen(path, "r")) != NULL) {
+            fclose(fd);
+            return (1);
+        }
+    }
+    return (0);
+}
+
+/*  Write headers file includes, recursively. */
+/*      - Only quoted #include, no macro expansion */
+static void fakecc_headers(const Fakecc *cc, FILE *out, const char *file,
+                           char (*seen)[FAKECC_LINE], int *seen_num, int depth) {
+    char  line[FAKECC_LINE];
+    FILE *fd;
+
+    if ((depth > FAKECC_MAX_DEPTH) || ((fd = fopen(file, "r")) == NULL))
+        return;
+    while (fgets(line, sizeof(line), fd) != NULL) {
+        char  path[FAKECC_LINE];
+        char *start = strstr(line, "#include \"");
+        char *end;
+        int   i;
+
+        if (start == NULL)
+            continue;
+        start += strlen("#include \"");
+        if ((end = strchr(start, '"')) == NULL)
+            continue;
+        *end = '\0';
+        if (!fakecc_find(cc, file, start, path))
+            continue;
+        for (i = 0; i < *seen_num; i++) {
+            if (strcmp(seen[i], path) == 0)
+                break;
+        }
+        if ((i < *seen_num) || (*seen_num >= FAKECC_LINE))
+            continue;
+        strcpy(seen[(*seen_num)++], path);
+        fprintf(out, " \\\n %s", path);
+        fakecc_headers(cc, out, path, seen, seen_num, depth + 1);
+    }
+    fclose(fd);
+}
+
+/*  Write make rule: object depends on source, headers. */
+static void fakecc_deps(const Fakecc *cc, const char *depfile,
+                        const char *object, const char *source) {
+    FILE  *out      = (depfile != NULL) ? fopen(depfile, "w") : stdout;
+    int    seen_num = 0;
+    char (*seen)[FAKECC_LINE] = calloc(FAKECC_LINE, sizeof(*seen));
+
+    if ((out == NULL) || (seen == NULL)) {
+        fprintf(stderr, "fakecc: cannot write '%s'\n", depfile);
+        exit(1);
+    }
+    fprintf(out, "%s: %s", object, source);
+    if (cc->forced != NULL) {
+        fprintf(out, " \\\n %s", cc->forced);
+        fakecc_headers(cc, out, cc->forced, seen, &seen_num, 0);
+    }
+    fakecc_headers(cc, out, source, seen, &seen_num, 0);
+    fprintf(out, "\n");
+    if (out != stdout)
+        fclose(out);
+    free(seen);
+}
+
+/*  Write fake object of FAKECC_SIZE bytes. */
+static void fakecc_object(const char *object, const char *source) {
+    long  i;
+    long  size = fakecc_env("FAKECC_SIZE", 1024);
+    FILE *out  = fopen(object, "wb");
+
+    if (out == NULL) {
+        fprintf(stderr, "fakecc: cannot write '%s'\n", object);
+        exit(1);
+    }
+    fprintf(out, "fakecc %s\n", source);
+    for (i = 0; i < size; i++)
+        fputc(0, out);
+    fclose(out);
+}
+
+/*  Object of source: -o if compiling one, */
+/*         else basename.o in cwd. */
+static void fakecc_object_path(const Fakecc *cc, const char *source,
+                               char *object) {
+    const char *base = strrchr(source, '/');
+    char       *dot;
+
+    if ((cc->mode == FAKECC_COMPILE) && (cc->output != NULL) &&
+        (cc->sources_num == 1)) {
+        strcpy(object, cc->output);
+        return;
+    }
+    strcpy(object, (base != NULL) ? base + 1 : source);
+    if ((dot = strrchr(object, '.')) != NULL)
+        strcpy(dot, ".o");
+}
+
+static void fakecc_parse(Fakecc *cc, int argc, char *argv[]) {
+    int i;
+
+    for (i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        size_t      len = strlen(arg);
+
+        if (strcmp(arg, "-c") == 0) {
+            if (cc->mode == FAKECC_LINK)
+                cc->mode = FAKECC_COMPILE;
+        } else if ((strcmp(arg, "-MM") == 0) || (strcmp(arg, "-M") == 0)) {
+            cc->mode = FAKECC_DEPS;
+        } else if ((strcmp(arg, "-MMD") == 0) || (strcmp(arg, "-MD") == 0)) {
+            cc->depfile = 1;
+        } else if ((strcmp(arg, "-MF") == 0) && (i + 1 < argc)) {
+            cc->depout = argv[++i];
+        } else if (strcmp(arg, "-include") == 0 && (i + 1 < argc)) {
+            cc->forced = argv[++i];
+        } else if (strncmp(arg, "-o", 2) == 0) {
+            cc->output = (len > 2) ? arg + 2 : ((i + 1 < argc) ? argv[++i] : NULL);
+        } else if ((strncmp(arg, "-I", 2) == 0) &&
+                   (cc->includes_num < FAKECC_MAX_INCLUDES)) {
+            cc->includes[cc->includes_num++] = (len > 2) ? arg + 2 :
+                                               ((i + 1 < argc) ? argv[++i] : ".");
+        } else if ((arg[0] != '-') && (len > 2) &&
+                   ((strcmp(arg + len - 2, ".c") == 0) ||
+                    (strcmp(arg + len - 2, ".h") == 0)) &&
+                   (cc->sources_num < FAKECC_LINE)) {
+            cc->sources[cc->sources_num++] = arg;
+        }
+    }
+}
+
+int main(int argc, char *argv[]) {
+    int     i;
+    int     failed  = 0;
+    long    ms      = fakecc_env("FAKECC_MS", 50);
+    long    slept   = 0;
+    Fakecc  cc;
+
+    memset(&cc, 0, sizeof(cc));
+    fakecc_parse(&cc, argc, argv);
+
+    /* --- Link: touch output --- */
+    if (cc.mode == FAKECC_LINK) {
+        fakecc_sleep(fakecc_env("FAKECC_LINK_MS", ms));
+        if (cc.output != NULL)
+            fakecc_object(cc.output, "link");
+        return (0);
+    }
+
+    for (i = 0; i < cc.sources_num; i++) {
+        char object[FAKECC_LINE];
+
+        fakecc_object_path(&cc, cc.sources[i], object);
+        /* --- -MM: rule of object in output --- */
+        if (cc.mode == FAKECC_DEPS) {
+            fakecc_sleep(fakecc_env("FAKECC_DEP_MS", 0));
+            fakecc_deps(&cc, cc.output, object, cc.sources[i]);
+            continue;
+        }
+
+        /* --- -c: sources compile in sequence --- */
+        slept += fakecc_duration(cc.sources[i], ms);
+        if (fakecc_fails(cc.sources[i])) {
+            fprintf(stderr, "%s:1:1: error: fakecc failure\n", cc.sources[i]);
+            failed = 1;
+            continue;
+        }
+        fakecc_object(object, cc.sources[i]);
+        if (cc.depfile) {
+            char depfile[FAKECC_LINE];
+            strcpy(depfile, object);
+            if (strrchr(depfile, '.') != NULL)
+                *strrchr(depfile, '.') = '\0';
+            strcat(depfile, ".d");
+            fakecc_deps(&cc, cc.depout != NULL ? cc.depout : depfile,
+                        object, cc.sources[i]);
+        }
+    }
+    fakecc_sleep(slept);
+    return (failed);
+}
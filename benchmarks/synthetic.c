@@ -0,0 +1,288 @@
+/*
+* synthetic.c
+*
+* Copyright (C) Gabriel Taillon, 2026
+*
+* Synthetic large-project benchmarks for mace C-based build system.
+*   1. Generates project: sources, headers included
+*      in chains of depth, targets linked in shape
+*   2. Builds it in-process: clean, no-op, then
+*      with one header touched
+*   3. Prints one JSON object per build, per line
+*
+*/
+
+#define MACE_OVERRIDE_MAIN
+#include "../mace.h"
+
+#define SYN_SCHEMA 1
+
+enum SYN_SHAPES {
+    SYN_CHAIN   = 0, /* target k links k - 1        */
+    SYN_WIDE    = 1, /* targets independent         */
+    SYN_TREE    = 2, /* target k links (k - 1) / 2  */
+    SYN_SHAPE_NUM
+};
+
+static const char *syn_shapes[SYN_SHAPE_NUM] = {"chain", "wide", "tree"};
+
+typedef struct Syn_Args {
+    int         sources;
+    int         headers;
+    int         depth;
+    int         targets;
+    int         shape;
+    int         jobs;
+    int         repeat;
+    const char *dir;
+    const char *cc;
+} Syn_Args;
+
+static struct parg_opt syn_longopts[] = {
+    {"sources", PARG_REQARG, 0, 'n', "INT",  "Number of sources. Defaults to 1000"},
+    {"headers", PARG_REQARG, 0, 'H', "INT",  "Number of headers. Defaults to 100"},
+    {"depth",   PARG_REQARG, 0, 'D', "INT",  "Headers in include chains. Defaults to 4"},
+    {"targets", PARG_REQARG, 0, 't', "INT",  "Number of targets. Defaults to 10"},
+    {"shape",   PARG_REQARG, 0, 's', "NAME", "Target links: chain, wide, tree"},
+    {"jobs",    PARG_REQARG, 0, 'j', "INT",  "Allow N jobs at once"},
+    {"repeat",  PARG_REQARG, 0, 'r', "INT",  "Runs of no-op, touched builds. Defaults to 3"},
+    {"dir",     PARG_REQARG, 0, 'C', "DIR",  "Generated project. Defaults to synthetic"},
+    {"cc",      PARG_REQARG, 0, 'c', "CC",   "C compiler, e.g. ./fakecc. Defaults to gcc"},
+    {"help",    PARG_NOARG,  0, 'h', NULL,   "Display help and exit"},
+    {0}
+};
+
+/*  Number of header include chains. */
+static int syn_chains(const Syn_Args *args) {
+    return ((args->headers + args->depth - 1) / args->depth);
+}
+
+/*  Write header j: includes next header of its */
+/*         chain, value changes when touched. */
+static void syn_header(const Syn_Args *args, int j, int value) {
+    char  path[64];
+    FILE *fd;
+    b32   leaf = ((j % args->depth) == (args->depth - 1)) ||
+                 (j == (args->headers - 1));
+
+    sprintf(path, "include/h%d.h", j);
+    fd = fopen(path, "w");
+    if (fd == NULL) {
+        fprintf(stderr, "cannot write '%s'\n", path);
+        exit(1);
+    }
+    fprintf(fd, "#ifndef SYN_H%d\n#define SYN_H%d\n", j, j);
+    if (leaf) {
+        fprintf(fd, "#define SYN_%d %d\n", j, value);
+    } else {
+        fprintf(fd, "#include \"h%d.h\"\n", j + 1);
+        fprintf(fd, "#define SYN_%d (%d + SYN_%d)\n", j, value, j + 1);
+    }
+    fprintf(fd, "#endif\n");
+    fclose(fd);
+}
+
+/*  Write project: src/t<k>/s<i>.c include */
+/*         first header of chain i % chains. */
+static void syn_generate(const Syn_Args *args) {
+    int  i;
+    int  k;
+    char path[64];
+
+    mace_mkdir("include");
+    mace_mkdir("src");
+    for (k = 0; k < args->targets; k++) {
+        sprintf(path, "src/t%d", k);
+        mace_mkdir(path);
+    }
+    for (i = 0; i < args->headers; i++)
+        syn_header(args, i, 0);
+
+    for (i = 0; i < args->sources; i++) {
+        FILE *fd;
+        int   head = (i % syn_chains(args)) * args->depth;
+        k = (int)((long)i * args->targets / args->sources);
+        sprintf(path, "src/t%d/s%d.c", k, i);
+        fd = fopen(path, "w");
+        if (fd == NULL) {
+            fprintf(stderr, "cannot write '%s'\n", path);
+            exit(1);
+        }
+        fprintf(fd, "#include \"h%d.h\"\n", head);
+        fprintf(fd, "int syn%d(void) { return (SYN_%d); }\n", i, head);
+        fclose(fd);
+    }
+}
+
+/*  Build project in-process, print stats of */
+/*         build as JSON line. */
+static void syn_build(const Syn_Args *args, const char *scenario, int run) {
+    int        k;
+    u64        wall;
+    Mace_Args  mace_args = Mace_Args_default;
+    Target    *syn       = calloc(args->targets, sizeof(*syn));
+    char     **names     = calloc(args->targets, sizeof(*names));
+    char     **sources   = calloc(args->targets, sizeof(*sources));
+
+    mace_args.silent = true;
+    mace_args.jobs   = args->jobs;
+
+    wall = mace_time_us();
+    mace_pre_user(&mace_args);
+    mace_set_compiler(args->cc);
+    mace_set_cc_depflag("-MM");
+    mace_set_archiver(MACE_AR_BUILTIN);
+    mace_set_obj_dir("obj");
+    mace_set_build_dir("build");
+    for (k = 0; k < args->targets; k++) {
+        int link = -1;
+        names[k]   = calloc(16, sizeof(**names));
+        sources[k] = calloc(24, sizeof(**sources));
+        sprintf(names[k],   "syn%d", k);
+        sprintf(sources[k], "src/t%d/*.c", k);
+        if ((args->shape == SYN_CHAIN) && (k > 0))
+            link = k - 1;
+        else if ((args->shape == SYN_TREE) && (k > 0))
+            link = (k - 1) / 2;
+
+        syn[k].includes = "include";
+        syn[k].sources  = sources[k];
+        syn[k].links    = (link >= 0) ? names[link] : NULL;
+        syn[k].kind     = MACE_STATIC_LIBRARY;
+        mace_add_target(&syn[k], names[k]);
+    }
+    mace_post_user(&mace_args);
+    mace_pre_build();
+    mace_build();
+    wall = mace_time_us() - wall;
+
+    printf("{\"schema\":%d,\"scenario\":\"%s\",\"run\":%d,"
+           "\"sources\":%d,\"headers\":%d,\"depth\":%d,\"targets\":%d,"
+           "\"shape\":\"%s\",\"jobs\":%d,\"cc\":",
+           SYN_SCHEMA, scenario, run, args->sources, args->headers,
+           args->depth, args->targets, syn_shapes[args->shape], args->jobs);
+    mace_json_string(stdout, args->cc);
+    printf(",\"wall\":%lu,", (unsigned long)wall);
+    printf("\"phases\":{\"pre_user\":%lu,\"post_user\":%lu,"
+           "\"pre_build\":%lu,\"build\":%lu},",
+           (unsigned long)stats.pre_user,  (unsigned long)stats.post_user,
+           (unsigned long)stats.pre_build, (unsigned long)stats.build);
+    printf("\"pre_build_phases\":{\"plan\":%lu,\"sources\":%lu,\"depfiles\":%lu,"
+           "\"objdeps\":%lu,\"headers\":%lu,\"unity\":%lu,\"schedule\":%lu},",
+           (unsigned long)stats.pre_plan,
+           (unsigned long)stats.pre_sources, (unsigned long)stats.pre_depfiles,
+           (unsigned long)stats.pre_objdeps, (unsigned long)stats.pre_headers,
+           (unsigned long)stats.pre_unity,   (unsigned long)stats.pre_schedule);
+    printf("\"counters\":{\"files_hashed\":%lu,\"bytes_hashed\":%lu,"
+           "\"d_loads\":%d,\"ho_loads\":%d,\"processes\":%d,"
+           "\"objects_skipped\":%d,\"links_skipped\":%d,"
+           "\"plan_checks\":%d,\"plan_fresh\":%s},",
+           (unsigned long)stats.files_hashed, (unsigned long)stats.bytes_hashed,
+           stats.d_loads, stats.ho_loads, stats.processes,
+           stats.objects_skipped, stats.links_skipped,
+           stats.plan_checks, stats.plan_fresh ? "true" : "false");
+    printf("\"utilization\":{\"slots\":%d,\"busy\":%lu,\"idle\":{",
+           plen, (unsigned long)util.busy);
+    for (k = 0; k < MACE_IDLE_NUM; k++)
+        printf("%s\"%s\":%lu", k > 0 ? "," : "", mace_idles[k],
+               (unsigned long)util.idle[k]);
+    printf("}}}\n");
+    fflush(stdout);
+
+    mace_post_build(NULL);
+    for (k = 0; k < args->targets; k++) {
+        free(names[k]);
+        free(sources[k]);
+    }
+    free(names);
+    free(sources);
+    free(syn);
+}
+
+static Syn_Args syn_parse_args(int argc, char *argv[]) {
+    int c;
+    struct parg_state ps = parg_state_default;
+    Syn_Args args = {1000, 100, 4, 10, SYN_CHAIN, MACE_JOBS_DEFAULT, 3,
+                     "synthetic", "gcc"};
+
+    while ((c = parg_getopt_long(&ps, argc, argv, "c:C:D:hH:j:n:r:s:t:",
+                                 syn_longopts, NULL)) != -1) {
+        switch (c) {
+            case 'c': args.cc       = ps.optarg;        break;
+            case 'C': args.dir      = ps.optarg;        break;
+            case 'D': args.depth    = atoi(ps.optarg);  break;
+            case 'H': args.headers  = atoi(ps.optarg);  break;
+            case 'j': args.jobs     = atoi(ps.optarg);  break;
+            case 'n': args.sources  = atoi(ps.optarg);  break;
+            case 'r': args.repeat   = atoi(ps.optarg);  break;
+            case 't': args.targets  = atoi(ps.optarg);  break;
+            case 's':
+                for (args.shape = 0; args.shape < SYN_SHAPE_NUM; args.shape++) {
+                    if (strcmp(ps.optarg, syn_shapes[args.shape]) == 0)
+                        break;
+                }
+                if (args.shape == SYN_SHAPE_NUM) {
+                    fprintf(stderr, "Unknown shape '%s'. Use chain, wide, tree.\n", ps.optarg);
+                    exit(1);
+                }
+                break;
+            case 'h':
+                mace_parg_usage(argv[0], syn_longopts);
+                exit(0);
+            default:
+                fprintf(stderr, "Error: unhandled option, see --help\n");
+                exit(1);
+        }
+    }
+    if ((args.sources < 1) || (args.headers < 1) || (args.depth < 1) ||
+        (args.targets < 1) || (args.targets > args.sources) || (args.jobs < 1)) {
+        fprintf(stderr, "Set sources, headers, depth, jobs above 1, targets below sources.\n");
+        exit(1);
+    }
+    return (args);
+}
+
+int main(int argc, char *argv[]) {
+    int      run;
+    Syn_Args args = syn_parse_args(argc, argv);
+    char     cc[PATH_MAX];
+
+    /* Compiler path e.g. ./fakecc: mace runs it */
+    /* by name, from its directory added to PATH */
+    if ((strchr(args.cc, '/') != NULL) && (realpath(args.cc, cc) != NULL)) {
+        const char *path = getenv("PATH");
+        char       *env  = calloc(strlen(cc) + (path ? strlen(path) : 0) + 2, 1);
+        args.cc = strrchr(cc, '/') + 1;
+        sprintf(env, "%.*s:%s", (int)(args.cc - cc - 1), cc, path ? path : "");
+        setenv("PATH", env, 1);
+        free(env);
+    }
+    if (strlen(args.cc) >= MACE_CC_BUFFER) {
+        fprintf(stderr, "Compiler name '%s' longer than %d.\n", args.cc, MACE_CC_BUFFER - 1);
+        exit(1);
+    }
+
+    mace_mkdir(args.dir);
+    if (chdir(args.dir) != 0) {
+        fprintf(stderr, "Could not mv to '%s'\n", args.dir);
+        exit(1);
+    }
+    if (system("rm -rf include src obj build") != 0)
+        exit(1);
+    syn_generate(&args);
+
+    /* --- Clean: all objects, .d, checksums --- */
+    syn_build(&args, "clean", 0);
+
+    /* --- No-op: nothing changed --- */
+    for (run = 0; run < args.repeat; run++)
+        syn_build(&args, "noop", run);
+
+    /* --- Touched: last header of first chain --- */
+    for (run = 0; run < args.repeat; run++) {
+        syn_header(&args, args.depth < args.headers ? args.depth - 1 :
+                   args.headers - 1, run + 1);
+        syn_build(&args, "touch", run);
+    }
+    return (0);
+}
@@ -14,6 +14,8 @@
 **  Convenience executable for mace build system
 **   
 **  1. Compiles input macefile to builder exe
+**      - Skipped if macefile, its headers, and
+**        compile command didn't change
 **  2. Runs builder exe
 **      - Passes flags to builder exe
 **
@@ -36,7 +38,196 @@
     #define BUILDER builder
 #endif
 /* tne number of argc_run++, +1 */
-#define MAX_ARGC_RUN 14 
+#define MAX_ARGC_RUN 24 
+
+/* -- Builder dependencies, fingerprint -- */
+#define BUILDER_DEPS        STRINGIFY(BUILDER)".d"
+#define BUILDER_OBJECT      STRINGIFY(BUILDER)".o"
+#define BUILDER_FINGERPRINT STRINGIFY(BUILDER)".sha1"
+
+/* -- libmace.a installed by installer -- */
+/* Macefile only declares public API, links
+** mace compiled once, if libmace.a exists. */
+#ifdef LIBMACE_DIR
+    #define LIBMACE         STRINGIFY(LIBMACE_DIR)"/libmace.a"
+    #define LIBMACE_CFLAGS  " -c -MD -MF "BUILDER_DEPS" -DMACE_LIBRARY"
+    #define LIBMACE_LDFLAGS " -L"STRINGIFY(LIBMACE_DIR)" -lmace"
+#endif
+
+/*  Hash file contents into ctx. */
+/*  @return false if file can't be read */
+static b32 builder_hash_file(SHA1_CTX *ctx, const char *path) {
+    char    buffer[BUFSIZ];
+    size_t  size;
+    FILE   *file = fopen(path, "rb");
+    if (file == NULL)
+        return (false);
+
+    SHA1DCUpdate(ctx, path, strlen(path) + 1);
+    while ((size = fread(buffer, 1, sizeof(buffer), file)) > 0)
+        SHA1DCUpdate(ctx, buffer, size);
+    fclose(file);
+    return (true);
+}
+
+/*  Hash compiler executable into ctx: */
+/*         path resolved from PATH, its stat. */
+/*      - Compiler updated in place: rebuilds */
+/*  @return false if compiler not found */
+static b32 builder_hash_compiler(SHA1_CTX *ctx, const char *cc) {
+    struct stat  st;
+    char        *path   = NULL;
+    char        *dirs;
+    char        *dir;
+    const char  *env    = getenv("PATH");
+    b32          found  = false;
+
+    if (strchr(cc, '/') != NULL) {
+        path  = strdup(cc);
+        MACE_MEMCHECK(path);
+        found = (stat(path, &st) == 0);
+    } else if (env != NULL) {
+        dirs = strdup(env);
+        MACE_MEMCHECK(dirs);
+        for (dir = strtok(dirs, ":"); !found && (dir != NULL);
+             dir = strtok(NULL, ":")) {
+            free(path);
+            path = calloc(strlen(dir) + strlen(cc) + 2, sizeof(*path));
+            MACE_MEMCHECK(path);
+            sprintf(path, "%s/%s", dir, cc);
+            found = (access(path, X_OK) == 0) && (stat(path, &st) == 0);
+        }
+        free(dirs);
+    }
+
+    if (found) {
+        SHA1DCUpdate(ctx, path, strlen(path) + 1);
+        SHA1DCUpdate(ctx, (const char *)&st.st_ino,   sizeof(st.st_ino));
+        SHA1DCUpdate(ctx, (const char *)&st.st_size,  sizeof(st.st_size));
+        SHA1DCUpdate(ctx, (const char *)&st.st_mtime, sizeof(st.st_mtime));
+    }
+    free(path);
+    return (found);
+}
+
+/*  Fingerprint of builder: compiler, compile */
+/*         command, macefile and headers in */
+/*         BUILDER_DEPS. */
+/*  @return false if any can't be read */
+static b32 builder_fingerprint(const char *cc, const char *compile_cmd,
+                               u8 fingerprint[SHA1DC_LEN]) {
+    SHA1_CTX ctx;
+    char    *deps;
+    char    *token;
+    long     size;
+    b32      out  = true;
+    FILE    *file = fopen(BUILDER_DEPS, "rb");
+    if (file == NULL)
+        return (false);
+
+    /* - Read make rule written by cc -MD - */
+    fseek(file, 0, SEEK_END);
+    size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    deps = calloc(size + 1, sizeof(*deps));
+    MACE_MEMCHECK(deps);
+    size = fread(deps, 1, size, file);
+    fclose(file);
+
+    SHA1DCInit(&ctx);
+    SHA1DCUpdate(&ctx, compile_cmd, strlen(compile_cmd) + 1);
+    if (!builder_hash_compiler(&ctx, cc))
+        out = false;
+
+    /* - Prerequisites after "builder:" - */
+    token = strchr(deps, ':');
+    token = (token != NULL) ? strtok(token + 1, " \t\r\n\\") : NULL;
+    if (token == NULL)
+        out = false;
+    while (out && (token != NULL)) {
+        out   = builder_hash_file(&ctx, token);
+        token = strtok(NULL, " \t\r\n\\");
+    }
+    free(deps);
+#ifdef LIBMACE_DIR
+    builder_hash_file(&ctx, LIBMACE);
+#endif
+
+    if (SHA1DCFinal(fingerprint, &ctx))
+        out = false;
+    return (out);
+}
+
+/*  Check if builder is up to date. */
+static b32 builder_cached(const char *cc, const char *compile_cmd) {
+    u8    previous[SHA1DC_LEN];
+    u8    current[SHA1DC_LEN];
+    FILE *file;
+    b32   read;
+
+    if (access("./"STRINGIFY(BUILDER), X_OK) != 0)
+        return (false);
+
+    file = fopen(BUILDER_FINGERPRINT, "rb");
+    if (file == NULL)
+        return (false);
+    read = (fread(previous, 1, SHA1DC_LEN, file) == SHA1DC_LEN);
+    fclose(file);
+
+    return (read && builder_fingerprint(cc, compile_cmd, current) &&
+            (memcmp(previous, current, SHA1DC_LEN) == 0));
+}
+
+/*  Save fingerprint of builder just compiled. */
+static void builder_fingerprint_write(const char *cc,
+                                      const char *compile_cmd) {
+    u8    fingerprint[SHA1DC_LEN];
+    FILE *file;
+
+    if (!builder_fingerprint(cc, compile_cmd, fingerprint)) {
+        remove(BUILDER_FINGERPRINT);
+        return;
+    }
+    file = fopen(BUILDER_FINGERPRINT, "wb");
+    if (file == NULL)
+        return;
+    fwrite(fingerprint, 1, SHA1DC_LEN, file);
+    fclose(file);
+}
+
+/*  Space-separated command: */
+/*         <cc> <input> -o <output><flags> */
+static char *builder_cmd(const char *cc, const char *input,
+                         const char *output, const char *flags) {
+    size_t len_total    =   strlen(cc)      + 1 +
+                            strlen(input)   + 1 +
+                            strlen("-o")    + 1 +
+                            strlen(output)  +
+                            strlen(flags)   + 1;
+    char *cmd           = calloc(len_total, sizeof(*cmd));
+    MACE_MEMCHECK(cmd);
+    sprintf(cmd, "%s %s -o %s%s", cc, input, output, flags);
+    return (cmd);
+}
+
+/*  Run compile or link command of builder. */
+/*  @return false if compiler failed */
+static b32 builder_compile(const char *cc, const char *compile_cmd) {
+    int    status       = 0;
+    int    len          = 8;
+    int    argc_compile = 0;
+    char **argv_compile = calloc(len, sizeof(*argv_compile));
+    pid_t  pid;
+
+    argv_compile = mace_argv_flags(&len, &argc_compile, 
+                                   argv_compile, compile_cmd, NULL,
+                                   false, mace_separator);
+    mace_exec_print(argv_compile, argc_compile);
+    pid = mace_exec(cc, argv_compile);
+    waitpid(pid, &status, 0);
+    mace_argv_free(argv_compile, argc_compile);
+    return (WIFEXITED(status) && (WEXITSTATUS(status) == 0));
+}
 
 int main(int argc, char *argv[]) {
     /* -- Parse inputs -- */
@@ -67,47 +258,57 @@ int main(int argc, char *argv[]) {
 
     /* --- Compile the macefile --- */
     /* - Read macefile name from args - */
-    char *builder = STRINGIFY(BUILDER);
     char *macefile;
-    size_t len_cc       = strlen(cc);
-    size_t len_flag     = strlen("-o");
-    size_t len_builder  = strlen(builder);
-    size_t len_macefile;
     if (args.macefile != NULL) {
         macefile        = args.macefile;
-        len_macefile    = strlen(args.macefile);
     } else {
         macefile        = STRINGIFY(DEFAULT_MACEFILE);
-        len_macefile    = strlen(STRINGIFY(DEFAULT_MACEFILE));
-    }
-
-    /* - Write space-separated command - */
-    size_t len_total    =   len_cc          + 1 +
-                            len_macefile    + 1 +
-                            len_flag        + 1 + 
-                            len_builder     + 1;
-    char *compile_cmd   = calloc(len_total, sizeof(compile_cmd));
-    size_t i = 0;
-    strncpy(compile_cmd + i, cc,         len_cc);
-    i += len_cc;
-    strncpy(compile_cmd + i, " ",         1);
-    i += 1;
-    strncpy(compile_cmd + i, macefile,                 len_macefile);
-    i += len_macefile;
-    strncpy(compile_cmd + i, " -o "STRINGIFY(BUILDER), len_builder + len_flag + 2);
-
-    /* - Build argv_compile - */
-    int len             = 8;
-    int argc_compile    = 0;
-    char **argv_compile = calloc(len, sizeof(*argv_compile));
-    argv_compile = mace_argv_flags(&len, &argc_compile, 
-                                   argv_compile, compile_cmd, NULL,
-                                   false, mace_separator);
+    }
 
-    /* - Compile it - */
-    mace_exec_print(argv_compile, argc_compile);
-    pid_t pid = mace_exec(cc, argv_compile);
-    mace_wait_pid(pid);
+    /* - Single header, or linked with libmace.a - */
+    char *compile_cmd   = builder_cmd(cc, macefile, STRINGIFY(BUILDER),
+                                      " -MD -MF "BUILDER_DEPS);
+    char *object_cmd    = NULL;
+    char *link_cmd      = NULL;
+#ifdef LIBMACE_DIR
+    if (access(LIBMACE, R_OK) == 0) {
+        object_cmd  = builder_cmd(cc, macefile, BUILDER_OBJECT,
+                                  LIBMACE_CFLAGS);
+        link_cmd    = builder_cmd(cc, BUILDER_OBJECT, STRINGIFY(BUILDER),
+                                  LIBMACE_LDFLAGS);
+    }
+#endif
+
+    /* - Compile it, unless builder is up to date - */
+    b32 cached = !args.build_all &&
+                 (((object_cmd != NULL) && builder_cached(cc, object_cmd)) ||
+                  builder_cached(cc, compile_cmd));
+    b32 linked = false;
+    if (!cached && (object_cmd != NULL)) {
+        if (!builder_compile(cc, object_cmd)) {
+            fprintf(stderr, "Could not compile '%s'.\n", macefile);
+            exit(1);
+        }
+        /* libmace.a of another mace version fails to
+        ** link: macefile compiled with single header. */
+        linked = builder_compile(cc, link_cmd);
+        remove(BUILDER_OBJECT);
+        if (linked)
+            builder_fingerprint_write(cc, object_cmd);
+        else
+            fprintf(stderr, "Could not link with libmace.a, "
+                    "compiling single header.\n");
+    }
+    if (!cached && !linked) {
+        if (!builder_compile(cc, compile_cmd)) {
+            fprintf(stderr, "Could not compile '%s'.\n", macefile);
+            exit(1);
+        }
+        builder_fingerprint_write(cc, compile_cmd);
+    }
+    free(compile_cmd);
+    free(object_cmd);
+    free(link_cmd);
 
     /* --- Run the builder executable --- */
     /* - Build argv_run: pass target and flags to builder - */
@@ -115,6 +316,8 @@ int main(int argc, char *argv[]) {
     char *dflag = "-d";
     char *nflag = "-n";
     char *sflag = "-s";
+    char *Rflag = "-R";
+    char *Eflag = "-E";
     char *jflag = "-j";
 
     char *argv_run[MAX_ARGC_RUN] = {"./"STRINGIFY(BUILDER)};
@@ -127,6 +330,10 @@ int main(int argc, char *argv[]) {
         argv_run[argc_run++] = nflag;
     if (args.silent)
         argv_run[argc_run++] = sflag;
+    if (args.report)
+        argv_run[argc_run++] = Rflag;
+    if (args.explain)
+        argv_run[argc_run++] = Eflag;
     if (args.user_config != NULL) {
         argv_run[argc_run++] = "-g";
         argv_run[argc_run++] = args.user_config;
@@ -139,21 +346,36 @@ int main(int argc, char *argv[]) {
         argv_run[argc_run++] = "-a";
         argv_run[argc_run++] = args.ar;
     }
+    if (args.pools != NULL) {
+        argv_run[argc_run++] = "-P";
+        argv_run[argc_run++] = args.pools;
+    }
+    if (args.trace != NULL) {
+        argv_run[argc_run++] = "-T";
+        argv_run[argc_run++] = args.trace;
+    }
+    if (args.stats == MACE_STATS_TEXT)
+        argv_run[argc_run++] = "-S";
+    else if (args.stats == MACE_STATS_JSON)
+        argv_run[argc_run++] = "--stats=json";
     char jobstr[8] = {0};
     if (args.jobs >= 1) {
         argv_run[argc_run++] = "-j";
         sprintf(jobstr, "%d", args.jobs);
         argv_run[argc_run++] = jobstr;
     }
+    char jobs_minstr[8] = {0};
+    if (args.jobs_min > MACE_JOBS_MIN_DEFAULT) {
+        argv_run[argc_run++] = "-J";
+        sprintf(jobs_minstr, "%d", args.jobs_min);
+        argv_run[argc_run++] = jobs_minstr;
+    }
     argv_run[argc_run++] = args.user_target;
 
-    /* - Run it - */
+    /* - Run it: builder replaces this process - */
     mace_exec_print(argv_run, argc_run);
-    pid = mace_exec("./"STRINGIFY(BUILDER), argv_run);
-    mace_wait_pid(pid);
-
-    /* - Free everything - */
-    mace_argv_free(argv_compile, argc_compile);
-    Mace_Args_Free(&args);
-    free(compile_cmd);
+    fflush(stdout);
+    execv("./"STRINGIFY(BUILDER), argv_run);
+    fprintf(stderr, "Could not execute '%s'.\n", "./"STRINGIFY(BUILDER));
+    exit(1);
 }
@@ -12,11 +12,12 @@
 ***************************************************
 **  Macefile for 'mace' convenience executable
 **  
-**  1. Builds 'mace' exe
+**  1. Builds 'mace' exe, libmace.a
 **  2. Installs: 
 **      1. mace         to PREFIX/bin
 **      2. mace.h       to PREFIX/include
-**      3. _mace.zsh    to ZSH_COMPLETION
+**      3. libmace.a    to PREFIX/lib
+**      4. _mace.zsh    to ZSH_COMPLETION
 **
 */
 
@@ -52,6 +53,16 @@
     #define ZSH_COMPLETION /usr/share/zsh/site-functions
 #endif
 
+/* mace compiled once: 'mace' compiles macefiles
+** with -DMACE_LIBRARY, links them with it.
+** Target 'mace' outputs libmace.a, target
+** 'convenience' is installed as 'mace'. */
+struct Target LIBMACE  = {
+    .sources        = "libmace.c",
+    .kind           = MACE_STATIC_LIBRARY,
+    .flags          = "-O2",
+};
+
 struct Target MACE  = {
     .sources        = "convenience_executable.c",
     .kind           = MACE_EXECUTABLE,
@@ -60,13 +71,16 @@ struct Target MACE  = {
     **  2. Set compiler, names */
     .flags          = "-DMACE_OVERRIDE_MAIN -DCC="STRINGIFY(CC)" "
     "-DBUILDER="STRINGIFY(BUILDER)" "
-    "-DDEFAULT_MACEFILE="STRINGIFY(DEFAULT_MACEFILE),
-    "-O2",
+    "-DDEFAULT_MACEFILE="STRINGIFY(DEFAULT_MACEFILE)" "
+    "-DLIBMACE_DIR="STRINGIFY(PREFIX)"/lib -O2",
+    .dependencies   = "mace",
     .cmd_post       =
     /* Install mace convenience executable*/
-    "install -T " STRINGIFY(BUILD_DIR) "/mace " STRINGIFY(PREFIX) "/bin/mace &&"
+    "install -T " STRINGIFY(BUILD_DIR) "/convenience " STRINGIFY(PREFIX) "/bin/mace &&"
     /* Install mace.h header*/
     "install -T mace.h"  " " STRINGIFY(PREFIX) "/include/mace.h &&"
+    /* Install mace library */
+    "install -D -T " STRINGIFY(BUILD_DIR) "/libmace.a " STRINGIFY(PREFIX) "/lib/libmace.a &&"
     /* Install zsh completion */
     "cp _mace.zsh _mace.temp &&"
     "sed -i s/macefile.c/" STRINGIFY(DEFAULT_MACEFILE) "/ _mace.temp &&"
@@ -80,7 +94,8 @@ int mace(int argc, char *argv[]) {
     MACE_SET_BUILD_DIR(BUILD_DIR);
     MACE_SET_OBJ_DIR(OBJ_DIR);
 
-    mace_add_target(&MACE, "mace");
-    MACE_SET_DEFAULT_TARGET(mace);
+    mace_add_target(&LIBMACE, "mace");
+    mace_add_target(&MACE, "convenience");
+    MACE_SET_DEFAULT_TARGET(convenience);
     return (0);
 }
@@ -0,0 +1,21 @@
+/*
+**  Copyright 2023-2026 Gabriel Taillon
+**  Licensed under GPLv3
+**
+**      Éloigne de moi l'esprit d'oisiveté, de
+**          découragement, de domination et de
+**          vaines paroles.
+**      Accorde-moi l'esprit d'intégrité,
+**          d'humilité, de patience et de charité.
+**      Donne-moi de voir mes fautes.
+**
+***************************************************
+**
+**  libmace: mace compiled once, with main.
+**  Macefiles compiled with -DMACE_LIBRARY only
+**  declare public API, link with -lmace.
+**
+*/
+
+#define MACE_IMPLEMENTATION
+#include "mace.h"
@@ -23,9 +23,14 @@
 **      0. Install `mace`: `./installer`
 **      1. Build: `mace`
 **
+**  Library build (with libmace.a from installer)
+**      1. Bootstrap: `gcc -DMACE_LIBRARY macefile.c -lmace -o builder`
+**      2. Build: `./builder`
+**
 */
 
 #define _XOPEN_SOURCE 500 /* include POSIX 1995 */
+#define _DEFAULT_SOURCE   /* wait4, getloadavg  */
 
 /* -- libc -- */
 #include <time.h>
@@ -39,8 +44,10 @@
 /* -- POSIX -- */
 #include <ftw.h>
 #include <glob.h>
+#include <fcntl.h>
 #include <unistd.h>
 #include <sys/wait.h>
+#include <sys/resource.h>
 
 #define SHA1DC_NO_STANDARD_INCLUDES
 
@@ -48,6 +55,19 @@
 /*                  PUBLIC API                  */
 /*----------------------------------------------*/
 
+/* -- Linkage -- */
+/* Single header by default: all of mace is
+** compiled, static, in every macefile.
+**  - MACE_IMPLEMENTATION: public API extern,
+**    compiled once e.g. into libmace.a
+**  - MACE_LIBRARY: public API declared only,
+**    macefile linked with libmace.a */
+#if defined(MACE_IMPLEMENTATION) || defined(MACE_LIBRARY)
+    #define MACE_API extern
+#else
+    #define MACE_API static
+#endif
+
 /* -- User entry point -- */
 /* Must be implement by user & add at
 ** least one target with MACE_ADD_TARGET. */
@@ -68,6 +88,29 @@ typedef i32                 b32;
 #define  STRINGIFY(x) _STRINGIFY(x)
 #define _STRINGIFY(x) #x
 
+/* -- Version -- */
+#define MACE_VER_MAJOR 5
+#define MACE_VER_MINOR 0
+#define MACE_VER_PATCH 3
+#define MACE_VER_STRING \
+    STRINGIFY(MACE_VER_MAJOR)"."\
+    STRINGIFY(MACE_VER_MINOR)"."\
+    STRINGIFY(MACE_VER_PATCH)
+
+/* -- ABI -- */
+/* libmace.a defines mace_abi_<major>_<minor>_<patch>,
+** macefiles with MACE_LIBRARY reference it:
+** libmace.a of another version fails to link. */
+#define  MACE_ABI            _MACE_ABI(MACE_VER_MAJOR, MACE_VER_MINOR, MACE_VER_PATCH)
+#define _MACE_ABI(a, b, c)   __MACE_ABI(a, b, c)
+#define __MACE_ABI(a, b, c)  mace_abi_##a##_##b##_##c
+#if defined(MACE_IMPLEMENTATION)
+    const int MACE_ABI = MACE_VER_MAJOR;
+#elif defined(MACE_LIBRARY)
+    extern const int MACE_ABI;
+    const int *const mace_abi = &MACE_ABI;
+#endif
+
 /* -- Forward declarations -- */
 struct Target;
 struct Config;
@@ -75,15 +118,15 @@ struct Config;
 /* -- Target -- */
 #define MACE_ADD_TARGET(target) \
     mace_add_target(&target, STRINGIFY(target))
-static void mace_add_target(struct Target *target,
-                            const char *name);
+MACE_API void mace_add_target(struct Target *target,
+                              const char *name);
 
 /* When default target set by user, mace builds
 ** only default target and its dependencies.
 ** Default target is first one if not set. */
 #define MACE_SET_DEFAULT_TARGET(target) \
     mace_set_default_target(STRINGIFY(target))
-static void mace_set_default_target(const char *name);
+MACE_API void mace_set_default_target(const char *name);
 
 /* -- Compiler -- */
 /* Compiler setting priority:
@@ -92,48 +135,81 @@ static void mace_set_default_target(const char *name);
 **      c- macefile       (with MACE_SET_COMPILER) */
 #define MACE_SET_COMPILER(compiler) \
     mace_set_compiler(STRINGIFY(compiler))
-static void  mace_set_compiler(const char *cc);
+MACE_API void mace_set_compiler(const char *cc);
+
+/* -- Archiver -- */
+/* NOTE: Automatically set in mace_set_compiler */
+/* Archiver setting priority:
+**      a- input argument (with -a,--ar)
+**      b- config
+**      c- macefile       (with MACE_SET_ARCHIVER) */
+#define MACE_SET_ARCHIVER(archiver) \
+    mace_set_archiver(STRINGIFY(archiver))
+MACE_API void mace_set_archiver(const char *ar);
+
+/* -- cc_depflag -- */
+/* NOTE: Automatically set in mace_set_compiler */
+/* Compiler flag to build .d dependency files
+** Ex: gcc -MM ... */
+#define MACE_SET_CC_DEPFLAG(cc_depflag) \
+    mace_set_cc_depflag(STRINGIFY(cc_depflag))
+MACE_API void mace_set_cc_depflag(const char *depflag);
+
+/* -- Job pools -- */
+/* Pools limit number of concurrent processes.
+** Targets compile in pool "compile", link in
+** pool "link" by default. Pools are separate:
+** links can overlap with compiles.
+** Pool limit setting priority:
+**      a- input argument (with -P,--pool)
+**      b- config
+**      c- macefile       (with MACE_SET_POOL)
+** "compile" limit defaults to -j,--jobs. */
+#define MACE_SET_POOL(pool, limit) \
+    mace_set_pool(STRINGIFY(pool), limit)
+MACE_API void mace_set_pool(const char *name, int limit);
 
 /* -- Directories -- */
 /* obj_dir, for intermediary files: .o, .d, etc. */
 #define MACE_SET_OBJ_DIR(dir) \
     mace_set_obj_dir(STRINGIFY(dir))
-static void mace_set_obj_dir(const char *obj);
+MACE_API void mace_set_obj_dir(const char *obj);
 
 /* build_dir, for targets: binaries, libraries. */
 #define MACE_SET_BUILD_DIR(dir) \
     mace_set_build_dir(STRINGIFY(dir))
-static void mace_set_build_dir(const char *build);
+MACE_API void mace_set_build_dir(const char *build);
 
 /* -- Separator -- */
 /* To separate tokens in strings
 ** e.g. target.src, config.flags, etc.
 ** Default is ' ' */
-static void mace_set_separator(char sep);
+MACE_API void mace_set_separator(char sep);
 
 /* -- Config -- */
 /* Default config is first one if not set. */
 #define MACE_SET_DEFAULT_CONFIG(target) \
     mace_set_default_config(STRINGIFY(target))
-static void mace_set_default_config(const char *name);
+MACE_API void mace_set_default_config(const char *name);
 
 #define MACE_ADD_CONFIG(config) \
     mace_add_config(&config, STRINGIFY(config))
-static void mace_add_config(struct Config *config,
-                            const char *name);
+MACE_API void mace_add_config(struct Config *config,
+                              const char *name);
 
 #define MACE_TARGET_CONFIG(target, config) \
     mace_target_config( STRINGIFY(target), \
                         STRINGIFY(config))
-static void mace_target_config( const char *ntarget,
-                                const char *nconfig);
+MACE_API void mace_target_config(const char *ntarget,
+                                 const char *nconfig);
 
 /* --- Constants --- */
 #define MACE_DEFAULT_BUILD_DIR "build"
 #define MACE_DEFAULT_OBJ_DIR "obj"
 
 enum MACE_CONSTANTS {
-    MACE_CC_BUFFER = 8
+    MACE_CC_BUFFER = 8,
+    MACE_POOL_MAX  = 16
 };
 
 enum MACE_TARGET_KIND { /* target.kind */
@@ -142,9 +218,23 @@ enum MACE_TARGET_KIND { /* target.kind */
     MACE_STATIC_LIBRARY,
     MACE_DYNAMIC_LIBRARY,
     MACE_PHONY,
+    /* Objects linked by dependents directly,
+    ** no archive. */
+    MACE_OBJECT_LIBRARY,
     MACE_TARGET_KIND_NUM
 };
 
+enum MACE_PGO { /* config.pgo */
+    MACE_PGO_NONE,
+    /* -fprofile-generate: objects, outputs in
+    ** <obj_dir>/pgo, <build_dir>/pgo. Config
+    ** train ran after relinks. */
+    MACE_PGO_GENERATE,
+    /* -fprofile-use: profiles copied next to
+    ** objects. Changed profiles recompile. */
+    MACE_PGO_USE
+};
+
 /* --- struct definitions --- */
 
 /* Why Macro'd struct definitions?
@@ -180,12 +270,39 @@ typedef struct Target { \
 \
     /* Dependencies are targets, built before self. */ \
     const char *dependencies;   /* targets          */ \
+\
+    /* Job pools, added with MACE_SET_POOL.
+    ** NULL: "compile" and "link" pools. */ \
+    const char *compile_pool; \
+    const char *link_pool; \
 \
     /* allatonce: Compile all .o with one call.
     ** Slightly faster.
     ** WARNING: DOES NOT WORK if multiple source
     ** files have the same filename. */ \
     b32 allatonce; \
+    /* batch: Compile dirty sources in about N
+    ** shards, one call each, in parallel.
+    ** Objects mirror source directories:
+    ** works with same filenames. */ \
+    int batch; \
+    /* unity: Compile generated .c files in
+    ** obj_dir, each #include-ing about N
+    ** sources, by path. Edits recompile their
+    ** chunk. */ \
+    int unity; \
+    /* Header precompiled before sources, then
+    ** included first in all of them.
+    ** Unused with allatonce. */ \
+    const char *pch; \
+    /* thin: static library is a thin archive,
+    ** members refer to objects, not copies. */ \
+    b32 thin; \
+    /* partial: executable links objects of each
+    ** source directory into one relocatable
+    ** object, cc -r, relinked if they change.
+    ** Unused with unity, config lto. */ \
+    b32 partial; \
     int kind; /* MACE_TARGET_KIND */ \
 \
     Target_Private private; \
@@ -196,6 +313,20 @@ typedef struct Config { \
     char cc[MACE_CC_BUFFER];    /* compiler     */ \
     char ar[MACE_CC_BUFFER];    /* archiver     */ \
     const char *flags;          /* passed as is */ \
+    /* Pool limits, as "NAME=INT" tokens */ \
+    const char *pools; \
+    /* Linker: -fuse-ld=<linker>, e.g. lld, mold */ \
+    /* Default linker if cc can't run it */ \
+    const char *linker; \
+    /* -gsplit-dwarf: debug info in .dwo files */ \
+    b32 split_dwarf; \
+    /* Link time optimization, jobs shared */ \
+    /* with mace: gcc -flto, clang -flto=thin */ \
+    b32 lto; \
+    /* Profile guided optimization: MACE_PGO */ \
+    int pgo; \
+    /* Training command, ran by MACE_PGO_GENERATE */ \
+    const char *train; \
 \
     Config_Private private; \
 } Config;
@@ -309,9 +440,76 @@ typedef struct Target_Private {
     /* --- Recompile switches ---  */
     /* [argc_source]    */
     b32 *_recompiles;
+    /* [argc_source] MACE_REASON of recompile */
+    int *_reasons;
+    /* [argc_source * SHA1DC_LEN] checksums */
+    u8  *_checksums;
+    /* [argc_source] checksum not written yet */
+    b32 *_staged;
+    /* [argc_source] digest of headers' checksums
+    ** not written yet, 0 if none            */
+    u64 *_hdrs_digests;
+    /* [argc_source] digest of profile not
+    ** written yet, 0 if none               */
+    u64 *_pgo_digests;
     /* [hdr_order]      */
     b32 *_hdrs_changed;
 
+    /* --- Scheduling ---  */
+    /* [argc_source] expected compile time  */
+    u64 *_weights;
+    /* [compile_num] argc_source of dirty
+    ** sources, longest first               */
+    int *_compile_order;
+    int  _compile_num;
+    /* expected compile time of target      */
+    u64  _cost;
+    /* [argc_source] expected peak RSS [KiB] */
+    u64 *_rss;
+
+    /* --- Batch shards ---  */
+    /* [compile_num] argc_source, by shard  */
+    int *_shard_sources;
+    /* [shard_num + 1] shard start in above */
+    int *_shard_start;
+    int  _shard_num;
+
+    /* --- Unity chunks ---  */
+    /* [argc_source] chunk of source        */
+    int   *_unity_chunk;
+    /* [unity_num] generated unity sources  */
+    char **_unity_sources;
+    /* [unity_num] objects, in argv form    */
+    char **_unity_objects;
+    int    _unity_num;
+
+    /* --- Precompiled header ---  */
+    /* _argv index of "-include" stub, 0: none */
+    int    _argc_pch;
+    /* compiled stub: .gch, .pch. NULL: none    */
+    char  *_pch_out;
+    /* [pch_deps_num] hdr_order of pch deps     */
+    int   *_pch_deps;
+    int    _pch_deps_num;
+    b32    _pch_dirty;
+
+    /* --- Records ---  */
+    /* hash of compile command, w/o files */
+    u32    _fingerprint;
+
+    /* --- Stats ---  */
+    /* [us] spent in pre-build          */
+    u64    _prebuild_time;
+    /* linked this build, or would be   */
+    b32    _relinked;
+    /* hash of link command, with objects   */
+    u32    _link_fingerprint;
+
+    /* --- Job pools ---  */
+    /* [pool] of compile_pool, link_pool    */
+    int  _compile_pool;
+    int  _link_pool;
+
 } Target_Private;
 
 typedef struct Config_Private {
@@ -329,6 +527,9 @@ MACE_TARGET_DEFINITION
 
 MACE_CONFIG_DEFINITION
 
+/* Macefile linked with libmace.a: types only */
+#ifndef MACE_LIBRARY
+
 typedef struct Mace_Args {
     char *user_target;
     char *macefile;
@@ -336,26 +537,25 @@ typedef struct Mace_Args {
     char *dir;
     char *cc;
     char *ar;
+    char *pools;
+    char *trace;
     u64   user_target_hash;
     u64   user_config_hash;
     int   jobs;
+    int   jobs_min;
+    int   stats;    /* MACE_STATS */
     b32   debug;
     b32   silent;
     b32   dry_run;
     b32   build_all;
+    b32   report;
+    b32   explain;
+    b32   no_plan;
 } Mace_Args;
 
 void Mace_Args_Free(Mace_Args *args);
 
 /***************** CONSTANTS ****************/
-#define MACE_VER_MAJOR 5
-#define MACE_VER_MINOR 0
-#define MACE_VER_PATCH 3
-#define MACE_VER_STRING \
-    STRINGIFY(MACE_VER_MAJOR)"."\
-    STRINGIFY(MACE_VER_MINOR)"."\
-    STRINGIFY(MACE_VER_PATCH)
-
 #define MACE_SHA1_EXT ".sha1"
 
 enum MACE_PRIVATE_CONSTANTS {
@@ -365,8 +565,22 @@ enum MACE_PRIVATE_CONSTANTS {
     MACE_CWD_BUFFERSIZE     =  256,
     MACE_OBJDEP_BUFFER      = 4096,
     MACE_JOBS_DEFAULT       =   12,
+    MACE_LINK_JOBS_DEFAULT  =    2,
+    MACE_JOBS_MIN_DEFAULT   =    1,
+    /* Memory kept free when adapting jobs [KiB] */
+    MACE_MEM_RESERVE        = 262144,
+    /* Jobs younger than this may not be
+    ** resident yet in MemAvailable [us] */
+    MACE_RSS_RAMP           = 1000000,
+    /* Load, memory sampled at most once per [us]:
+    ** jobs started since are in MACE_RSS_RAMP */
+    MACE_JOBS_SAMPLE        = 100000,
     MACE_SHA1_EXT_LEN       =    5,
     MACE_USAGE_MIDCOLW      =   12,
+    /* Compile records kept in .t files */
+    MACE_RECORD_HISTORY     =    8,
+    /* Objects listed per --report section */
+    MACE_REPORT_TOP         =   10,
     /* SHA1DC_LEN is a magic number in sha1dc */
     SHA1DC_LEN              =   20
 };
@@ -380,6 +594,13 @@ enum MACE_TARGET {
     MACE_TARGET_DEFAULT
 };
 
+enum MACE_POOL {
+    MACE_POOL_NULL          =  -1,
+    MACE_POOL_COMPILE       =   0,
+    MACE_POOL_LINK          =   1,
+    MACE_POOL_DEFAULT_NUM   =   2
+};
+
 enum MACE_ARGV {
     /* single source compilation */
     MACE_ARGV_CC,
@@ -388,6 +609,43 @@ enum MACE_ARGV {
     MACE_ARGV_OTHER
 };
 
+enum MACE_PROCESS {
+    /* Mace_Process.index is: */
+    MACE_PROCESS_PRECOMPILE,    /* [argc_source]    */
+    MACE_PROCESS_COMPILE,       /* [argc_source]    */
+    MACE_PROCESS_SHARD,         /* [shard]          */
+    MACE_PROCESS_PCH,           /* unused           */
+    MACE_PROCESS_LINK           /* 0, or partial group + 1 */
+};
+
+enum MACE_STATS {
+    /* Mace_Args.stats is: */
+    MACE_STATS_NONE,
+    MACE_STATS_TEXT,
+    MACE_STATS_JSON
+};
+
+enum MACE_REASON {
+    /* Why object recompiles, target relinks */
+    MACE_REASON_NONE,
+    MACE_REASON_BUILD_ALL,      /* -B                       */
+    MACE_REASON_SOURCE,         /* source checksum changed  */
+    MACE_REASON_OBJECT,         /* object missing           */
+    MACE_REASON_HEADER,         /* header checksum changed  */
+    MACE_REASON_PCH,            /* precompiled header dirty */
+    MACE_REASON_UNITY,          /* source of chunk dirty    */
+    MACE_REASON_FLAGS,          /* compile command changed  */
+    MACE_REASON_COMPILED,       /* objects compiled         */
+    MACE_REASON_ALLATONCE,      /* objects always compiled  */
+    MACE_REASON_OUTPUT,         /* output missing           */
+    MACE_REASON_NEWER,          /* object newer than output */
+    MACE_REASON_LINKED,         /* linked target newer      */
+    MACE_REASON_THIN,           /* archive thin or not      */
+    MACE_REASON_PROFILE,        /* PGO profile changed      */
+    MACE_REASON_LINK_FLAGS,     /* link command changed     */
+    MACE_REASON_NUM
+};
+
 enum MACE_CHECKSUM_MODE {
     MACE_CHECKSUM_MODE_NULL,
     MACE_CHECKSUM_MODE_SRC,
@@ -412,26 +670,6 @@ static Mace_Args mace_parse_args(int     argc,
 static Mace_Args mace_parse_env(void);
 static Mace_Args mace_combine_args_env(Mace_Args args,
                                        Mace_Args env);
-/* --- setters --- */
-
-/* -- Archiver -- */
-/* NOTE: Automatically set in mace_set_compiler */
-/* Archiver setting priority:
-**      a- input argument (with -a,--ar)
-**      b- config
-**      c- macefile       (with MACE_SET_ARCHIVER) */
-#define MACE_SET_ARCHIVER(archiver) \
-    mace_set_archiver(STRINGIFY(archiver))
-static void  mace_set_archiver(     const char *ar);
-
-/* -- cc_depflag -- */
-/* NOTE: Automatically set in mace_set_compiler */
-/* Compiler flag to build .d dependency files
-** Ex: gcc -MM ... */
-#define MACE_SET_CC_DEPFLAG(cc_depflag) \
-    mace_set_cc_depflag(STRINGIFY(cc_depflag))
-static void  mace_set_cc_depflag(const char *depflag);
-
 /* --- mace_utils --- */
 static char  *mace_str_buffer(const char *const strlit);
 
@@ -448,9 +686,15 @@ static void mace_checksum(          Mace_Checksum *chk);
 static b32  mace_checksum_cmp(const Mace_Checksum *chk);
 
 static b32  mace_file_changed(const char *checksum,
-                              const char *header);
+                              const char *header,
+                              u8 *staged);
 static void mace_checksum_w(Mace_Checksum *checksum);
 static void mace_checksum_r(Mace_Checksum *checksum);
+static void mace_checksum_write(const char *checksum_path,
+                                const u8 *hash);
+static void mace_file_write(const char *file_path,
+                            const void *data,
+                            size_t size);
 
 /* --- mace_hashing --- */
 static u64 mace_hash(const char *str);
@@ -463,9 +707,15 @@ static char **mace_argv_flags(int            *len,
                               const char     *flag,
                               b32             path,
                               const char     *separator);
+static int    mace_path_flag(const char *flag);
+static char  *mace_flag_abs( const char *flag, int pre);
 
 /* -- Config struct OOP -- */
 static void mace_Config_Free(Config *config);
+static void mace_Config_Free_flags(Config *config);
+static void mace_Config_flag_add(Config      *config,
+                                 const char  *token,
+                                 int         *len);
 
 /* -- Target struct OOP -- */
 /* - Free - */
@@ -528,15 +778,56 @@ static void mace_Target_Header_Add_Objpath(Target *target,
 /* - Checksums - */
 static b32 mace_Source_Checksum(const Target *target,
                                 const char *s,
-                                const char *o);
+                                const char *o,
+                                u8 *staged);
+static char *mace_Source_checksum_path(const Target *target,
+                                       const char *obj_path);
+/* Checksums of changed sources, headers are
+** staged, written after objects compile:
+** failed or interrupted builds resume there */
+static void mace_Target_Checksum_Commit(Target *target,
+                                        int source_i);
+static void mace_Target_Checksums_Commit(Target *target);
+static void mace_headers_commit(void);
 static void mace_Headers_Checksums(const Target *target);
 static void mace_Headers_Checksums_Checks(Target *target);
+/* Digest of checksums of headers an object was
+** compiled with, in .hs file next to it */
+static u64   mace_Target_headers_digest(const Target *target,
+                                        int source_i);
+static char *mace_headers_digest_path(const char *object);
+static u64   mace_headers_digest_read(const char *object);
+static void  mace_headers_digest_write(const char *object,
+                                       u64 digest);
+
+/* Header checked this build, by all targets */
+typedef struct Mace_Header_Check {
+    u64         hash;       /* of header, checksum path */
+    const char *checksum;   /* path of .sha1 file       */
+    b32         changed;
+    u32         caused;     /* recompiles, all targets  */
+    u8          staged[SHA1DC_LEN]; /* after build  */
+} Mace_Header_Check;
+
+static u64  mace_header_check_hash(const Target *target,
+                                   int header_order);
+static int  mace_header_checked(u64 hash);
 
 /* - argv - */
 static void mace_argv_add_config(Target *target,
                                  char ** *argv,
                                  int *argc,
                                  int *arg_len);
+static void mace_argv_add_linker(char ** *argv,
+                                 int *argc,
+                                 int *arg_len,
+                                 b32 partial);
+static b32  mace_linker_probe(const char *linker);
+static b32  mace_lto(void);
+static void mace_argv_add_lto(char ** *argv,
+                              int *argc,
+                              int *arg_len,
+                              b32 link);
 
 static void mace_Target_argv_grow(Target  *t);
 static void mace_Target_Parse_User(Target  *t);
@@ -555,11 +846,34 @@ static void   mace_argv_free(char   **argv,
 /* - recompilation flag - */
 static void mace_Target_Recompiles_Add(Target *target,
                                        b32 add);
+static void mace_Target_Reason(Target *target,
+                               int source_i,
+                               int reason);
+
+/* - compile command changes - */
+/* Fingerprint of compile command saved in
+** <obj_dir>/<target>.flags after compiling:
+** all sources recompile if it changes. */
+static char *mace_Target_flags_path(const Target *target);
+static void  mace_Target_Flags_Check(Target *target);
+static void  mace_Target_Flags_Write(const Target *target);
 
 /* - compilation - */
 static void mace_Target_compile(            Target *t);
 static void mace_Target_precompile(         Target *t);
 static void mace_Target_compile_allatonce(  Target *t);
+static void mace_Target_compile_batch(      Target *t);
+static void mace_Target_compile_unity(      Target *t);
+static void mace_Target_compile_pch(        Target *t);
+
+/* - precompiled header - */
+/* Stub <obj_dir>/pch/<target>_pch.h #includes pch.
+** Sources compile with -include stub: gcc, clang
+** use stub.gch, stub.pch next to it if valid. */
+static const char *mace_pch_ext(void);
+static void mace_Target_Pch(        Target *t);
+static void mace_Target_Pch_Deps(   Target *t);
+static void mace_Target_Pch_Check(  Target *t);
 
 /* --- mace_glob --- */
 static int     mace_globerr(const char *path,
@@ -570,15 +884,42 @@ static glob_t  mace_glob_sources(const char *path);
 static pid_t mace_exec(const char *exec,
                        char *const arguments[]);
 static void  mace_wait_pid(int pid);
+static void  mace_pid_status(int status);
 static void  mace_exec_print(char *const arguments[],
                              size_t argnum);
 
 /* --- mace_build --- */
 /* -- linking -- */
 static void mace_link_executable(       Target *t);
+static char **mace_link_partial(        Target *t,
+                                        int *argc);
 static void mace_link_static_library(   Target *t);
 static void mace_link_dynamic_library(  Target *t);
-
+static char **mace_Target_link_objects(const Target *t,
+                                       int *argc);
+static char  *mace_Target_output(const Target *t);
+static int    mace_Target_link_reason(const Target *t,
+                                      int *linked);
+static void   mace_argv_add_links(const Target *t,
+                                  char ***argv,
+                                  int *argc,
+                                  int *arg_len);
+static void   mace_argv_add_links_visit(const Target *t,
+                                        char ***argv,
+                                        int *argc,
+                                        int *arg_len,
+                                        b32 *visited);
+
+/* - link command changes - */
+/* Fingerprint of link command saved in
+** <obj_dir>/<target>.link after linking:
+** target relinks if it changes, or is missing. */
+static u32    mace_Target_link_fingerprint(const Target *t);
+static char  *mace_Target_link_path(const Target *t);
+static b32    mace_Target_Link_Changed(const Target *t);
+static void   mace_Target_Link_Write(const Target *t);
+
+/* Phony, object libraries: not linked */
 typedef void (*mace_link_t)(Target *);
 mace_link_t mace_link[MACE_TARGET_KIND_NUM - 1] = {
     mace_link_executable,
@@ -624,6 +965,7 @@ static int mace_isWildcard( const char *str);
 static void  mace_mkdir(const char *path);
 static void  mace_make_dirs(void);
 static void  mace_object_path(  const char *source);
+static void  mace_object_path_mirror(const char *source);
 static char *mace_library_path( const char *name,
                                 int kind);
 static char *mace_checksum_filename(const char *file,
@@ -631,11 +973,488 @@ static char *mace_checksum_filename(const char *file,
 static char *mace_executable_path(const char *name);
 
 /* --- mace_pqueue --- */
-static void  mace_pqueue_put(pid_t pid);
-static pid_t mace_pqueue_pop(void);
+typedef struct Mace_Process {
+    pid_t    pid;       /* 0 if slot is free        */
+    u64      start;     /* [us]                     */
+    Target  *target;
+    int      kind;      /* MACE_PROCESS             */
+    int      index;     /* [argc_source] or [shard] */
+    int      pool;      /* [pool] process runs in   */
+    u64      rss;       /* expected peak [KiB]      */
+    int      token;     /* jobserver token, -1: none */
+} Mace_Process;
+
+static void  mace_pqueue_put(pid_t    pid,
+                             Target  *target,
+                             int      kind,
+                             int      index,
+                             int      pool,
+                             u64      rss);
+static void  mace_pqueue_wait(void);
+static void  mace_pqueue_reap(int i,
+                              int status,
+                              const struct rusage *usage);
+static void  mace_pqueue_drain(void);
+static b32   mace_pqueue_busy(const Target *target,
+                              b32 link);
+static b32   mace_pqueue_running(const Target *target,
+                                 int kind);
+
+/* --- mace_pool --- */
+typedef struct Mace_Pool {
+    u64 hash;   /* pool name hash               */
+    int limit;  /* max concurrent processes     */
+    int num;    /* processes running            */
+    b32 link;   /* links only: no served token  */
+} Mace_Pool;
+
+static int  mace_pool_order(u64 hash);
+static int  mace_pool_find(const char *name,
+                           int fallback);
+static void mace_pool_wait(int pool,
+                           u64 rss);
+
+/* --- mace_jobs --- */
+/* Jobs adapt to machine: new jobs wait if
+** memory or CPUs are used up, and
+** at least jobs_min jobs always run. */
+typedef struct Mace_Jobs_Sample {
+    u64     time;       /* [us], 0: never sampled   */
+    u64     available;  /* MemAvailable [KiB]       */
+    double  load;       /* 1 min, -1: unknown       */
+    long    cpus;
+} Mace_Jobs_Sample;
+
+static b32  mace_jobs_admit(u64 rss);
+static void mace_jobs_sample(void);
+static u64  mace_mem_available(void);
+
+/* --- mace_jobserver --- */
+/* GNU make jobserver: one slot budget shared
+** by all processes of the tree.
+**  - Client: if MAKEFLAGS has --jobserver-auth
+**  - Server: otherwise, exports MAKEFLAGS to
+**    children that can use it: make, nested mace
+**    in cmd_pre, cmd_post, gcc LTO links
+** Every job but the first needs a token. */
+typedef struct Mace_Jobserver {
+    int   read;     /* blocking, shared with children */
+    int   write;    /* shared with children           */
+    int   poll;     /* own non-blocking read, -1: off */
+    int   held;     /* token for next job, -1: none   */
+    b32   server;
+    char *makeflags;  /* previous MAKEFLAGS, server */
+} Mace_Jobserver;
+
+static void mace_jobserver_init(int jobs,
+                                b32 serve);
+static b32  mace_jobserver_wanted(void);
+static b32  mace_jobserver_client(const char *makeflags);
+static b32  mace_jobserver_server(int jobs);
+static b32  mace_jobserver_open(const char *auth);
+static b32  mace_jobserver_acquire(void);
+static void mace_jobserver_release(int token);
+static void mace_jobserver_free(void);
+static void mace_parse_pools(const char *str,
+                             const char *separator);
+static void mace_pools_resolve(const Mace_Args *args,
+                               const Config *config);
+
+static void mace_Target_wait(const Target *target,
+                             b32 link);
+static void mace_Target_wait_deps(const Target *target);
+
+/* --- mace_schedule --- */
+/* Compile durations and peak memory of objects
+** are recorded in obj_dir as .t files, next
+** to objects. Dirty objects, and targets in
+** build_order, are scheduled longest
+** critical path first.
+**  - .t files keep last MACE_RECORD_HISTORY
+**    records, newest first */
+typedef struct Mace_Record {
+    u32 duration;       /* [ms], 0 if unknown   */
+    u32 rss;            /* [KiB], 0 if unknown  */
+    u32 status;         /* exit status          */
+    u32 fingerprint;    /* of compile command   */
+} Mace_Record;
+
+static u64  mace_time_us(void);
+static void mace_record_read(const char *object,
+                             Mace_Record *record);
+static int  mace_record_history(const char *object,
+                                Mace_Record *records);
+static u32  mace_Target_fingerprint(const Target *target);
+static void mace_record_write(const char *object,
+                              const Mace_Record *record);
+static void mace_Target_Durations(Target *target,
+                                  u64 *ms,
+                                  u64 *bytes);
+static void mace_Target_Schedule(Target *target,
+                                 u64 ms,
+                                 u64 bytes);
+static int  mace_weight_cmp(const void *a,
+                            const void *b);
+static u64  mace_Target_Shards(Target *target);
+static u64  mace_Target_Shards_Fill(Target *target,
+                                    int shard_num,
+                                    const int *shard_of,
+                                    u64 *loads,
+                                    const int *counts);
+static void mace_Target_Shard_Record(Target *target,
+                                     int shard,
+                                     u64 duration,
+                                     u64 rss,
+                                     int status);
+static void mace_schedule(void);
+static void mace_build_order_critical(void);
+
+/* --- mace_trace --- */
+/* -T,--trace FILE writes Chrome trace-event JSON,
+** for chrome://tracing or ui.perfetto.dev.
+**  - tid 0: mace itself, internal phases
+**  - tid N: processes in job slot N - 1 */
+static void mace_trace_open(const char *path);
+static void mace_trace_close(void);
+static void mace_trace_slots(int num);
+static u64  mace_trace_begin(void);
+static void mace_trace_end(const char *name,
+                           const char *detail,
+                           u64 start);
+static void mace_trace_event(const char *name,
+                             const char *cat,
+                             const char *detail,
+                             int tid,
+                             u64 start,
+                             u64 end);
+static void mace_trace_process(const Mace_Process *process,
+                               int slot,
+                               u64 end);
+
+/* --- mace_report --- */
+/* -R,--report lists slowest objects, biggest
+** regressions versus their previous records,
+** totals of targets, and headers by fan-out,
+** instead of building.
+**  - Checksums not written: report doesn't
+**    hide changes from next build
+**  - Recompiles caused by changed header saved
+**    in .r file, next to its checksum */
+typedef struct Mace_Report {
+    Target *target;
+    int     source;     /* [argc_source]            */
+    u32     duration;   /* [ms] newest record       */
+    u32     previous;   /* [ms] mean of older ones  */
+    u32     rss;        /* [KiB]                    */
+    b32     flags;      /* fingerprint changed      */
+    b32     failed;
+} Mace_Report;
+
+typedef struct Mace_Fanout {
+    u64         hash;       /* of header path           */
+    const char *header;
+    const char *checksum;   /* path of .sha1 file       */
+    int         tus;        /* sources including it     */
+    u64         cost;       /* [ms] of its sources      */
+    int         recompiles; /* caused, recent changes   */
+    int         changes;    /* recent changes recorded  */
+} Mace_Fanout;
+
+static void mace_report(void);
+static void mace_report_headers(void);
+static int  mace_report_slowest_cmp(const void *a,
+                                    const void *b);
+static int  mace_report_regression_cmp(const void *a,
+                                       const void *b);
+static int  mace_fanout_hash_cmp(const void *a,
+                                 const void *b);
+static int  mace_fanout_cost_cmp(const void *a,
+                                 const void *b);
+static int  mace_fanout_recompiles_cmp(const void *a,
+                                       const void *b);
+static void mace_recompiles_record(void);
+static char *mace_recompiles_path(const char *checksum);
+static int  mace_recompiles_history(const char *checksum,
+                                    u32 *counts);
+static void mace_recompiles_write(const char *checksum,
+                                  u32 count);
+
+/* --- mace_explain --- */
+/* -E,--explain prints why objects recompile,
+** after pre-build, and why targets relink. */
+static void mace_explain(void);
+static void mace_explain_source(const Target *target,
+                                int source_i);
+
+/* --- mace_pgo --- */
+/* Profile guided optimization, gcc .gcda files:
+**  1. MACE_PGO_GENERATE config builds in own
+**     obj_dir, build_dir, then runs train
+**  2. MACE_PGO_USE config copies profiles next
+**     to objects. Changed ones recompile: digest
+**     of profile object compiled with in .pd
+**     file next to it, written after compile */
+static void  mace_pgo_dirs(void);
+static char *mace_pgo_profile(const char *object,
+                              b32 trained);
+static char *mace_pgo_digest_path(const char *object);
+static u64   mace_pgo_digest_read(const char *object);
+static b32   mace_Target_Profile(Target *target,
+                                 int source_i);
+static void  mace_pgo_train(void);
+
+static const char *mace_reasons[MACE_REASON_NUM] = {
+    "up to date",
+    "-B",
+    "source changed",
+    "object missing",
+    "header changed",
+    "precompiled header dirty",
+    "source of unity chunk dirty",
+    "compile flags changed",
+    "objects compiled",
+    "all at once target",
+    "output missing",
+    "object newer than output",
+    "linked target newer",
+    "archive format changed",
+    "profile changed",
+    "link command changed"
+};
+
+/* --- mace_plan --- */
+/* Files a build depends on, stat'd after build,
+** saved to <obj_dir>/mace.plan. Next build
+** skips pre-build and build if key and stats
+** of all files unchanged: no-op.
+**  - Key: builder, targets, config, compiler
+**  - Inputs: sources, headers, source dirs
+**  - Outputs: objects, pch, targets
+**  - Inputs modified in second plan written
+**    are stale: same-second edits unseen
+**  - Not written if targets have commands,
+**    messages or allatonce: always run */
+#define MACE_PLAN_MAGIC 0x31706D6Du /* "mmp1" */
+
+typedef struct Mace_Plan_Header {
+    u32 magic;      /* MACE_PLAN_MAGIC      */
+    u32 num;        /* files                */
+    u64 key;        /* of builder, targets  */
+    u64 time;       /* [s] pre-build start  */
+    u64 paths_len;  /* [bytes] after files  */
+} Mace_Plan_Header;
+
+typedef struct Mace_Plan_File {
+    u64 hash;       /* of path              */
+    u64 mtime;      /* [s], 0 if missing    */
+    u64 size;       /* [bytes]              */
+    u32 path;       /* offset in paths      */
+    u32 input;      /* edited by user       */
+} Mace_Plan_File;
+
+typedef struct Mace_Plan {
+    Mace_Plan_File  *files;
+    int              num;
+    int              len;
+    char            *paths;
+    size_t           paths_num;
+    size_t           paths_len;
+} Mace_Plan;
+
+static char *mace_plan_path(void);
+static u64   mace_plan_hash(u64 hash, const char *str);
+static u64   mace_plan_key(void);
+static b32   mace_plan_fresh(void);
+static b32   mace_plan_Target(Mace_Plan *plan,
+                              const Target *target);
+static void  mace_plan_add(Mace_Plan *plan,
+                           const char *path,
+                           b32 input);
+static void  mace_plan_write(void);
+static int   mace_plan_cmp(const void *a, const void *b);
+
+/* --- mace_ar --- */
+/* Static libraries archived in-process if
+** archiver is MACE_AR_BUILTIN: no process,
+** GNU ar format with symbol index.
+**  - Members with same size, mtime as their
+**    object copied from previous archive,
+**    symbols from its index: only changed
+**    objects read
+**  - thin targets: members refer to objects
+**  - Symbols read from ELF objects. LTO
+**    objects, LLVM bitcode, archives above
+**    4GiB: external archiver MACE_AR_FALLBACK,
+**    gcc-ar for gcc, llvm-ar for clang */
+#define MACE_AR_BUILTIN     "mace"
+#define MACE_AR_FALLBACK    "ar"
+#define MACE_AR_MAGIC       "!<arch>\n"
+#define MACE_AR_THIN        "!<thin>\n"
+#define MACE_AR_MAGIC_LEN   8
+#define MACE_AR_HEADER_LEN  60
+#define MACE_AR_NAME_LEN    16
+#define MACE_AR_COPY        65536
+
+typedef struct Mace_Ar_Member {
+    const char *path;       /* object                   */
+    const char *name;       /* basename, path if thin   */
+    u64         size;       /* [bytes]                  */
+    u64         mtime;      /* [s]                      */
+    u64         header;     /* offset in archive        */
+    i64         old;        /* data in previous, or -1  */
+    i64         long_name;  /* in names table, or -1    */
+    int         syms_num;
+} Mace_Ar_Member;
+
+typedef struct Mace_Ar_Symbol {
+    u64         header;     /* of member                */
+    const char *name;
+    int         order;      /* in index                 */
+} Mace_Ar_Symbol;
+
+/* Members of previous archive, reused */
+typedef struct Mace_Ar_Previous {
+    FILE            *file;
+    Mace_Ar_Member  *members;
+    int              num;
+    int              len;
+    int              cursor;    /* last member reused   */
+    int             *syms;      /* [member] first       */
+    b32             *used;      /* [member]             */
+    Mace_Ar_Symbol  *symbols;
+    int              symbols_num;
+    char            *index;     /* symbol index member  */
+    char            *names;     /* long names, owned    */
+    size_t           names_len;
+} Mace_Ar_Previous;
+
+typedef struct Mace_Ar {
+    Mace_Ar_Member  *members;
+    int              num;
+    char            *syms;      /* names, NUL ended     */
+    size_t           syms_len;
+    size_t           syms_size;
+    int              syms_num;
+    char            *names;     /* long names table     */
+    size_t           names_len;
+    size_t           names_size;
+    b32              thin;
+} Mace_Ar;
+
+static b32   mace_ar_write(const Target *target,
+                           const char *lib);
+static b32   mace_ar_previous(Mace_Ar_Previous *previous,
+                              const char *lib,
+                              b32 thin);
+static void  mace_ar_previous_free(Mace_Ar_Previous *previous);
+static int   mace_ar_previous_find(Mace_Ar_Previous *previous,
+                                   const char *name);
+static b32   mace_ar_previous_same(Mace_Ar_Previous *previous,
+                                   int old, const u8 *buf,
+                                   size_t len);
+static b32   mace_ar_recompiled(const Target *target, int i);
+static int   mace_ar_symbol_cmp(const void *a, const void *b);
+static void  mace_ar_symbol_add(Mace_Ar *ar,
+                                Mace_Ar_Member *member,
+                                const char *name);
+static void  mace_ar_name_add(Mace_Ar *ar,
+                              Mace_Ar_Member *member);
+static int   mace_ar_elf_symbols(Mace_Ar *ar,
+                                 Mace_Ar_Member *member,
+                                 const u8 *buf, size_t len);
+static u64   mace_ar_elf_read(const u8 *p, int bytes, b32 big);
+static void  mace_ar_be32(FILE *file, u32 value);
+static void  mace_ar_header(FILE *file, const char *name,
+                            u64 mtime, int mode, u64 size);
+static void  mace_ar_copy(FILE *out, FILE *in,
+                          u64 size, const char *path);
+static u8   *mace_ar_file_read(const char *path, size_t *len);
+static b32   mace_ar_thin(const char *lib);
+static void  mace_ar_free(Mace_Ar *ar);
+
+/* --- mace_stats --- */
+/* -S,--stats prints time spent in phases of
+** main, and work done or skipped, after build.
+**  - Phases timed by themselves: also when
+**    user overrides main */
+typedef struct Mace_Stats {
+    u64 start;          /* [us] of user mace() */
+    u64 pre_user;       /* [us] */
+    u64 user;           /* [us] */
+    u64 post_user;      /* [us] */
+    u64 pre_build;      /* [us] */
+    u64 build;          /* [us] */
+    u64 pre_sources;    /* [us] globbing, source checksums */
+    u64 pre_depfiles;   /* [us] generating .d files */
+    u64 pre_objdeps;    /* [us] reading .d, .ho files */
+    u64 pre_headers;    /* [us] header checksums, checks */
+    u64 pre_unity;      /* [us] chunking unity sources */
+    u64 pre_schedule;   /* [us] build order, schedule */
+    u64 pre_plan;       /* [us] checking build plan */
+    u64 files_hashed;
+    u64 bytes_hashed;
+    int d_loads;
+    int ho_loads;
+    int processes;
+    int objects_skipped;
+    int links_skipped;
+    int plan_checks;    /* files stat'd in plan */
+    u64 plan_time;      /* [s] pre-build start  */
+    b32 plan_fresh;     /* no-op, build skipped */
+} Mace_Stats;
+
+static void mace_stats_print(int format);
+
+/* --- mace_util --- */
+/* Slot utilization: when busy slots change,
+** slot-time since last change is busy, or idle
+** blamed on what mace was waiting for.    */
+enum MACE_IDLE {
+    MACE_IDLE_MACE      = 0, /* spawning, hashing   */
+    MACE_IDLE_PREBUILD  = 1, /* serial pre-build    */
+    MACE_IDLE_POOL      = 2, /* pool limit reached  */
+    MACE_IDLE_ADMIT     = 3, /* load, memory, jobserver */
+    MACE_IDLE_OBJECTS   = 4, /* objects before link */
+    MACE_IDLE_LINKED    = 5, /* linked targets      */
+    MACE_IDLE_SERIAL    = 6, /* mace_wait_pid: allatonce */
+    MACE_IDLE_CMD       = 7, /* cmd_pre, cmd_post   */
+    MACE_IDLE_DRAIN     = 8, /* last processes      */
+    MACE_IDLE_NUM
+};
+
+typedef struct Mace_Util {
+    u64 last;                   /* [us] 0 if stopped    */
+    u64 busy;                   /* [slot us]            */
+    u64 idle[MACE_IDLE_NUM];    /* [slot us]            */
+    int cause;                  /* MACE_IDLE            */
+    int serial;                 /* process outside pqueue */
+} Mace_Util;
+
+static void mace_util_tick(void);
+static int  mace_util_cause(int cause);
+
+/* --- mace_unity --- */
+/* Unity targets compile generated .c files in
+** obj_dir, each #include-ing sources of one
+** chunk. Chunks are runs of sources sorted by
+** path, ending at paths whose hash is 0 mod N:
+** edits only recompile their chunk, adding or
+** removing a source only changes its chunk. */
+static void mace_Target_Unity(Target *target);
+static u64  mace_Target_Unity_Shards(Target *target);
+static int  mace_path_cmp(const void *a,
+                          const void *b);
 
 /* --- mace utils --- */
 static void mace_chdir(const char *path);
+static b32  mace_write_changed(const char *path,
+                               const char *content);
+static void mace_remove_stale(const Target *target,
+                              const char *kind,
+                              char **keep,
+                              int keep_num);
+static void mace_json_string(FILE *file,
+                             const char *str);
 
 /******************* GLOBALS ********************/
 #define false 0
@@ -647,13 +1466,68 @@ static b32 verbose    = false;
 static b32 dry_run    = false;
 /* build_all: Build all targets */
 static b32 build_all  = false;
+/* report: Pre-compile, report on records */
+static b32 report     = false;
+/* explain: Print why objects, targets rebuild */
+static b32 explain    = false;
+/* no_plan: Don't read, save build plan */
+static b32 no_plan    = false;
+/* jobs_min: jobs always allowed at once */
+static int jobs_min   = MACE_JOBS_MIN_DEFAULT;
+
+/* -- GNU make jobserver -- */
+static Mace_Jobserver jobserver = {-1, -1, -1, -1, false, NULL};
+/* -- Load, memory for mace_jobs_admit -- */
+static Mace_Jobs_Sample jobs_sample = {0};
 
 /* --- Processes --- */
 /* 1. Compile objects in parallel. */
-/* 2. Compile targets in series. */
-static pid_t   *pqueue  = NULL;
-static int      pnum    =  0;
-static int      plen    = -1;
+/* 2. Link targets in parallel, after their
+**    objects and dependencies. */
+/* [plen] process slots, sum of pool limits */
+static Mace_Process *pqueue = NULL;
+static int           pnum   =  0;
+static int           plen   = -1;
+
+/* -- Job pools -- */
+/* [pool] as added, "compile" & "link" first */
+static Mace_Pool pools[MACE_POOL_MAX];
+static int       pool_num   = 0;
+
+/* -- Trace -- */
+/* NULL if not tracing */
+static FILE *trace_file     = NULL;
+static u64   trace_start    = 0;
+static b32   trace_first    = true;
+/* Process that opened trace: only one to end it,
+** at exit too, e.g. on failed build */
+static pid_t trace_pid      = 0;
+static b32   trace_atexit   = false;
+
+/* -- Flags followed by a path -- */
+/* Joined ("-Iinc") or next argv ("-include x.h") */
+#define MACE_PATH_FLAG_NUM 10
+static const char *mace_path_flags[MACE_PATH_FLAG_NUM] = {
+    "-I", "-L", "-B", "-iquote", "-isystem", "-idirafter",
+    "-include", "-imacros", "--sysroot=", "-fprofile-use="
+};
+
+/* -- Stats -- */
+/* Reset by mace_pre_user */
+static Mace_Stats stats;
+static Mace_Util  util;
+static const char *mace_idles[MACE_IDLE_NUM] = {
+    "mace", "pre_build", "pool", "admit", "objects",
+    "linked", "serial", "commands", "drain"
+};
+
+/* -- Headers checked this build -- */
+/* Checksum files are shared by targets: first
+** check of header is the only one that sees
+** its change. Later targets reuse it.      */
+static Mace_Header_Check *hdrs_checked     = NULL;
+static int                hdrs_checked_num = 0;
+static int                hdrs_checked_len = 0;
 
 /* -- separator -- */
 static char mace_separator[2]           = " ";
@@ -662,12 +1536,16 @@ static char mace_command_separator[3]   = "&&";
 /* -- Compiler -- */
 /* cc: gcc, clang or tcc */
 static char cc[MACE_CC_BUFFER]         = "gcc";
-/* ar: ar, llvm-ar or tcc -ar */
-static char ar[MACE_CC_BUFFER]         = "ar";
+/* ar: MACE_AR_BUILTIN, ar, llvm-ar or tcc -ar */
+static char ar[MACE_CC_BUFFER]         = MACE_AR_BUILTIN;
 
 /* flag to create .d file */
 static char cc_depflag[MACE_CC_BUFFER] = "-MM";
 
+/* Config linker runs: -1 unprobed, reset by */
+/* mace_pre_user. Probed at first link */
+static int linker_ok = -1;
+
 /* -- current working directory -- */
 static char cwd[MACE_CWD_BUFFERSIZE];
 
@@ -715,6 +1593,11 @@ static char     *obj_dir     = NULL;
 /* targets */
 static char     *build_dir   = NULL;
 
+/* -- qsort context: _weights of scheduled target -- */
+static u64      *mace_sort_weights = NULL;
+/* -- qsort context: paths of unity target -- */
+static const char **mace_sort_paths = NULL;
+
 /* -- mace_globals control -- */
 static void mace_object_grow(void);
 
@@ -3933,10 +4816,12 @@ void mace_set_cc_depflag(const char *depflag) {
     size_t to_cpy;
     
     MACE_EARLY_RET(depflag, MACE_VOID, MACE_nASSERT);
+    MACE_EARLY_RET(depflag[0] != '\0', MACE_VOID, MACE_nASSERT);
     
     len = strlen(depflag);
-    to_cpy = len > MACE_CC_BUFFER ? MACE_CC_BUFFER : len;
-    memcpy(cc_depflag, depflag, to_cpy);
+    to_cpy = len > MACE_CC_BUFFER - 1 ? MACE_CC_BUFFER - 1 : len;
+    memmove(cc_depflag, depflag, to_cpy);
+    memset(cc_depflag + to_cpy, 0, MACE_CC_BUFFER - to_cpy);
 }
 
 /*  Only place where archiver ar is set. */
@@ -3945,10 +4830,12 @@ void mace_set_archiver(const char *archiver) {
     size_t to_cpy;
 
     MACE_EARLY_RET(archiver, MACE_VOID, MACE_nASSERT);
+    MACE_EARLY_RET(archiver[0] != '\0', MACE_VOID, MACE_nASSERT);
     
     len = strlen(archiver);
-    to_cpy = len > MACE_CC_BUFFER ? MACE_CC_BUFFER : len;
-    memcpy(ar, archiver, to_cpy);
+    to_cpy = len > MACE_CC_BUFFER - 1 ? MACE_CC_BUFFER - 1 : len;
+    memmove(ar, archiver, to_cpy);
+    memset(ar + to_cpy, 0, MACE_CC_BUFFER - to_cpy);
 }
 
 /*  Only place where compiler cc is set. */
@@ -3957,23 +4844,27 @@ void mace_set_compiler(const char *compiler) {
     size_t to_cpy;
 
     MACE_EARLY_RET(compiler, MACE_VOID, MACE_nASSERT);
+    MACE_EARLY_RET(compiler[0] != '\0', MACE_VOID, MACE_nASSERT);
 
     len = strlen(compiler);
-    to_cpy = len > MACE_CC_BUFFER ? MACE_CC_BUFFER : len;
-    memcpy(cc, compiler, to_cpy);
+    to_cpy = len > MACE_CC_BUFFER - 1 ? MACE_CC_BUFFER - 1 : len;
+    memmove(cc, compiler, to_cpy);
+    memset(cc + to_cpy, 0, MACE_CC_BUFFER - to_cpy);
 
     if (strstr(cc, "gcc") != NULL) {
         mace_set_cc_depflag("-MM");
-        mace_set_archiver("ar");
+        mace_set_archiver(MACE_AR_BUILTIN);
     } else if (strstr(cc, "tcc") != NULL) {
         mace_set_cc_depflag("-MD");
         mace_set_archiver("tcc -ar");
     } else if (strstr(cc, "clang") != NULL) {
         mace_set_cc_depflag("-MM");
-        mace_set_archiver("llvm-ar");
+        mace_set_archiver(MACE_AR_BUILTIN);
     } else {
-        fprintf(stderr, "unknown compiler '%s'. \n", compiler);
-        exit(1);
+        /* Unknown: gcc defaults, macefile sets */
+        /* MACE_SET_CC_DEPFLAG, _ARCHIVER after */
+        mace_set_cc_depflag("-MM");
+        mace_set_archiver(MACE_AR_BUILTIN);
     }
 }
 
@@ -4061,6 +4952,47 @@ char **mace_argv_flags(int         *len,   int *argc,
     return (argv);
 }
 
+/*  Length of path flag at start of flag. */
+/*  @return -1 if flag is not followed by a path */
+int mace_path_flag(const char *flag) {
+    int i;
+    for (i = 0; i < MACE_PATH_FLAG_NUM; i++) {
+        size_t len = strlen(mace_path_flags[i]);
+        if (strncmp(flag, mace_path_flags[i], len) == 0)
+            return ((int)len);
+    }
+    return (-1);
+}
+
+/*  Flag with its path made absolute, from cwd */
+/*         of the process. Path starts at flag + pre. */
+/*  @return NULL if path is already absolute */
+char *mace_flag_abs(const char *flag, int pre) {
+    char   *abs;
+    char   *dir;
+    size_t  len;
+
+    MACE_EARLY_RET(flag != NULL, NULL, assert);
+    MACE_EARLY_RET((pre >= 0) && (flag[pre] != '\0'), NULL, MACE_nASSERT);
+    MACE_EARLY_RET(flag[pre] != '/', NULL, MACE_nASSERT);
+
+    dir = calloc(PATH_MAX, sizeof(*dir));
+    MACE_MEMCHECK(dir);
+    if (getcwd(dir, PATH_MAX) == NULL) {
+        fprintf(stderr, "getcwd() error %d: '%s'\n",
+                errno, strerror(errno));
+        exit(1);
+    }
+
+    len = pre + strlen(dir) + strlen(flag + pre) + 2;
+    abs = calloc(len, sizeof(*abs));
+    MACE_MEMCHECK(abs);
+    memcpy(abs, flag, pre);
+    sprintf(abs + pre, "%s/%s", dir, flag + pre);
+    MACE_FREE(dir);
+    return (abs);
+}
+
 /*  Parse user input target->excludes string.  */
 /*      - Split excludes using mace_separator */
 /*      - Hash file into _excludes list */
@@ -4227,6 +5159,26 @@ void mace_Target_sources_grow(Target *target) {
         bytesize = target->private._len_sources * sizeof(*target->private._recompiles);
         target->private._recompiles = calloc(1, bytesize);
     }
+    if (target->private._reasons == NULL) {
+        bytesize = target->private._len_sources * sizeof(*target->private._reasons);
+        target->private._reasons = calloc(1, bytesize);
+    }
+    if (target->private._checksums == NULL) {
+        bytesize = target->private._len_sources * SHA1DC_LEN;
+        target->private._checksums = calloc(1, bytesize);
+    }
+    if (target->private._staged == NULL) {
+        bytesize = target->private._len_sources * sizeof(*target->private._staged);
+        target->private._staged = calloc(1, bytesize);
+    }
+    if (target->private._hdrs_digests == NULL) {
+        bytesize = target->private._len_sources * sizeof(*target->private._hdrs_digests);
+        target->private._hdrs_digests = calloc(1, bytesize);
+    }
+    if (target->private._pgo_digests == NULL) {
+        bytesize = target->private._len_sources * sizeof(*target->private._pgo_digests);
+        target->private._pgo_digests = calloc(1, bytesize);
+    }
 
     /* -- Alloc objects -- */
     if (target->private._argv_objects == NULL) {
@@ -4254,6 +5206,21 @@ void mace_Target_sources_grow(Target *target) {
         bytesize = target->private._len_sources * sizeof(*target->private._recompiles);
         target->private._recompiles = realloc(target->private._recompiles, bytesize);
         memset(target->private._recompiles + target->private._len_sources / 2, 0, bytesize / 2);
+        bytesize = target->private._len_sources * sizeof(*target->private._reasons);
+        target->private._reasons = realloc(target->private._reasons, bytesize);
+        memset(target->private._reasons + target->private._len_sources / 2, 0, bytesize / 2);
+        bytesize = target->private._len_sources * SHA1DC_LEN;
+        target->private._checksums = realloc(target->private._checksums, bytesize);
+        memset(target->private._checksums + bytesize / 2, 0, bytesize / 2);
+        bytesize = target->private._len_sources * sizeof(*target->private._staged);
+        target->private._staged = realloc(target->private._staged, bytesize);
+        memset(target->private._staged + target->private._len_sources / 2, 0, bytesize / 2);
+        bytesize = target->private._len_sources * sizeof(*target->private._hdrs_digests);
+        target->private._hdrs_digests = realloc(target->private._hdrs_digests, bytesize);
+        memset(target->private._hdrs_digests + target->private._len_sources / 2, 0, bytesize / 2);
+        bytesize = target->private._len_sources * sizeof(*target->private._pgo_digests);
+        target->private._pgo_digests = realloc(target->private._pgo_digests, bytesize);
+        memset(target->private._pgo_digests + target->private._len_sources / 2, 0, bytesize / 2);
 
         /* -- Realloc objects -- */
         bytesize = target->private._len_sources * sizeof(*target->private._argv_objects);
@@ -4368,7 +5335,8 @@ void mace_Target_argv_compile(Target *target) {
     }
 
     /* --- Adding argvs common to all --- */
-    target->private._argc = MACE_ARGV_OTHER;
+    target->private._argc       = MACE_ARGV_OTHER;
+    target->private._argc_pch   = 0;
     /* -- argv user flags -- */
     if ((target->private._argc_flags > 0) && (target->private._argv_flags != NULL)) {
         int i;
@@ -4432,168 +5400,2922 @@ void mace_argv_add_config(Target *target, char ** *argv,
     }
 }
 
-/***************** mace_pqueue ******************/
-
-pid_t mace_pqueue_pop(void) {
-    MACE_EARLY_RET(pnum > 0, 0, assert);
+/*  Add config linker as flags to argv for linking. */
+/*      - -fuse-ld=<linker> if cc can run it */
+/*      - Else default linker, with warning */
+/*      - --gdb-index with split_dwarf: only gold, */
+/*        lld and mold write it, bfd doesn't. */
+/*        Not for partial links: lld rejects -r */
+void mace_argv_add_linker(char ** *argv, int *argc, int *arg_len,
+                          b32 partial) {
+    const char *linker;
+    char       *flag;
 
-    return (pqueue[--pnum]);
-}
+    if (config_num <= 0)
+        return;
+    linker = configs[mace_config].linker;
+    if ((linker == NULL) || (linker[0] == '\0'))
+        return;
 
-void mace_pqueue_put(pid_t pid) {
-    if (pnum >= plen) {
-        mace_wait_pid(pid);
+    if (linker_ok < 0) {
+        linker_ok = mace_linker_probe(linker);
+        if (!linker_ok && !silent)
+            printf("Warning! Linker '%s' unavailable to '%s'. "
+                   "Using default linker.\n", linker, cc);
     }
-    if (plen > 1) {
-        /* TODO  queue with no memmove */
-        size_t bytes = (plen - 1) * sizeof(*pqueue);
-        memmove(pqueue + 1, pqueue, bytes);
+    if (!linker_ok)
+        return;
+
+    flag    = calloc(strlen("-fuse-ld=") + strlen(linker) + 1, sizeof(*flag));
+    MACE_MEMCHECK(flag);
+    sprintf(flag, "-fuse-ld=%s", linker);
+    *argv   = mace_argv_grow(*argv, argc, arg_len);
+    (*argv)[(*argc)++] = flag;
+
+    if (configs[mace_config].split_dwarf && !partial &&
+        (strcmp(linker, "bfd") != 0)) {
+        *argv   = mace_argv_grow(*argv, argc, arg_len);
+        (*argv)[(*argc)++] = mace_str_buffer("-Wl,--gdb-index");
+    }
+}
+
+/*  Is config's link time optimization on. */
+b32 mace_lto(void) {
+    return ((config_num > 0) && configs[mace_config].lto);
+}
+
+/*  Add config LTO flags to argv. */
+/*      - Compile: -flto, clang -flto=thin */
+/*      - Link gcc: -flto=jobserver, partitions */
+/*        take jobserver tokens, -flto=<jobs> if */
+/*        no jobserver */
+/*      - Link clang: -flto-jobs=<jobs>, with lld */
+/*        cache in <obj_dir>/lto */
+/*      - jobs: compile pool's, split between */
+/*        concurrent links of link pools */
+void mace_argv_add_lto(char ** *argv, int *argc, int *arg_len,
+                       b32 link) {
+    int     i;
+    char    buffer[32];
+    b32     clang = (strstr(cc, "clang") != NULL);
+    int     links = 0;
+    int     jobs  = pools[MACE_POOL_COMPILE].limit > 0 ?
+                    pools[MACE_POOL_COMPILE].limit : 1;
+
+    if (!mace_lto())
+        return;
+
+    /* -- Concurrent links share compile jobs -- */
+    for (i = 0; i < pool_num; i++)
+        links += pools[i].link ? pools[i].limit : 0;
+    if (links > 1)
+        jobs /= links;
+    if (jobs < 1)
+        jobs = 1;
+
+    if (clang)
+        strcpy(buffer, "-flto=thin");
+    else if (!link)
+        strcpy(buffer, "-flto");
+    else if (jobserver.poll >= 0)
+        strcpy(buffer, "-flto=jobserver");
+    else
+        sprintf(buffer, "-flto=%d", jobs);
+    *argv   = mace_argv_grow(*argv, argc, arg_len);
+    (*argv)[(*argc)++] = mace_str_buffer(buffer);
+
+    if (!clang || !link)
+        return;
+
+    sprintf(buffer, "-flto-jobs=%d", jobs);
+    *argv   = mace_argv_grow(*argv, argc, arg_len);
+    (*argv)[(*argc)++] = mace_str_buffer(buffer);
+
+    /* -- ThinLTO cache: lld only -- */
+    if ((configs[mace_config].linker != NULL) &&
+        (strcmp(configs[mace_config].linker, "lld") == 0) && (linker_ok > 0)) {
+        char *cache = calloc(strlen(obj_dir) + 32, sizeof(*cache));
+        MACE_MEMCHECK(cache);
+        sprintf(cache, "%s/lto", obj_dir);
+        mace_mkdir(cache);
+        sprintf(cache, "-Wl,--thinlto-cache-dir=%s/lto", obj_dir);
+        *argv   = mace_argv_grow(*argv, argc, arg_len);
+        (*argv)[(*argc)++] = cache;
     }
-    pqueue[0] = pid;
-    pnum++;
 }
 
-/***************** mace_glob_sources ****************/
-/*  If source is a folder, get all .c files in it. */
-glob_t mace_glob_sources(const char *path) {
-    glob_t  globbed;
-    int     flags   = 0;
-    int     ret     = glob(path, flags, mace_globerr, &globbed);
+/***************** mace_pgo ******************/
+/*  Move obj_dir, build_dir to their pgo */
+/*         subdirectory: instrumented objects, */
+/*         outputs don't overwrite others. */
+void mace_pgo_dirs(void) {
+    char *dir;
 
-    if (ret != 0) {
-        fprintf(stderr, "problem with %s (%s), quitting\n", path,
-                (ret == GLOB_ABORTED ? "filesystem problem" :
-                 ret == GLOB_NOMATCH ? "no match of pattern" :
-                 ret == GLOB_NOSPACE ? "no dynamic memory" :
-                 "unknown problem\n"));
-        exit(ret);
-    }
+    mace_mkdir(obj_dir);
+    mace_mkdir(build_dir);
+    dir = calloc(strlen(obj_dir) + strlen(build_dir) + 5, sizeof(*dir));
+    MACE_MEMCHECK(dir);
+    sprintf(dir, "%s/pgo", obj_dir);
+    mace_set_obj_dir(dir);
+    sprintf(dir, "%s/pgo", build_dir);
+    mace_set_build_dir(dir);
+    MACE_FREE(dir);
+}
+
+/*  Path of profile of object <cwd>/<obj_dir>/<rel>.o */
+/*      - trained: written by training, */
+/*        <cwd>/<obj_dir>/pgo/<rel>.gcda */
+/*      - Else copy read by -fprofile-use, */
+/*        <cwd>/<obj_dir>/<rel>.gcda */
+/*  @return NULL if object not in obj_dir */
+char *mace_pgo_profile(const char *object, b32 trained) {
+    char   *profile;
+    size_t  prefix_len  = strlen(cwd) + strlen(obj_dir) + 1;
+    size_t  len         = strlen(object);
+
+    if ((len <= prefix_len + 2) || (strncmp(object, cwd, strlen(cwd)) != 0) ||
+        (strncmp(object + strlen(cwd) + 1, obj_dir, strlen(obj_dir)) != 0))
+        return (NULL);
 
-    return (globbed);
+    profile = calloc(len + 16, sizeof(*profile));
+    MACE_MEMCHECK(profile);
+    sprintf(profile, "%.*s%s%.*s.gcda", (int)prefix_len, object,
+            trained ? "/pgo" : "", (int)(len - prefix_len - 2), object + prefix_len);
+    return (profile);
 }
 
-int mace_globerr(const char *path, int eerrno) {
-    fprintf(stderr, "%s: %s\n", path, strerror(eerrno));
-    return (eerrno);
+/*  Path of .pd file of object, next to it. */
+char *mace_pgo_digest_path(const char *object) {
+    size_t  len     = strlen(object);
+    char   *path    = calloc(len + 2, sizeof(*path));
+    MACE_MEMCHECK(path);
+    memcpy(path, object, len);
+    memcpy(path + len - 1, "pd", 2);
+    return (path);
 }
 
-/***************** mace_exec ******************/
-/*  Print command to be run in forked process. */
-void mace_exec_print(char *const arguments[],
-                     size_t argnum) {
-    int i;
+/*  Read digest of profile object compiled with. */
+/*  @return 0 if unknown */
+u64 mace_pgo_digest_read(const char *object) {
+    u64      digest = 0;
+    char    *path   = mace_pgo_digest_path(object);
+    FILE    *fp     = fopen(path, "rb");
 
-    for (i = 0; i < argnum; i++) {
-        if (verbose && !silent)
-            printf("%s ", arguments[i]);
+    if (fp != NULL) {
+        if (fread(&digest, sizeof(digest), 1, fp) != 1)
+            digest = 0;
+        fclose(fp);
     }
-    if (verbose && !silent)
-        printf("%s", "\n");
+    MACE_FREE(path);
+    return (digest);
+}
+
+/*  Copy trained profile of source's object */
+/*         next to it, if changed. */
+/*      - Profile removed: copy removed */
+/*      - Digest of profile staged, written */
+/*        after object compiled: stopped */
+/*        builds recompile next time */
+/*  @return true if profile changed: recompile */
+b32 mace_Target_Profile(Target *target, int source_i) {
+    char   *object;
+    char   *trained;
+    char   *copy;
+    u8     *trained_buf;
+    u8     *copy_buf;
+    size_t  i;
+    size_t  trained_len = 0;
+    size_t  copy_len    = 0;
+    u64     digest      = 5381ul;
+    b32     copied;
+    b32     changed;
+
+    if ((config_num <= 0) || (configs[mace_config].pgo != MACE_PGO_USE))
+        return (false);
+
+    object  = target->private._argv_objects[source_i] + strlen("-o");
+    trained = mace_pgo_profile(object, true);
+    copy    = mace_pgo_profile(object, false);
+    if ((trained == NULL) || (copy == NULL)) {
+        MACE_FREE(trained);
+        MACE_FREE(copy);
+        return (false);
+    }
+
+    trained_buf = (access(trained, F_OK) == 0) ?
+                  mace_ar_file_read(trained, &trained_len) : NULL;
+    copy_buf    = (access(copy, F_OK) == 0) ?
+                  mace_ar_file_read(copy, &copy_len) : NULL;
+    copied      = (trained_buf == NULL) == (copy_buf == NULL);
+    if ((trained_buf != NULL) && (copy_buf != NULL))
+        copied = (trained_len == copy_len) &&
+                 (memcmp(trained_buf, copy_buf, trained_len) == 0);
+
+    /* -- Compared to profile object compiled with -- */
+    for (i = 0; i < trained_len; i++)
+        digest = (digest * 33ul) ^ trained_buf[i];
+    changed = (digest != mace_pgo_digest_read(object));
+    target->private._pgo_digests[source_i] = (changed && !report) ? digest : 0;
+
+    /* -- Copied before compile reads it -- */
+    if (!copied && !dry_run && !report) {
+        FILE *fd;
+        if (trained_buf == NULL) {
+            remove(copy);
+        } else if ((fd = fopen(copy, "wb")) != NULL) {
+            fwrite(trained_buf, 1, trained_len, fd);
+            fclose(fd);
+        } else {
+            fprintf(stderr, "Could not write profile '%s'.\n", copy);
+            exit(1);
+        }
+    }
+    MACE_FREE(trained_buf);
+    MACE_FREE(copy_buf);
+    MACE_FREE(trained);
+    MACE_FREE(copy);
+    return (changed);
 }
 
-/*  Put back arguments array (argv) into a */
-/*         single line for execvp. */
-char *mace_args2line(char *const arguments[]) {
-    int i   =   0;
-    int num =   0;
-    int len = 128;
+/*  Run config's training command, if an */
+/*         instrumented target relinked. */
+/*      - Profiles of all objects removed first: */
+/*        counts of last training only */
+void mace_pgo_train(void) {
+    int     z;
+    int     i;
+    b32     relinked = false;
+    Config *config;
 
-    char *argline = calloc(len, sizeof(*argline));
-    MACE_MEMCHECK(argline);
+    if ((config_num <= 0) || (configs[mace_config].pgo != MACE_PGO_GENERATE))
+        return;
+    config = &configs[mace_config];
+    for (z = 0; z < build_order_num; z++)
+        relinked |= targets[build_order[z]].private._relinked;
+    if (!relinked || (config->train == NULL))
+        return;
 
-    while ((arguments[i] != NULL) &&
-           (i < MACE_MAX_ITERATIONS)) {
-        size_t ilen = strlen(arguments[i]);
-        while ((num + ilen + 1) > len) {
-            size_t bytesize = len * 2 * sizeof(*argline);
-            argline = realloc(argline, bytesize);
-            MACE_MEMCHECK(argline);
-            memset(argline + len, 0, len);
-            len *= 2;
+    for (z = 0; (z < build_order_num) && !dry_run; z++) {
+        int    argc_objects;
+        char **argv_objects = mace_Target_link_objects(&targets[build_order[z]],
+                                                       &argc_objects);
+        for (i = 0; i < argc_objects; i++) {
+            char  *object   = argv_objects[i] + strlen("-o");
+            size_t len      = strlen(object);
+            char  *profile  = calloc(len + 4, sizeof(*profile));
+            MACE_MEMCHECK(profile);
+            sprintf(profile, "%.*s.gcda", (int)(len - 2), object);
+            remove(profile);
+            MACE_FREE(profile);
         }
-        assert(num < len);
-        memcpy(argline + num, arguments[i], ilen);
-        num += ilen;
-        argline[num++] = ' ';
-        i++;
-    }
-    if (i == MACE_MAX_ITERATIONS) {
-        if (!silent)
-            printf("Warning! Max iterations reached. Truncating argv.");
     }
-    argline[num] = '\0';
-    return (argline);
-}
-
-/*  Execute command in a different fork with */
-/*         execvp and bash. */
-pid_t mace_exec_wbash(const char *exec,
-                      char *const arguments[]) {
-    char    *argline    = mace_args2line(arguments);
-    pid_t    pid        = fork();
+    mace_run_commands(config->train, "train", config->private._name);
+}
+
+/*  Can cc link with linker: runs */
+/*         cc -fuse-ld=<linker> -Wl,--version */
+b32 mace_linker_probe(const char *linker) {
+    char   *flag;
+    char   *argv[4];
+    int     status = 0;
+    pid_t   pid;
+
+    flag    = calloc(strlen("-fuse-ld=") + strlen(linker) + 1, sizeof(*flag));
+    MACE_MEMCHECK(flag);
+    sprintf(flag, "-fuse-ld=%s", linker);
+    argv[0] = cc;
+    argv[1] = flag;
+    argv[2] = "-Wl,--version";
+    argv[3] = NULL;
+
+    if (trace_file != NULL)
+        fflush(trace_file);
+    fflush(stdout);
+    pid = fork();
     if (pid < 0) {
         fprintf(stderr, "forking issue\n");
-        assert(0);
         exit(1);
     } else if (pid == 0) {
-        char *bashargs[4];
-        bashargs[0] =  "/bin/bash";
-        bashargs[1] =  "-c";
-        bashargs[2] =  argline;
-        bashargs[3] =  NULL;
-        mace_exec_print(bashargs, 3);
-        execvp("/bin/bash", bashargs);
-        exit(0);
+        int null = open("/dev/null", O_WRONLY);
+        if (null >= 0) {
+            dup2(null, STDOUT_FILENO);
+            dup2(null, STDERR_FILENO);
+        }
+        execvp(argv[0], argv);
+        _exit(127);
     }
-    MACE_FREE(argline);
-    return (pid);
+    stats.processes++;
+    MACE_FREE(flag);
+    if (waitpid(pid, &status, 0) < 0)
+        return (false);
+    return (WIFEXITED(status) && (WEXITSTATUS(status) == 0));
 }
 
-/*  Execute command in a different fork */
-/*         with execvp. */
-pid_t mace_exec(const char *exec,
-                char *const arguments[]) {
-    pid_t pid = fork();
-    if (pid < 0) {
-        fprintf(stderr, "forking issue.\n");
-        assert(0);
-        exit(1);
-    } else if (pid == 0) {
-        execvp(exec, arguments);
-        exit(0);
+/***************** mace_pqueue ******************/
+/*  Put process in a free slot of the queue. */
+/*         Waits for any process if queue is full. */
+/*      - Call mace_pool_wait before forking */
+void mace_pqueue_put(pid_t pid, Target *target,
+                     int kind, int index,
+                     int pool, u64 rss) {
+    int i;
+
+    assert((pool >= 0) && (pool < pool_num));
+    while (pnum >= plen) {
+        mace_pqueue_wait();
     }
-    return (pid);
+
+    for (i = 0; i < plen; i++) {
+        if (pqueue[i].pid == 0)
+            break;
+    }
+    assert(i < plen);
+    mace_util_tick();
+    pqueue[i].pid       = pid;
+    pqueue[i].start     = mace_time_us();
+    pqueue[i].target    = target;
+    pqueue[i].kind      = kind;
+    pqueue[i].index     = index;
+    pqueue[i].pool      = pool;
+    pqueue[i].rss       = rss;
+    pqueue[i].token     = jobserver.held;
+    jobserver.held      = -1;
+    pools[pool].num++;
+    pnum++;
 }
 
-/*  Wait on process with pid to finish */
-void mace_wait_pid(int pid) {
-    int status;
-
-    if (waitpid(pid, &status, 0) > 0) {
-        if (WEXITSTATUS(status) == 0) {
-            /* pass */
-        } else if (WIFEXITED(status) && !WEXITSTATUS(status)) {
-            /* pass */
-        } else if (WIFEXITED(status) &&  WEXITSTATUS(status)) {
-            if (WEXITSTATUS(status) == 127) {
-                /* execvp failed */
-                fprintf(stderr, "execvp failed.\n");
-                exit(WEXITSTATUS(status));
-            } else {
-                fprintf(stderr, "Fork returned a non-zero status.\n");
-                exit(WEXITSTATUS(status));
+/*  Wait for any process in queue to finish, */
+/*         free its slot. */
+/*      - Records duration of compiled object */
+void mace_pqueue_wait(void) {
+    int     i;
+    int     status;
+    pid_t   pid;
+    struct rusage usage;
+
+    MACE_EARLY_RET(pnum > 0, MACE_VOID, assert);
+
+    /* -- Wait for any process in queue -- */
+    i = plen;
+    while (i >= plen) {
+        pid = wait4(-1, &status, 0, &usage);
+        if ((pid < 0) && (errno == EINTR))
+            continue;
+        if (pid < 0) {
+            /* No child left: queue is stale */
+            mace_util_tick();
+            for (i = 0; i < plen; i++) {
+                if (pqueue[i].pid != 0)
+                    mace_jobserver_release(pqueue[i].token);
             }
-        } else {
-            fprintf(stderr, "is baka? %d\n", WEXITSTATUS(status));
-            fprintf(stderr, "Fork didn't terminate normally. %d\n", WEXITSTATUS(status));
-            exit(WEXITSTATUS(status));
+            if (plen > 0)
+                memset(pqueue, 0, (size_t)plen * sizeof(*pqueue));
+            pnum = 0;
+            for (i = 0; i < pool_num; i++)
+                pools[i].num = 0;
+            return;
         }
+        for (i = 0; i < plen; i++) {
+            if (pqueue[i].pid == pid)
+                break;
+        }
+    }
+    mace_pqueue_reap(i, status, &usage);
+}
+
+/*  Free slot i of finished process: record, */
+/*         commit, give its jobserver token back. */
+void mace_pqueue_reap(int i, int status, const struct rusage *usage) {
+    Mace_Process *process = &pqueue[i];
+
+    /* -- Record compile duration, peak memory, status -- */
+    if (process->kind == MACE_PROCESS_COMPILE) {
+        Mace_Record record;
+        Target *target  = process->target;
+        char *obj_flag  = target->private._argv_objects[process->index];
+        record.duration = (u32)((mace_time_us() - process->start) / 1000ul);
+        /* Note: ru_maxrss in KiB on Linux, bytes on macOS */
+        record.rss          = (u32)usage->ru_maxrss;
+        record.status       = (u32)WEXITSTATUS(status);
+        record.fingerprint  = target->private._fingerprint;
+        mace_record_write(obj_flag + 2, &record);
+    } else if (process->kind == MACE_PROCESS_SHARD) {
+        u64 duration    = (mace_time_us() - process->start) / 1000ul;
+        mace_Target_Shard_Record(process->target, process->index,
+                                 duration, (u64)usage->ru_maxrss,
+                                 WEXITSTATUS(status));
+    }
+    mace_pid_status(status);
+
+    /* -- Compiled: sources' checksums written -- */
+    /* -- Linked: link command written -- */
+    if (!WIFEXITED(status) || (WEXITSTATUS(status) != 0)) {
+        /* Failed: nothing committed */
+    } else if (process->kind == MACE_PROCESS_COMPILE) {
+        mace_Target_Checksum_Commit(process->target, process->index);
+    } else if ((process->kind == MACE_PROCESS_LINK) && (process->index == 0)) {
+        mace_Target_Link_Write(process->target);
+    } else if (process->kind == MACE_PROCESS_SHARD) {
+        int start   = process->target->private._shard_start[process->index];
+        int end     = process->target->private._shard_start[process->index + 1];
+        for (; start < end; start++)
+            mace_Target_Checksum_Commit(process->target,
+                                        process->target->private._shard_sources[start]);
+    }
+
+    mace_trace_process(process, i, mace_time_us());
+    mace_util_tick();
+    pools[process->pool].num--;
+    mace_jobserver_release(process->token);
+    memset(process, 0, sizeof(*process));
+    pnum--;
+}
+
+/*  Wait for all processes in queue to finish. */
+void mace_pqueue_drain(void) {
+    while (pnum > 0) {
+        mace_pqueue_wait();
+    }
+}
+
+/*  Check if target has a process in queue. */
+/*      - link: linking, otherwise compiling */
+b32 mace_pqueue_busy(const Target *target, b32 link) {
+    int i;
+
+    MACE_EARLY_RET(pqueue != NULL, false, MACE_nASSERT);
+
+    for (i = 0; i < plen; i++) {
+        if ((pqueue[i].pid == 0) || (pqueue[i].target != target))
+            continue;
+        if (link == (pqueue[i].kind == MACE_PROCESS_LINK))
+            return (true);
     }
+    return (false);
 }
 
-/******************* mace_build ********************/
-void mace_link_dynamic_library(Target *target) {
-    int      i;
+/*  Check if target has a process of kind in queue. */
+b32 mace_pqueue_running(const Target *target, int kind) {
+    int i;
+
+    MACE_EARLY_RET(pqueue != NULL, false, MACE_nASSERT);
+
+    for (i = 0; i < plen; i++) {
+        if ((pqueue[i].pid != 0) && (pqueue[i].target == target) &&
+            (pqueue[i].kind == kind))
+            return (true);
+    }
+    return (false);
+}
+
+/***************** mace_pool ******************/
+/*  Set limit of pool, adding it if needed. */
+void mace_set_pool(const char *name, int limit) {
+    int order;
+
+    MACE_EARLY_RET(name, MACE_VOID, assert);
+
+    if (limit < 1) {
+        fprintf(stderr, "Pool '%s' limit should be above 0.\n", name);
+        exit(1);
+    }
+
+    order = mace_pool_order(mace_hash(name));
+    if (order < 0) {
+        if (pool_num >= MACE_POOL_MAX) {
+            fprintf(stderr, "Too many pools, max is %d.\n", MACE_POOL_MAX);
+            exit(1);
+        }
+        order = pool_num++;
+        pools[order].hash   = mace_hash(name);
+        pools[order].num    = 0;
+    }
+    pools[order].limit = limit;
+}
+
+/*  Get pool order from input hash */
+/*  @return Pool order, or -1 if not found */
+int mace_pool_order(u64 hash) {
+    int i;
+    for (i = 0; i < pool_num; i++) {
+        if (hash == pools[i].hash)
+            return (i);
+    }
+    return (MACE_POOL_NULL);
+}
+
+/*  Get pool order from name, fallback if NULL. */
+/*         Exits if pool was never set. */
+int mace_pool_find(const char *name, int fallback) {
+    int order;
+
+    MACE_EARLY_RET(name != NULL, fallback, MACE_nASSERT);
+
+    order = mace_pool_order(mace_hash(name));
+    if (order < 0) {
+        fprintf(stderr, "Pool '%s' not found. Exiting\n", name);
+        exit(1);
+    }
+    return (order);
+}
+
+/*  Wait for any process until pool has a */
+/*         free slot, and machine can take a */
+/*         job expected to use rss [KiB]. */
+/*      - Served tokens are compile slots: */
+/*        link-only pools take none */
+void mace_pool_wait(int pool, u64 rss) {
+    int cause = util.cause;
+    b32 token;
+
+    assert((pool >= 0) && (pool < pool_num));
+    token = !jobserver.server || !pools[pool].link;
+    while (pnum > 0) {
+        if (pools[pool].num >= pools[pool].limit)
+            mace_util_cause(MACE_IDLE_POOL);
+        else if (!mace_jobs_admit(rss) || (token && !mace_jobserver_acquire()))
+            mace_util_cause(MACE_IDLE_ADMIT);
+        else
+            break;
+        mace_pqueue_wait();
+    }
+    mace_util_cause(cause);
+}
+
+/***************** mace_jobs ******************/
+/*  Check if a new job expected to use rss */
+/*         [KiB] can start now. */
+/*      - Waits if other processes load all CPUs */
+/*      - Waits if MemAvailable can't fit job, */
+/*        and jobs that just started */
+b32 mace_jobs_admit(u64 rss) {
+    int     i;
+    u64     now;
+    u64     need;
+    u64     available;
+
+    /* -- Always allow jobs_min -- */
+    if (pnum < jobs_min)
+        return (true);
+    mace_jobs_sample();
+
+    /* -- Load from other processes -- */
+    if ((jobs_sample.cpus > 0) && (jobs_sample.load >= 0) &&
+        ((jobs_sample.load - pnum) > jobs_sample.cpus)) {
+        if (verbose)
+            printf("Waiting: load average %.2f\n", jobs_sample.load);
+        return (false);
+    }
+
+    /* -- Memory -- */
+    available = jobs_sample.available;
+    if (available == 0)
+        return (true);
+
+    now  = mace_time_us();
+    need = rss + MACE_MEM_RESERVE;
+    for (i = 0; i < plen; i++) {
+        if ((pqueue[i].pid != 0) &&
+            ((now - pqueue[i].start) < MACE_RSS_RAMP))
+            need += pqueue[i].rss;
+    }
+    if (need > available) {
+        if (verbose)
+            printf("Waiting: %lu KiB available\n", available);
+        return (false);
+    }
+    return (true);
+}
+
+/*  Sample load average, available memory, */
+/*         unless sampled in last MACE_JOBS_SAMPLE. */
+/*      - Admitting one job at a time reads */
+/*        /proc/meminfo once per interval */
+void mace_jobs_sample(void) {
+    u64 now = mace_time_us();
+
+    if ((jobs_sample.time > 0) &&
+        ((now - jobs_sample.time) < MACE_JOBS_SAMPLE))
+        return;
+
+    jobs_sample.time        = now;
+    jobs_sample.cpus        = sysconf(_SC_NPROCESSORS_ONLN);
+    jobs_sample.available   = mace_mem_available();
+    if (getloadavg(&jobs_sample.load, 1) != 1)
+        jobs_sample.load    = -1;
+}
+
+/***************** mace_jobserver ******************/
+/*  Join jobserver from MAKEFLAGS, or serve */
+/*         jobs tokens to children. */
+/*      - serve: children can use tokens */
+void mace_jobserver_init(int jobs, b32 serve) {
+    mace_jobserver_free();
+    if (mace_jobserver_client(getenv("MAKEFLAGS")))
+        return;
+    if (serve)
+        mace_jobserver_server(jobs);
+}
+
+/*  Can children use served tokens: */
+/*      - Commands may run make, nested mace */
+/*      - gcc LTO links: -flto=jobserver */
+b32 mace_jobserver_wanted(void) {
+    int i;
+
+    if (mace_lto() && (strstr(cc, "clang") == NULL))
+        return (true);
+    for (i = 0; i < target_num; i++) {
+        if ((targets[i].cmd_pre != NULL) || (targets[i].cmd_post != NULL))
+            return (true);
+    }
+    return (false);
+}
+
+/*  Join jobserver of parent make, mace. */
+/*      - Last --jobserver-auth, --jobserver-fds */
+/*      - Form R,W or fifo:PATH */
+b32 mace_jobserver_client(const char *makeflags) {
+    const char *auth = NULL;
+    const char *next;
+    b32 out;
+
+    MACE_EARLY_RET(makeflags != NULL, false, MACE_nASSERT);
+
+    next = makeflags;
+    while ((next = strstr(next, "--jobserver-")) != NULL) {
+        if (strncmp(next, "--jobserver-auth=", 17) == 0)
+            auth = next + 17;
+        else if (strncmp(next, "--jobserver-fds=", 16) == 0)
+            auth = next + 16;
+        next++;
+    }
+    MACE_EARLY_RET(auth != NULL, false, MACE_nASSERT);
+
+    out = mace_jobserver_open(auth);
+    if (!out) {
+        fprintf(stderr, "mace: jobserver unavailable, parent jobs not shared.\n");
+    } else if (verbose) {
+        printf("Jobserver client\n");
+    }
+    return (out);
+}
+
+/*  Open jobserver from auth string. */
+/*      - Own non-blocking fd: read never */
+/*        blocks, even on shared pipe  */
+b32 mace_jobserver_open(const char *auth) {
+    char path[MACE_CWD_BUFFERSIZE];
+    int  fdr, fdw;
+    size_t len;
+
+    len = strcspn(auth, " ");
+    if (strncmp(auth, "fifo:", 5) == 0) {
+        /* -- Named pipe, make >= 4.4 -- */
+        len -= 5;
+        if (len >= MACE_CWD_BUFFERSIZE)
+            return (false);
+        memcpy(path, auth + 5, len);
+        path[len] = '\0';
+        jobserver.write = open(path, O_RDWR);
+    } else {
+        /* -- Anonymous pipe fds -- */
+        if (sscanf(auth, "%d,%d", &fdr, &fdw) != 2)
+            return (false);
+        /* Negative fds: parent disabled jobserver */
+        if ((fdr < 0) || (fdw < 0))
+            return (false);
+        /* Closed fds: command not marked recursive */
+        if ((fcntl(fdr, F_GETFD) == -1) || (fcntl(fdw, F_GETFD) == -1))
+            return (false);
+        jobserver.read  = fdr;
+        jobserver.write = dup(fdw);
+        sprintf(path, "/proc/self/fd/%d", fdr);
+    }
+    jobserver.poll = open(path, O_RDONLY | O_NONBLOCK);
+    if ((jobserver.poll < 0) || (jobserver.write < 0)) {
+        mace_jobserver_free();
+        return (false);
+    }
+    fcntl(jobserver.poll,  F_SETFD, FD_CLOEXEC);
+    fcntl(jobserver.write, F_SETFD, FD_CLOEXEC);
+    return (true);
+}
+
+/*  Serve jobs - 1 tokens to children through */
+/*         a pipe exported in MAKEFLAGS. */
+b32 mace_jobserver_server(int jobs) {
+    int     i;
+    int     fds[2];
+    char   *prev;
+    char   *makeflags;
+    char    auth[64];
+    char    path[32];
+    size_t  len;
+
+    MACE_EARLY_RET(jobs > 1, false, MACE_nASSERT);
+    MACE_EARLY_RET(pipe(fds) == 0, false, MACE_nASSERT);
+
+    sprintf(path, "/proc/self/fd/%d", fds[0]);
+    jobserver.read   = fds[0];
+    jobserver.write  = fds[1];
+    jobserver.server = true;
+    jobserver.poll   = open(path, O_RDONLY | O_NONBLOCK);
+    if (jobserver.poll < 0) {
+        mace_jobserver_free();
+        return (false);
+    }
+    fcntl(jobserver.poll, F_SETFD, FD_CLOEXEC);
+
+    /* -- Tokens, first job is free -- */
+    for (i = 1; i < jobs; i++) {
+        if (write(jobserver.write, "+", 1) != 1)
+            break;
+    }
+
+    /* -- Export to children -- */
+    prev = getenv("MAKEFLAGS");
+    if (prev != NULL)
+        jobserver.makeflags = mace_str_buffer(prev);
+    sprintf(auth, " -j%d --jobserver-auth=%d,%d", jobs, fds[0], fds[1]);
+    len = (prev != NULL ? strlen(prev) : 0) + strlen(auth) + 1;
+    makeflags = calloc(len, sizeof(*makeflags));
+    MACE_MEMCHECK(makeflags);
+    if (prev != NULL)
+        strcpy(makeflags, prev);
+    strcat(makeflags, auth);
+    setenv("MAKEFLAGS", makeflags, 1);
+    MACE_FREE(makeflags);
+
+    if (verbose)
+        printf("Jobserver server: %d jobs\n", jobs);
+    return (true);
+}
+
+/*  Get token for next job, if needed. */
+/*      - false if none available now */
+b32 mace_jobserver_acquire(void) {
+    char token;
+
+    /* -- No jobserver, or token already held -- */
+    if ((jobserver.poll < 0) || (jobserver.held >= 0))
+        return (true);
+
+    /* -- First job uses implicit token -- */
+    if (pnum <= 0)
+        return (true);
+
+    if (read(jobserver.poll, &token, 1) != 1)
+        return (false);
+    jobserver.held = (unsigned char)token;
+    return (true);
+}
+
+/*  Give token back to jobserver. */
+void mace_jobserver_release(int token) {
+    char byte = (char)token;
+
+    MACE_EARLY_RET(token >= 0, MACE_VOID, MACE_nASSERT);
+    MACE_EARLY_RET(jobserver.write >= 0, MACE_VOID, MACE_nASSERT);
+
+    while (write(jobserver.write, &byte, 1) != 1) {
+        if (errno != EINTR)
+            break;
+    }
+}
+
+/*  Close jobserver, restore MAKEFLAGS. */
+void mace_jobserver_free(void) {
+    mace_jobserver_release(jobserver.held);
+    if (jobserver.poll >= 0)
+        close(jobserver.poll);
+    if (jobserver.server) {
+        close(jobserver.read);
+        close(jobserver.write);
+        if (jobserver.makeflags != NULL)
+            setenv("MAKEFLAGS", jobserver.makeflags, 1);
+        else
+            unsetenv("MAKEFLAGS");
+    } else if (jobserver.write >= 0) {
+        /* Client: own dup of parent's fd */
+        close(jobserver.write);
+    }
+    MACE_FREE(jobserver.makeflags);
+    jobserver.read      = -1;
+    jobserver.write     = -1;
+    jobserver.poll      = -1;
+    jobserver.held      = -1;
+    jobserver.server    = false;
+}
+
+/*  Memory available for new processes [KiB]. */
+/*      - 0 if unknown, e.g. no /proc/meminfo */
+u64 mace_mem_available(void) {
+    u64      kib = 0;
+    char     line[128];
+    FILE    *meminfo = fopen("/proc/meminfo", "r");
+
+    MACE_EARLY_RET(meminfo != NULL, 0, MACE_nASSERT);
+
+    while (fgets(line, sizeof(line), meminfo) != NULL) {
+        if (sscanf(line, "MemAvailable: %lu kB", &kib) == 1)
+            break;
+    }
+    fclose(meminfo);
+    return (kib);
+}
+
+/*  Set pool limits from "NAME=INT" tokens. */
+void mace_parse_pools(const char *str,
+                      const char *separator) {
+    char    *buffer;
+    char    *token;
+
+    MACE_EARLY_RET(str != NULL, MACE_VOID, MACE_nASSERT);
+
+    buffer = mace_str_buffer(str);
+    token  = strtok(buffer, separator);
+    while (token != NULL) {
+        char *equal = strchr(token, '=');
+        if ((equal == NULL) || (equal == token)) {
+            fprintf(stderr, "Pool '%s' should be NAME=INT.\n", token);
+            exit(1);
+        }
+        *equal = '\0';
+        mace_set_pool(token, atoi(equal + 1));
+        token = strtok(NULL, separator);
+    }
+    MACE_FREE(buffer);
+}
+
+/*  Resolve pool limits, process queue length */
+/*         and targets' pools. */
+void mace_pools_resolve(const Mace_Args *args,
+                        const Config *config) {
+    int i;
+
+    /* -- compile limit: macefile, else -j -- */
+    if (pools[MACE_POOL_COMPILE].limit < 1) {
+        int jobs = (args != NULL) ? args->jobs : MACE_JOBS_DEFAULT;
+        pools[MACE_POOL_COMPILE].limit = jobs;
+    }
+
+    /* -- Override with config, input arguments -- */
+    if (config != NULL)
+        mace_parse_pools(config->pools, mace_separator);
+    if (args != NULL)
+        mace_parse_pools(args->pools, " ");
+
+    /* -- Pools are separate: one slot per process -- */
+    plen = 0;
+    for (i = 0; i < pool_num; i++) {
+        assert(pools[i].limit >= 1);
+        plen += pools[i].limit;
+    }
+
+    for (i = 0; i < target_num; i++) {
+        Target *target = &targets[i];
+        target->private._compile_pool = mace_pool_find(target->compile_pool,
+                                                       MACE_POOL_COMPILE);
+        target->private._link_pool    = mace_pool_find(target->link_pool,
+                                                       MACE_POOL_LINK);
+    }
+
+    /* -- Link-only pools: limited by own pool -- */
+    pools[MACE_POOL_LINK].link = true;
+    for (i = 0; i < target_num; i++)
+        pools[targets[i].private._link_pool].link = true;
+    for (i = 0; i < target_num; i++)
+        pools[targets[i].private._compile_pool].link = false;
+}
+
+/*  Wait until target is done compiling, */
+/*         or linking. */
+void mace_Target_wait(const Target *target, b32 link) {
+    int cause = mace_util_cause(link ? MACE_IDLE_LINKED : MACE_IDLE_OBJECTS);
+
+    while (mace_pqueue_busy(target, link)) {
+        mace_pqueue_wait();
+    }
+    mace_util_cause(cause);
+}
+
+/*  Wait until dependencies are done linking. */
+void mace_Target_wait_deps(const Target *target) {
+    size_t i;
+
+    MACE_EARLY_RET(target->private._deps_links != NULL, MACE_VOID, MACE_nASSERT);
+
+    for (i = 0; i < target->private._deps_links_num; i++) {
+        int order = mace_target_order(target->private._deps_links[i]);
+        /* Skip libraries that are not targets */
+        if (order < 0)
+            continue;
+        mace_Target_wait(&targets[order], true);
+    }
+}
+
+/***************** mace_schedule ******************/
+/*  Monotonic time in microseconds. */
+u64 mace_time_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((u64)ts.tv_sec * 1000000ul + (u64)ts.tv_nsec / 1000ul);
+}
+
+/*  Start trace file, all times relative to now. */
+void mace_trace_open(const char *path) {
+    MACE_EARLY_RET(path != NULL, MACE_VOID, assert);
+    mace_trace_close();
+
+    trace_file = fopen(path, "w");
+    if (trace_file == NULL) {
+        fprintf(stderr, "Could not open trace file '%s'\n", path);
+        exit(1);
+    }
+    trace_start = mace_time_us();
+    trace_first = true;
+    trace_pid   = getpid();
+    if (!trace_atexit) {
+        atexit(mace_trace_close);
+        trace_atexit = true;
+    }
+    fprintf(trace_file, "{\"traceEvents\":[\n");
+    fprintf(trace_file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,"
+                        "\"args\":{\"name\":\"mace\"}}");
+    trace_first = false;
+}
+
+/*  End trace file, if tracing. */
+/*      - Also at exit: trace of failed build ends */
+void mace_trace_close(void) {
+    MACE_EARLY_RET(trace_file != NULL, MACE_VOID, MACE_nASSERT);
+    MACE_EARLY_RET(getpid() == trace_pid, MACE_VOID, MACE_nASSERT);
+    fprintf(trace_file, "\n]}\n");
+    fclose(trace_file);
+    trace_file = NULL;
+}
+
+/*  Name job slots of process queue in trace. */
+void mace_trace_slots(int num) {
+    int i;
+    MACE_EARLY_RET(trace_file != NULL, MACE_VOID, MACE_nASSERT);
+    for (i = 0; i < num; i++) {
+        fprintf(trace_file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+                            "\"tid\":%d,\"args\":{\"name\":\"slot %d\"}}", i + 1, i);
+    }
+}
+
+/*  Time at start of span, 0 if not tracing. */
+u64 mace_trace_begin(void) {
+    return (trace_file != NULL ? mace_time_us() : 0);
+}
+
+/*  Add span of internal phase, ending now. */
+void mace_trace_end(const char *name, const char *detail, u64 start) {
+    MACE_EARLY_RET(trace_file != NULL, MACE_VOID, MACE_nASSERT);
+    mace_trace_event(name, "phase", detail, 0, start, mace_time_us());
+}
+
+/*  Add complete event to trace. */
+void mace_trace_event(const char *name, const char *cat,
+                      const char *detail, int tid,
+                      u64 start, u64 end) {
+    MACE_EARLY_RET(trace_file != NULL, MACE_VOID, MACE_nASSERT);
+    if (start < trace_start)
+        start = trace_start;
+    if (end < start)
+        end = start;
+
+    fprintf(trace_file, "%s{\"name\":", trace_first ? "" : ",\n");
+    mace_json_string(trace_file, name);
+    fprintf(trace_file, ",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%lu,\"dur\":%lu,"
+                        "\"pid\":1,\"tid\":%d", cat,
+            (unsigned long)(start - trace_start),
+            (unsigned long)(end - start), tid);
+    if (detail != NULL) {
+        fprintf(trace_file, ",\"args\":{\"detail\":");
+        mace_json_string(trace_file, detail);
+        fprintf(trace_file, "}");
+    }
+    fprintf(trace_file, "}");
+    trace_first = false;
+}
+
+/*  Add slice of finished process to trace. */
+void mace_trace_process(const Mace_Process *process,
+                        int slot, u64 end) {
+    char         name[64];
+    const char  *detail = NULL;
+    const char  *cat    = "link";
+    Target      *target = process->target;
+
+    MACE_EARLY_RET(trace_file != NULL, MACE_VOID, MACE_nASSERT);
+    MACE_EARLY_RET(target != NULL, MACE_VOID, assert);
+
+    switch (process->kind) {
+        case MACE_PROCESS_PRECOMPILE:
+        case MACE_PROCESS_COMPILE:
+            cat     = process->kind == MACE_PROCESS_COMPILE ? "compile" : "precompile";
+            detail  = target->private._argv_sources[process->index];
+            break;
+        case MACE_PROCESS_SHARD:
+            cat     = "shard";
+            if (target->unity > 0) {
+                int src = target->private._shard_sources[target->private._shard_start[process->index]];
+                detail  = target->private._unity_sources[target->private._unity_chunk[src]];
+            }
+            break;
+        case MACE_PROCESS_PCH:
+            cat     = "pch";
+            detail  = target->pch;
+            break;
+    }
+
+    /* -- Name: file of detail, or target -- */
+    if (detail != NULL) {
+        const char *slash = strrchr(detail, '/');
+        strncpy(name, slash != NULL ? slash + 1 : detail, sizeof(name) - 1);
+    } else if (process->kind == MACE_PROCESS_SHARD) {
+        sprintf(name, "shard %d ", process->index);
+        strncat(name, target->private._name, sizeof(name) - strlen(name) - 1);
+    } else {
+        strncpy(name, target->private._name, sizeof(name) - 1);
+    }
+    name[sizeof(name) - 1] = '\0';
+
+    mace_trace_event(name, cat, detail, slot + 1, process->start, end);
+}
+
+/*  Report on compile records of objects in */
+/*         build_order: slowest, regressions */
+/*         versus previous records, targets. */
+void mace_report(void) {
+    int          i;
+    int          z;
+    int          shown;
+    int          num    = 0;
+    int          len    = 0;
+    Mace_Report *rows   = NULL;
+    Mace_Record  records[MACE_RECORD_HISTORY];
+
+    /* --- Targets: totals of newest records --- */
+    printf("Targets:\n");
+    printf("  %-20s %8s %10s %10s\n", "target", "objects", "ms", "peak KiB");
+    for (z = 0; z < build_order_num; z++) {
+        Target *target  = &targets[build_order[z]];
+        int     known   = 0;
+        u64     total   = 0;
+        u32     peak    = 0;
+
+        for (i = 0; i < target->private._argc_sources; i++) {
+            int          r;
+            int          n;
+            u64          sum = 0;
+            Mace_Report *row;
+
+            n = mace_record_history(target->private._argv_objects[i] + 2, records);
+            if (n <= 0)
+                continue;
+            if (num >= len) {
+                len  = (len > 0) ? len * 2 : MACE_DEFAULT_OBJECT_LEN;
+                rows = realloc(rows, len * sizeof(*rows));
+                MACE_MEMCHECK(rows);
+            }
+            row = &rows[num++];
+            for (r = 1; r < n; r++)
+                sum += records[r].duration;
+            row->target     = target;
+            row->source     = i;
+            row->duration   = records[0].duration;
+            row->previous   = (n > 1) ? (u32)(sum / (n - 1)) : 0;
+            row->rss        = records[0].rss;
+            row->flags      = (n > 1) && (records[0].fingerprint != records[1].fingerprint);
+            row->failed     = (records[0].status != 0);
+
+            known++;
+            total  += row->duration;
+            peak    = (row->rss > peak) ? row->rss : peak;
+        }
+        printf("  %-20s %8d %10lu %10lu\n", target->private._name,
+               known, (unsigned long)total, (unsigned long)peak);
+    }
+
+    /* --- Slowest objects --- */
+    printf("Slowest objects:\n");
+    printf("  %10s %10s  %s\n", "ms", "KiB", "source");
+    qsort(rows, num, sizeof(*rows), mace_report_slowest_cmp);
+    for (i = 0; (i < num) && (i < MACE_REPORT_TOP); i++) {
+        printf("  %10lu %10lu  %s (%s)%s\n",
+               (unsigned long)rows[i].duration, (unsigned long)rows[i].rss,
+               rows[i].target->private._argv_sources[rows[i].source],
+               rows[i].target->private._name,
+               rows[i].failed ? " failed" : "");
+    }
+
+    /* --- Regressions: newest vs mean of older --- */
+    printf("Regressions vs previous %d records:\n", MACE_RECORD_HISTORY - 1);
+    printf("  %10s %10s  %s\n", "ms", "was ms", "source");
+    qsort(rows, num, sizeof(*rows), mace_report_regression_cmp);
+    shown = 0;
+    for (i = 0; (i < num) && (shown < MACE_REPORT_TOP); i++) {
+        if ((rows[i].previous == 0) || (rows[i].duration <= rows[i].previous))
+            break;
+        printf("  %10lu %10lu  %s (%s)%s\n",
+               (unsigned long)rows[i].duration, (unsigned long)rows[i].previous,
+               rows[i].target->private._argv_sources[rows[i].source],
+               rows[i].target->private._name,
+               rows[i].flags ? " flags changed" : "");
+        shown++;
+    }
+    MACE_FREE(rows);
+
+    mace_report_headers();
+}
+
+/*  Report headers by rebuild cost: sources */
+/*         including them, weighted by their */
+/*         newest compile records. Then by */
+/*         recompiles they caused recently. */
+void mace_report_headers(void) {
+    int          h;
+    int          i;
+    int          j;
+    int          z;
+    int          num    = 0;
+    int          len    = 0;
+    int          merged = 0;
+    Mace_Fanout *rows   = NULL;
+    u32          counts[MACE_RECORD_HISTORY];
+
+    /* --- One row per header of each target --- */
+    for (z = 0; z < build_order_num; z++) {
+        Target  *target = &targets[build_order[z]];
+        u32     *ms;
+
+        if (target->private._headers_num <= 0)
+            continue;
+        ms = calloc(target->private._argc_sources + 1, sizeof(*ms));
+        MACE_MEMCHECK(ms);
+        for (i = 0; i < target->private._argc_sources; i++) {
+            Mace_Record record;
+            mace_record_read(target->private._argv_objects[i] + 2, &record);
+            ms[i] = record.duration;
+        }
+
+        if (num + target->private._headers_num > len) {
+            len  = num + target->private._headers_num;
+            rows = realloc(rows, len * sizeof(*rows));
+            MACE_MEMCHECK(rows);
+        }
+        for (h = 0; h < target->private._headers_num; h++) {
+            Mace_Fanout *row = &rows[num + h];
+            memset(row, 0, sizeof(*row));
+            row->hash       = target->private._headers_hash[h];
+            row->header     = target->private._headers[h];
+            row->checksum   = target->private._headers_checksum[h];
+        }
+        for (i = 0; i < target->private._argc_sources; i++) {
+            if (target->private._deps_headers[i] == NULL)
+                continue;
+            for (j = 0; j < target->private._deps_headers_num[i]; j++) {
+                Mace_Fanout *row = &rows[num + target->private._deps_headers[i][j]];
+                row->tus++;
+                row->cost += ms[i];
+            }
+        }
+        num += target->private._headers_num;
+        MACE_FREE(ms);
+    }
+
+    /* No headers to report */
+    MACE_EARLY_RET(num > 0, MACE_VOID, MACE_nASSERT);
+
+    /* --- Merge rows of same header --- */
+    qsort(rows, num, sizeof(*rows), mace_fanout_hash_cmp);
+    for (i = 0; i < num; i++) {
+        if ((merged > 0) && (rows[merged - 1].hash == rows[i].hash)) {
+            rows[merged - 1].tus  += rows[i].tus;
+            rows[merged - 1].cost += rows[i].cost;
+            continue;
+        }
+        rows[merged++] = rows[i];
+    }
+    num = merged;
+
+    printf("Headers by rebuild cost:\n");
+    printf("  %10s %8s  %s\n", "ms", "sources", "header");
+    qsort(rows, num, sizeof(*rows), mace_fanout_cost_cmp);
+    for (i = 0; (i < num) && (i < MACE_REPORT_TOP); i++) {
+        printf("  %10lu %8d  %s\n", (unsigned long)rows[i].cost,
+               rows[i].tus, rows[i].header);
+    }
+
+    /* --- Recompiles caused over recent changes --- */
+    for (i = 0; i < num; i++) {
+        rows[i].changes = mace_recompiles_history(rows[i].checksum, counts);
+        for (j = 0; j < rows[i].changes; j++)
+            rows[i].recompiles += counts[j];
+    }
+    printf("Headers by recompiles, last %d changes:\n", MACE_RECORD_HISTORY);
+    printf("  %10s %8s  %s\n", "recompiles", "changes", "header");
+    qsort(rows, num, sizeof(*rows), mace_fanout_recompiles_cmp);
+    for (i = 0; (i < num) && (i < MACE_REPORT_TOP); i++) {
+        if (rows[i].recompiles == 0)
+            break;
+        printf("  %10d %8d  %s\n", rows[i].recompiles,
+               rows[i].changes, rows[i].header);
+    }
+    MACE_FREE(rows);
+}
+
+/*  Same header together. */
+int mace_fanout_hash_cmp(const void *a, const void *b) {
+    const Mace_Fanout *ra = a;
+    const Mace_Fanout *rb = b;
+    if (ra->hash != rb->hash)
+        return (ra->hash < rb->hash ? -1 : 1);
+    return (0);
+}
+
+/*  Highest rebuild cost first, then most sources. */
+int mace_fanout_cost_cmp(const void *a, const void *b) {
+    const Mace_Fanout *ra = a;
+    const Mace_Fanout *rb = b;
+    if (ra->cost != rb->cost)
+        return (ra->cost < rb->cost ? 1 : -1);
+    if (ra->tus != rb->tus)
+        return (ra->tus < rb->tus ? 1 : -1);
+    return (0);
+}
+
+/*  Most recompiles caused first. */
+int mace_fanout_recompiles_cmp(const void *a, const void *b) {
+    const Mace_Fanout *ra = a;
+    const Mace_Fanout *rb = b;
+    if (ra->recompiles != rb->recompiles)
+        return (ra->recompiles < rb->recompiles ? 1 : -1);
+    return (0);
+}
+
+/*  Save recompiles caused by changed headers. */
+void mace_recompiles_record(void) {
+    int i;
+    MACE_EARLY_RET(!report, MACE_VOID, MACE_nASSERT);
+    for (i = 0; i < hdrs_checked_num; i++) {
+        if (hdrs_checked[i].changed)
+            mace_recompiles_write(hdrs_checked[i].checksum, hdrs_checked[i].caused);
+    }
+}
+
+/*  Path of .r file next to header checksum. */
+char *mace_recompiles_path(const char *checksum) {
+    char   *path = mace_str_buffer(checksum);
+    size_t  len  = strlen(path);
+    assert(len > MACE_SHA1_EXT_LEN);
+    memcpy(path + len - MACE_SHA1_EXT_LEN, ".r", 3);
+    return (path);
+}
+
+/*  Read recompiles caused by recent changes of */
+/*         header, newest first. */
+/*  @return Number of changes recorded */
+int mace_recompiles_history(const char *checksum,
+                            u32 *counts) {
+    int      num = 0;
+    char    *path;
+    FILE    *fr;
+
+    MACE_EARLY_RET(checksum != NULL, 0, assert);
+
+    path = mace_recompiles_path(checksum);
+    fr   = fopen(path, "rb");
+    if (fr != NULL) {
+        num = (int)fread(counts, sizeof(*counts), MACE_RECORD_HISTORY, fr);
+        fclose(fr);
+    }
+    MACE_FREE(path);
+    return (num);
+}
+
+/*  Add recompiles caused by change of header. */
+/*      - Oldest count dropped if history full */
+void mace_recompiles_write(const char *checksum,
+                           u32 count) {
+    int      num;
+    char    *path;
+    FILE    *fr;
+    u32      counts[MACE_RECORD_HISTORY];
+
+    MACE_EARLY_RET(checksum != NULL, MACE_VOID, assert);
+
+    num = mace_recompiles_history(checksum, counts);
+    if (num >= MACE_RECORD_HISTORY)
+        num = MACE_RECORD_HISTORY - 1;
+    memmove(counts + 1, counts, num * sizeof(*counts));
+    counts[0] = count;
+    num++;
+
+    path = mace_recompiles_path(checksum);
+    fr   = fopen(path, "wb");
+    if (fr != NULL) {
+        fwrite(counts, sizeof(*counts), num, fr);
+        fclose(fr);
+    }
+    MACE_FREE(path);
+}
+
+/*  Longest newest record first. */
+int mace_report_slowest_cmp(const void *a, const void *b) {
+    const Mace_Report *ra = a;
+    const Mace_Report *rb = b;
+    if (ra->duration != rb->duration)
+        return (ra->duration < rb->duration ? 1 : -1);
+    return (0);
+}
+
+/*  Largest increase over previous records first, */
+/*         objects without previous records last. */
+int mace_report_regression_cmp(const void *a, const void *b) {
+    const Mace_Report *ra = a;
+    const Mace_Report *rb = b;
+    long da = (long)ra->duration - (long)ra->previous;
+    long db = (long)rb->duration - (long)rb->previous;
+    if ((ra->previous == 0) != (rb->previous == 0))
+        return (ra->previous == 0 ? 1 : -1);
+    if (da != db)
+        return (da < db ? 1 : -1);
+    return (0);
+}
+
+/*  Print why objects of targets in */
+/*         build_order recompile. */
+void mace_explain(void) {
+    int i;
+    int z;
+
+    for (z = 0; z < build_order_num; z++) {
+        Target *target = &targets[build_order[z]];
+        if (target->private._recompiles == NULL)
+            continue;
+        for (i = 0; i < target->private._argc_sources; i++) {
+            if (target->private._recompiles[i])
+                mace_explain_source(target, i);
+        }
+    }
+}
+
+/*  Print why object of source recompiles. */
+/*      - Names first changed header it includes */
+void mace_explain_source(const Target *target, int source_i) {
+    int j;
+    int reason = target->private._reasons[source_i];
+
+    printf("Recompile %s: %s", target->private._argv_sources[source_i],
+           mace_reasons[reason]);
+    if ((reason == MACE_REASON_HEADER) &&
+        (target->private._deps_headers[source_i] != NULL)) {
+        for (j = 0; j < target->private._deps_headers_num[source_i]; j++) {
+            int h = target->private._deps_headers[source_i][j];
+            if (target->private._hdrs_changed[h]) {
+                printf(" '%s'", target->private._headers[h]);
+                break;
+            }
+        }
+    }
+    printf("\n");
+}
+
+/*  Path of build plan: <cwd>/<obj_dir>/mace.plan */
+char *mace_plan_path(void) {
+    char *path = calloc(strlen(cwd) + strlen(obj_dir) + 12, sizeof(*path));
+    MACE_MEMCHECK(path);
+    sprintf(path, "%s/%s/mace.plan", cwd, obj_dir);
+    return (path);
+}
+
+/*  Continue djb2 hash with string. */
+/*      - NULL hashes differently than "" */
+u64 mace_plan_hash(u64 hash, const char *str) {
+    if (str == NULL)
+        return (hash * 33ul + 1ul);
+    while (*str)
+        hash = ((hash << 5ul) + hash) + (unsigned char)*str++;
+    return (hash * 33ul);
+}
+
+/*  Key of plan: changes if builder recompiled, */
+/*         or targets, config, compiler changed. */
+u64 mace_plan_key(void) {
+    size_t       i;
+    char         buffer[64];
+    struct stat  st;
+    u64          key = 5381ul;
+
+    /* -- Builder: recompiled if macefile changed -- */
+    if (stat("/proc/self/exe", &st) == 0) {
+        sprintf(buffer, "%ld %ld", (long)st.st_mtime, (long)st.st_size);
+        key = mace_plan_hash(key, buffer);
+    }
+    key = mace_plan_hash(key, cwd);
+    key = mace_plan_hash(key, obj_dir);
+    key = mace_plan_hash(key, build_dir);
+    key = mace_plan_hash(key, cc);
+    key = mace_plan_hash(key, ar);
+    key = mace_plan_hash(key, cc_depflag);
+    sprintf(buffer, "%d %d %d", mace_target, mace_user_target, mace_default_target);
+    key = mace_plan_hash(key, buffer);
+    if ((mace_config >= 0) && ((size_t)mace_config < config_num)) {
+        key = mace_plan_hash(key, configs[mace_config].flags);
+        key = mace_plan_hash(key, configs[mace_config].linker);
+        key = mace_plan_hash(key, configs[mace_config].split_dwarf ? "split" : "");
+        key = mace_plan_hash(key, configs[mace_config].lto ? "lto" : "");
+        key = mace_plan_hash(key, configs[mace_config].train);
+        sprintf(buffer, "%d", configs[mace_config].pgo);
+        key = mace_plan_hash(key, buffer);
+    }
+
+    for (i = 0; i < target_num; i++) {
+        const Target *target = &targets[i];
+        key = mace_plan_hash(key, target->private._name);
+        key = mace_plan_hash(key, target->includes);
+        key = mace_plan_hash(key, target->sources);
+        key = mace_plan_hash(key, target->excludes);
+        key = mace_plan_hash(key, target->base_dir);
+        key = mace_plan_hash(key, target->flags);
+        key = mace_plan_hash(key, target->links);
+        key = mace_plan_hash(key, target->link_flags);
+        key = mace_plan_hash(key, target->dependencies);
+        key = mace_plan_hash(key, target->compile_pool);
+        key = mace_plan_hash(key, target->link_pool);
+        key = mace_plan_hash(key, target->pch);
+        sprintf(buffer, "%d %d %d %d %d %d", target->allatonce, target->batch,
+                target->unity, target->thin, target->partial, target->kind);
+        key = mace_plan_hash(key, buffer);
+    }
+    return (key);
+}
+
+/*  Is build a no-op: plan key, stats of its */
+/*         files unchanged since it was written. */
+b32 mace_plan_fresh(void) {
+    u32               i;
+    char             *path;
+    char             *buffer = NULL;
+    const char       *paths;
+    FILE             *fp;
+    Mace_Plan_File   *files;
+    Mace_Plan_Header  header;
+    b32               fresh  = false;
+
+    if (build_all || dry_run || report || explain || no_plan)
+        return (false);
+
+    path = mace_plan_path();
+    fp   = fopen(path, "rb");
+    MACE_FREE(path);
+    if (fp == NULL)
+        return (false);
+
+    /* -- One read: files, then their paths -- */
+    if ((fread(&header, sizeof(header), 1, fp) == 1) &&
+        (header.magic == MACE_PLAN_MAGIC) &&
+        (header.key == mace_plan_key())) {
+        size_t bytesize = header.num * sizeof(*files) + header.paths_len;
+        buffer = calloc(bytesize + 1, 1);
+        MACE_MEMCHECK(buffer);
+        fresh = (fread(buffer, 1, bytesize, fp) == bytesize);
+    }
+    fclose(fp);
+
+    /* -- Stats of files unchanged -- */
+    mace_chdir(cwd);
+    files = (Mace_Plan_File *)buffer;
+    paths = buffer + header.num * sizeof(*files);
+    for (i = 0; fresh && (i < header.num); i++) {
+        struct stat st;
+        b32 found;
+
+        if (files[i].path >= header.paths_len) {
+            fresh = false;
+            break;
+        }
+        found = (stat(paths + files[i].path, &st) == 0);
+        stats.plan_checks++;
+        fresh = ((found ? (u64)st.st_mtime : 0ul) == files[i].mtime) &&
+                ((found ? (u64)st.st_size  : 0ul) == files[i].size);
+        /* Edited after pre-build started: maybe after */
+        /* its checksum, or compile */
+        if (files[i].input && (files[i].mtime >= header.time))
+            fresh = false;
+    }
+    MACE_FREE(buffer);
+    stats.plan_fresh = fresh;
+    return (fresh);
+}
+
+/*  Add files target depends on to plan. */
+/*  @return false if target always builds */
+b32 mace_plan_Target(Mace_Plan *plan, const Target *target) {
+    int      i;
+    int      argc_objects;
+    char   **argv_objects;
+    char    *buffer;
+    char    *token;
+    char    *out;
+    char     dir[PATH_MAX];
+    b32      ok = true;
+
+    if ((target->cmd_pre != NULL) || (target->cmd_post != NULL) ||
+        (target->msg_pre != NULL) || (target->msg_post != NULL) ||
+        target->allatonce)
+        return (false);
+    if (target->kind == MACE_PHONY)
+        return (true);
+
+    /* -- Source dirs: added sources -- */
+    if (target->sources != NULL) {
+        if (target->base_dir != NULL)
+            mace_chdir(target->base_dir);
+        buffer = mace_str_buffer(target->sources);
+        token  = strtok(buffer, mace_separator);
+        while (ok && (token != NULL)) {
+            if (mace_isWildcard(token)) {
+                char *slash = strrchr(token, '/');
+                if (slash != NULL)
+                    *slash = '\0';
+                else
+                    token = ".";
+            }
+            if (mace_isWildcard(token)) {
+                ok = false;
+            } else if (mace_isDir(token)) {
+                ok = (realpath(token, dir) != NULL);
+                if (ok)
+                    mace_plan_add(plan, dir, true);
+            }
+            token = strtok(NULL, mace_separator);
+        }
+        MACE_FREE(buffer);
+        mace_chdir(cwd);
+    }
+
+    /* -- Sources, headers, objects -- */
+    for (i = 0; i < target->private._argc_sources; i++)
+        mace_plan_add(plan, target->private._argv_sources[i], true);
+    for (i = 0; i < target->private._headers_num; i++)
+        mace_plan_add(plan, target->private._headers[i], true);
+    argv_objects = mace_Target_link_objects(target, &argc_objects);
+    for (i = 0; i < argc_objects; i++)
+        mace_plan_add(plan, argv_objects[i] + strlen("-o"), false);
+    /* Retrained profiles recompile */
+    for (i = 0; (config_num > 0) && (configs[mace_config].pgo == MACE_PGO_USE) &&
+                (i < argc_objects); i++) {
+        char *profile = mace_pgo_profile(argv_objects[i] + strlen("-o"), true);
+        if (profile != NULL)
+            mace_plan_add(plan, profile, true);
+        MACE_FREE(profile);
+    }
+    if (target->private._pch_out != NULL)
+        mace_plan_add(plan, target->private._pch_out, false);
+
+    /* -- Output -- */
+    if (target->kind == MACE_OBJECT_LIBRARY)
+        return (ok);
+    out = mace_Target_output(target);
+    mace_plan_add(plan, out, false);
+    MACE_FREE(out);
+    return (ok);
+}
+
+/*  Add file, its current stats, to plan. */
+void mace_plan_add(Mace_Plan *plan, const char *path, b32 input) {
+    struct stat      st;
+    size_t           len = strlen(path) + 1;
+    Mace_Plan_File  *file;
+
+    if (plan->num >= plan->len) {
+        plan->len   = (plan->len > 0) ? plan->len * 2 : MACE_DEFAULT_OBJECT_LEN;
+        plan->files = realloc(plan->files, plan->len * sizeof(*plan->files));
+        MACE_MEMCHECK(plan->files);
+    }
+    while ((plan->paths_num + len) > plan->paths_len) {
+        plan->paths_len = (plan->paths_len > 0) ? plan->paths_len * 2 : MACE_CWD_BUFFERSIZE;
+        plan->paths     = realloc(plan->paths, plan->paths_len);
+        MACE_MEMCHECK(plan->paths);
+    }
+
+    file = &plan->files[plan->num++];
+    memset(file, 0, sizeof(*file));
+    file->hash  = mace_hash(path);
+    file->path  = (u32)plan->paths_num;
+    file->input = input;
+    if (stat(path, &st) == 0) {
+        file->mtime = (u64)st.st_mtime;
+        file->size  = (u64)st.st_size;
+    }
+    memcpy(plan->paths + plan->paths_num, path, len);
+    plan->paths_num += len;
+}
+
+/*  Files by path hash, to drop duplicates. */
+int mace_plan_cmp(const void *a, const void *b) {
+    const Mace_Plan_File *fa = a;
+    const Mace_Plan_File *fb = b;
+    if (fa->hash != fb->hash)
+        return (fa->hash < fb->hash ? -1 : 1);
+    return (0);
+}
+
+/*  Save files of targets in build_order, */
+/*         with their stats, to plan. */
+/*      - After build: objects, outputs exist */
+/*      - Time of plan is pre-build start: */
+/*        inputs edited during build stale */
+void mace_plan_write(void) {
+    int               i;
+    int               z;
+    int               num   = 0;
+    char             *path;
+    FILE             *fp;
+    b32               ok    = true;
+    Mace_Plan         plan;
+    Mace_Plan_Header  header;
+
+    MACE_EARLY_RET(!dry_run, MACE_VOID, MACE_nASSERT);
+
+    memset(&plan, 0, sizeof(plan));
+    for (z = 0; ok && (z < build_order_num); z++)
+        ok = mace_plan_Target(&plan, &targets[build_order[z]]);
+
+    /* -- Headers shared by targets: once -- */
+    if (plan.num > 0)
+        qsort(plan.files, plan.num, sizeof(*plan.files), mace_plan_cmp);
+    for (i = 0; i < plan.num; i++) {
+        Mace_Plan_File *last = (num > 0) ? &plan.files[num - 1] : NULL;
+        if ((last != NULL) && (last->hash == plan.files[i].hash) &&
+            (strcmp(plan.paths + last->path, plan.paths + plan.files[i].path) == 0)) {
+            last->input |= plan.files[i].input;
+            continue;
+        }
+        plan.files[num++] = plan.files[i];
+    }
+
+    path = mace_plan_path();
+    fp   = ok ? fopen(path, "wb") : NULL;
+    if (fp != NULL) {
+        header.magic        = MACE_PLAN_MAGIC;
+        header.num          = (u32)num;
+        header.key          = mace_plan_key();
+        header.time         = stats.plan_time;
+        header.paths_len    = (u64)plan.paths_num;
+        fwrite(&header, sizeof(header), 1, fp);
+        fwrite(plan.files, sizeof(*plan.files), num, fp);
+        fwrite(plan.paths, 1, plan.paths_num, fp);
+        fclose(fp);
+    } else {
+        /* Targets always build: no plan */
+        remove(path);
+    }
+    MACE_FREE(path);
+    MACE_FREE(plan.files);
+    MACE_FREE(plan.paths);
+}
+
+/*  Add slot-time since last change: busy */
+/*         slots, idle ones blamed on cause. */
+void mace_util_tick(void) {
+    u64 now;
+    u64 busy;
+
+    MACE_EARLY_RET(util.last > 0, MACE_VOID, MACE_nASSERT);
+
+    now  = mace_time_us();
+    busy = (u64)(pnum + util.serial);
+    if (busy > (u64)plen)
+        busy = (u64)plen;
+    util.busy               += busy * (now - util.last);
+    util.idle[util.cause]   += ((u64)plen - busy) * (now - util.last);
+    util.last                = now;
+}
+
+/*  Blame idle slots on cause from now. */
+/*  @return Previous cause, to restore */
+int mace_util_cause(int cause) {
+    int previous = util.cause;
+
+    assert((cause >= 0) && (cause < MACE_IDLE_NUM));
+    mace_util_tick();
+    util.cause = cause;
+    return (previous);
+}
+
+/*  Print time spent in phases, counters. */
+/*      - format: MACE_STATS_TEXT or _JSON */
+/*      - Times in [us] in JSON, [ms] in text */
+void mace_stats_print(int format) {
+    int i;
+    int z;
+    u64 total = stats.pre_user  + stats.user    +
+                stats.post_user + stats.pre_build + stats.build;
+    u64 slots = util.busy;
+
+    for (i = 0; i < MACE_IDLE_NUM; i++)
+        slots += util.idle[i];
+    if (slots == 0)
+        slots = 1;
+
+    if (format == MACE_STATS_JSON) {
+        printf("{\"phases\":{\"pre_user\":%lu,\"user\":%lu,"
+               "\"post_user\":%lu,\"pre_build\":%lu,\"build\":%lu,"
+               "\"total\":%lu},\n",
+               (unsigned long)stats.pre_user,  (unsigned long)stats.user,
+               (unsigned long)stats.post_user, (unsigned long)stats.pre_build,
+               (unsigned long)stats.build,     (unsigned long)total);
+        printf("\"pre_build\":{");
+        for (z = 0; z < build_order_num; z++) {
+            Target *target = &targets[build_order[z]];
+            printf("%s", z > 0 ? "," : "");
+            mace_json_string(stdout, target->private._name);
+            printf(":%lu", (unsigned long)target->private._prebuild_time);
+        }
+        printf("},\n\"pre_build_phases\":{\"plan\":%lu,\"sources\":%lu,\"depfiles\":%lu,"
+               "\"objdeps\":%lu,\"headers\":%lu,\"unity\":%lu,\"schedule\":%lu",
+               (unsigned long)stats.pre_plan,
+               (unsigned long)stats.pre_sources,  (unsigned long)stats.pre_depfiles,
+               (unsigned long)stats.pre_objdeps,  (unsigned long)stats.pre_headers,
+               (unsigned long)stats.pre_unity,    (unsigned long)stats.pre_schedule);
+        printf("},\n\"counters\":{\"files_hashed\":%lu,\"bytes_hashed\":%lu,"
+               "\"d_loads\":%d,\"ho_loads\":%d,\"processes\":%d,"
+               "\"objects_skipped\":%d,\"links_skipped\":%d,"
+               "\"plan_checks\":%d,\"plan_fresh\":%s}",
+               (unsigned long)stats.files_hashed,
+               (unsigned long)stats.bytes_hashed,
+               stats.d_loads, stats.ho_loads, stats.processes,
+               stats.objects_skipped, stats.links_skipped,
+               stats.plan_checks, stats.plan_fresh ? "true" : "false");
+        printf(",\n\"utilization\":{\"slots\":%d,\"used\":%.1f,\"idle\":{",
+               plen, 100.0 * util.busy / slots);
+        for (i = 0; i < MACE_IDLE_NUM; i++)
+            printf("%s\"%s\":%.1f", i > 0 ? "," : "", mace_idles[i],
+                   100.0 * util.idle[i] / slots);
+        printf("}}}\n");
+        return;
+    }
+
+    printf("Stats:\n");
+    printf("  %-20s %10.3f ms\n", "pre-user",  stats.pre_user  / 1000.0);
+    printf("  %-20s %10.3f ms\n", "user mace()", stats.user    / 1000.0);
+    printf("  %-20s %10.3f ms\n", "post-user", stats.post_user / 1000.0);
+    printf("  %-20s %10.3f ms\n", "pre-build", stats.pre_build / 1000.0);
+    for (z = 0; z < build_order_num; z++) {
+        Target *target = &targets[build_order[z]];
+        printf("    %-18s %10.3f ms\n", target->private._name,
+               target->private._prebuild_time / 1000.0);
+    }
+    printf("    %-18s %10.3f ms\n", "- plan",     stats.pre_plan     / 1000.0);
+    printf("    %-18s %10.3f ms\n", "- sources",  stats.pre_sources  / 1000.0);
+    printf("    %-18s %10.3f ms\n", "- .d files", stats.pre_depfiles / 1000.0);
+    printf("    %-18s %10.3f ms\n", "- .d, .ho",  stats.pre_objdeps  / 1000.0);
+    printf("    %-18s %10.3f ms\n", "- headers",  stats.pre_headers  / 1000.0);
+    printf("    %-18s %10.3f ms\n", "- unity",    stats.pre_unity    / 1000.0);
+    printf("    %-18s %10.3f ms\n", "- schedule", stats.pre_schedule / 1000.0);
+    printf("  %-20s %10.3f ms\n", "build",     stats.build     / 1000.0);
+    printf("  %-20s %10.3f ms\n", "total",     total           / 1000.0);
+    printf("  %-20s %10lu (%lu bytes)\n", "files hashed",
+           (unsigned long)stats.files_hashed,
+           (unsigned long)stats.bytes_hashed);
+    printf("  %-20s %10d\n", ".d loads",        stats.d_loads);
+    printf("  %-20s %10d\n", ".ho loads",       stats.ho_loads);
+    printf("  %-20s %10d\n", "processes",       stats.processes);
+    printf("  %-20s %10d\n", "objects skipped", stats.objects_skipped);
+    printf("  %-20s %10d\n", "links skipped",   stats.links_skipped);
+    printf("  %-20s %10d (%s)\n", "plan checks",   stats.plan_checks,
+           stats.plan_fresh ? "fresh, no-op" : "stale");
+    printf("  %-20s %9.1f %% of %d slots x %.3f s\n", "slots used",
+           100.0 * util.busy / slots, plen, slots / (plen > 0 ? plen * 1e6 : 1e6));
+    for (i = 0; i < MACE_IDLE_NUM; i++) {
+        if (util.idle[i] > 0)
+            printf("    idle %-13s %9.1f %%\n", mace_idles[i],
+                   100.0 * util.idle[i] / slots);
+    }
+}
+
+/*  Read compile record of object from .t */
+/*         file. Zeroes if unknown. */
+void mace_record_read(const char *object,
+                      Mace_Record *record) {
+    Mace_Record records[MACE_RECORD_HISTORY];
+
+    MACE_EARLY_RET(record != NULL, MACE_VOID, assert);
+    memset(record, 0, sizeof(*record));
+
+    if (mace_record_history(object, records) > 0)
+        *record = records[0];
+}
+
+/*  Read compile records of object from .t */
+/*         file, newest first. */
+/*      - Legacy .t files: single duration, */
+/*        or duration and rss, as one record */
+/*  @return Number of records, 0 if unknown */
+int mace_record_history(const char *object,
+                        Mace_Record *records) {
+    int      num    = 0;
+    size_t   bytes  = 0;
+    u32      legacy[2];
+    char    *time_file;
+    FILE    *ft;
+
+    MACE_EARLY_RET(object  != NULL, 0, assert);
+    MACE_EARLY_RET(records != NULL, 0, assert);
+
+    time_file = mace_str_buffer(object);
+    time_file[strlen(time_file) - 1] = 't';
+    ft = fopen(time_file, "rb");
+    if (ft != NULL) {
+        bytes = fread(records, 1, MACE_RECORD_HISTORY * sizeof(*records), ft);
+        fclose(ft);
+    }
+    MACE_FREE(time_file);
+
+    num = (int)(bytes / sizeof(*records));
+    if ((bytes != sizeof(u32)) && (bytes != sizeof(legacy)))
+        return (num);
+
+    /* Legacy .t file: older than Mace_Record */
+    memcpy(legacy, records, bytes);
+    memset(records, 0, sizeof(*records));
+    records[0].duration = legacy[0];
+    if (bytes == sizeof(legacy))
+        records[0].rss  = legacy[1];
+    return (records[0].duration > 0);
+}
+
+/*  Add compile record of object to its .t file. */
+/*      - Oldest record dropped if history full */
+void mace_record_write(const char *object,
+                       const Mace_Record *record) {
+    int          num;
+    char        *time_file;
+    FILE        *ft;
+    Mace_Record  records[MACE_RECORD_HISTORY];
+
+    MACE_EARLY_RET(object != NULL, MACE_VOID, assert);
+    MACE_EARLY_RET(record != NULL, MACE_VOID, assert);
+
+    num = mace_record_history(object, records);
+    if (num >= MACE_RECORD_HISTORY)
+        num = MACE_RECORD_HISTORY - 1;
+    memmove(records + 1, records, num * sizeof(*records));
+    num++;
+
+    /* 0 is unknown duration */
+    records[0] = *record;
+    if (records[0].duration == 0)
+        records[0].duration = 1;
+
+    time_file = mace_str_buffer(object);
+    time_file[strlen(time_file) - 1] = 't';
+    ft = fopen(time_file, "wb");
+    if (ft != NULL) {
+        fwrite(records, sizeof(*records), num, ft);
+        fclose(ft);
+    }
+    MACE_FREE(time_file);
+}
+
+/*  Hash of target's compile command, */
+/*         without source and object. */
+/*      - Before config flags added to _argv */
+u32 mace_Target_fingerprint(const Target *target) {
+    int i;
+    u64 hash = mace_hash(cc);
+
+    MACE_EARLY_RET(target->private._argv != NULL, 0, MACE_nASSERT);
+
+    for (i = MACE_ARGV_OTHER; i < target->private._argc; i++) {
+        if (target->private._argv[i] == NULL)
+            continue;
+        hash = (hash * 33ul) ^ mace_hash(target->private._argv[i]);
+    }
+    for (i = 0; (config_num > 0) && (i < configs[mace_config].private._flag_num); i++)
+        hash = (hash * 33ul) ^ mace_hash(configs[mace_config].private._flags[i]);
+    if (mace_lto())
+        hash = (hash * 33ul) ^ mace_hash("-flto");
+    return ((u32)(hash ^ (hash >> 32)));
+}
+
+/*  Read recorded compile durations, peak */
+/*         memory of all objects to recompile */
+/*         into _weights, _rss. */
+/*      - Sums known durations, source sizes */
+/*      - Unknown memory is largest known */
+void mace_Target_Durations(Target *target,
+                           u64 *ms, u64 *bytes) {
+    int i;
+    u64 rss_max = 0;
+
+    MACE_EARLY_RET(target != NULL, MACE_VOID, assert);
+    MACE_FREE(target->private._weights);
+    MACE_FREE(target->private._rss);
+    MACE_EARLY_RET(target->private._argc_sources > 0, MACE_VOID, MACE_nASSERT);
+
+    target->private._weights = calloc(target->private._argc_sources,
+                                      sizeof(*target->private._weights));
+    MACE_MEMCHECK(target->private._weights);
+    target->private._rss = calloc(target->private._argc_sources,
+                                  sizeof(*target->private._rss));
+    MACE_MEMCHECK(target->private._rss);
+
+    for (i = 0; i < target->private._argc_sources; i++) {
+        struct stat st;
+        Mace_Record record;
+
+        if (!target->private._recompiles[i])
+            continue;
+
+        mace_record_read(target->private._argv_objects[i] + 2, &record);
+        target->private._weights[i] = record.duration;
+        target->private._rss[i]     = record.rss;
+        if (record.rss > rss_max)
+            rss_max = record.rss;
+        if (record.duration == 0)
+            continue;
+        if (stat(target->private._argv_sources[i], &st) != 0)
+            continue;
+        *ms    += record.duration;
+        *bytes += st.st_size;
+    }
+
+    for (i = 0; i < target->private._argc_sources; i++) {
+        if (target->private._rss[i] == 0)
+            target->private._rss[i] = rss_max;
+    }
+}
+
+/*  Longest compile time first, then source order. */
+int mace_weight_cmp(const void *a, const void *b) {
+    int ia = *(const int *)a;
+    int ib = *(const int *)b;
+    if (mace_sort_weights[ia] != mace_sort_weights[ib])
+        return (mace_sort_weights[ia] < mace_sort_weights[ib] ? 1 : -1);
+    return (ia - ib);
+}
+
+/*  Split dirty sources into about batch shards. */
+/*      - Sources of shard share object directory: */
+/*        no same filenames */
+/*      - Directories get shards in ratio of their */
+/*        weight, longest source to lightest shard */
+/*      - Shards ordered longest first */
+/*  @return Weight of longest shard */
+u64 mace_Target_Shards(Target *target) {
+    int  i, j;
+    int  dir_num    = 0;
+    int  shard_num  = 0;
+    int  num        = target->private._compile_num;
+    int *compile    = target->private._compile_order;
+    u64 *weights    = target->private._weights;
+    u64  total      = 0;
+    u64  longest;
+    /* [dir] */
+    u64 *dir_hash, *dir_weight;
+    int *dir_count, *dir_first, *dir_shards;
+    /* [compile_num] */
+    int *dir_of, *shard_of;
+    /* [shard] */
+    u64 *loads;
+    int *counts;
+
+    MACE_FREE(target->private._shard_sources);
+    MACE_FREE(target->private._shard_start);
+    target->private._shard_num = 0;
+    MACE_EARLY_RET(num > 0, 0, MACE_nASSERT);
+    MACE_EARLY_RET(target->batch > 0, 0, assert);
+
+    dir_hash    = calloc(num, sizeof(*dir_hash));
+    dir_weight  = calloc(num, sizeof(*dir_weight));
+    loads       = calloc(num, sizeof(*loads));
+    dir_count   = calloc(num, sizeof(*dir_count));
+    dir_first   = calloc(num, sizeof(*dir_first));
+    dir_shards  = calloc(num, sizeof(*dir_shards));
+    dir_of      = calloc(num, sizeof(*dir_of));
+    shard_of    = calloc(num, sizeof(*shard_of));
+    counts      = calloc(num, sizeof(*counts));
+    MACE_MEMCHECK(dir_hash);
+    MACE_MEMCHECK(dir_weight);
+    MACE_MEMCHECK(loads);
+    MACE_MEMCHECK(dir_count);
+    MACE_MEMCHECK(dir_first);
+    MACE_MEMCHECK(dir_shards);
+    MACE_MEMCHECK(dir_of);
+    MACE_MEMCHECK(shard_of);
+    MACE_MEMCHECK(counts);
+
+    /* -- Group sources by object directory -- */
+    for (i = 0; i < num; i++) {
+        u64   hash;
+        char *dir   = mace_str_buffer(target->private._argv_objects[compile[i]] + 2);
+        char *slash = strrchr(dir, '/');
+        if (slash != NULL)
+            *slash = '\0';
+        hash = mace_hash(dir);
+        MACE_FREE(dir);
+
+        for (j = 0; j < dir_num; j++) {
+            if (dir_hash[j] == hash)
+                break;
+        }
+        if (j == dir_num)
+            dir_hash[dir_num++] = hash;
+        dir_of[i]       = j;
+        dir_weight[j]  += weights[compile[i]];
+        dir_count[j]++;
+        total          += weights[compile[i]];
+    }
+
+    /* -- Shards per directory, in ratio of weight -- */
+    for (j = 0; j < dir_num; j++) {
+        u64 k = (target->batch * dir_weight[j] + total - 1) / total;
+        if (k < 1)
+            k = 1;
+        if (k > (u64)dir_count[j])
+            k = dir_count[j];
+        dir_first[j]    = shard_num;
+        dir_shards[j]   = (int)k;
+        shard_num      += (int)k;
+    }
+
+    /* -- Longest source to lightest shard of its directory -- */
+    for (i = 0; i < num; i++) {
+        int d       = dir_of[i];
+        int best    = dir_first[d];
+        for (j = dir_first[d] + 1; j < dir_first[d] + dir_shards[d]; j++) {
+            if (loads[j] < loads[best])
+                best = j;
+        }
+        shard_of[i]     = best;
+        loads[best]    += weights[compile[i]];
+        counts[best]++;
+    }
+
+    longest = mace_Target_Shards_Fill(target, shard_num, shard_of,
+                                      loads, counts);
+
+    MACE_FREE(dir_hash);
+    MACE_FREE(dir_weight);
+    MACE_FREE(loads);
+    MACE_FREE(dir_count);
+    MACE_FREE(dir_first);
+    MACE_FREE(dir_shards);
+    MACE_FREE(dir_of);
+    MACE_FREE(shard_of);
+    MACE_FREE(counts);
+    return (longest);
+}
+
+/*  Order shards longest first, put sources */
+/*         of _compile_order in their shard. */
+/*      - shard_of: [compile_num] shard */
+/*      - loads, counts: [shard] */
+/*  @return Weight of longest shard */
+u64 mace_Target_Shards_Fill(Target *target, int shard_num,
+                            const int *shard_of,
+                            u64 *loads, const int *counts) {
+    int  i, j;
+    int  num        = target->private._compile_num;
+    int *compile    = target->private._compile_order;
+    u64  longest;
+    int *order      = calloc(shard_num, sizeof(*order));
+    int *rank       = calloc(shard_num, sizeof(*rank));
+    int *fill       = calloc(shard_num, sizeof(*fill));
+    MACE_MEMCHECK(order);
+    MACE_MEMCHECK(rank);
+    MACE_MEMCHECK(fill);
+
+    /* -- Shards longest first -- */
+    for (j = 0; j < shard_num; j++)
+        order[j] = j;
+    mace_sort_weights = loads;
+    qsort(order, shard_num, sizeof(*order), mace_weight_cmp);
+    mace_sort_weights = NULL;
+    longest = loads[order[0]];
+
+    target->private._shard_start   = calloc(shard_num + 1,
+                                            sizeof(*target->private._shard_start));
+    target->private._shard_sources = calloc(num,
+                                            sizeof(*target->private._shard_sources));
+    MACE_MEMCHECK(target->private._shard_start);
+    MACE_MEMCHECK(target->private._shard_sources);
+    for (j = 0; j < shard_num; j++) {
+        rank[order[j]]  = j;
+        target->private._shard_start[j + 1] = target->private._shard_start[j] +
+                                              counts[order[j]];
+        fill[j]         = target->private._shard_start[j];
+    }
+    for (i = 0; i < num; i++) {
+        int r = rank[shard_of[i]];
+        target->private._shard_sources[fill[r]++] = compile[i];
+    }
+    target->private._shard_num = shard_num;
+
+    MACE_FREE(order);
+    MACE_FREE(rank);
+    MACE_FREE(fill);
+    return (longest);
+}
+
+/*  Record compile of shard's sources: */
+/*         duration split by their weights. */
+void mace_Target_Shard_Record(Target *target, int shard,
+                              u64 duration, u64 rss, int status) {
+    int i;
+    int start;
+    int end;
+    u64 sum = 0;
+
+    MACE_EARLY_RET(target != NULL, MACE_VOID, assert);
+    MACE_EARLY_RET(target->private._shard_start != NULL, MACE_VOID, assert);
+
+    start   = target->private._shard_start[shard];
+    end     = target->private._shard_start[shard + 1];
+    for (i = start; i < end; i++)
+        sum += target->private._weights[target->private._shard_sources[i]];
+
+    for (i = start; i < end; i++) {
+        Mace_Record record;
+        int  argc   = target->private._shard_sources[i];
+        u64  weight = target->private._weights[argc];
+        record.duration = (u32)(sum > 0 ? duration * weight / sum : duration / (end - start));
+        record.rss          = (u32)rss;
+        record.status       = (u32)status;
+        record.fingerprint  = target->private._fingerprint;
+        mace_record_write(target->private._argv_objects[argc] + 2, &record);
+    }
+}
+
+/*  Order of indices of mace_sort_paths, by path. */
+int mace_path_cmp(const void *a, const void *b) {
+    int ia = *(const int *)a;
+    int ib = *(const int *)b;
+    return (strcmp(mace_sort_paths[ia], mace_sort_paths[ib]));
+}
+
+/*  Chunk target's sources into unity files. */
+/*      - Sources sorted by path relative to cwd */
+/*      - Chunk ends at source with path hash 0 */
+/*        mod unity, or at 2 * unity sources */
+/*      - Chunk named from hash of its first path: */
+/*        stable across edits, added sources. */
+/*        Colliding hashes: next free one */
+/*      - Unity file rewritten if chunk changed */
+/*      - All sources of chunk recompile if any */
+/*        changed, or if its object is missing */
+/*      - Files of removed chunks deleted */
+void mace_Target_Unity(Target *target) {
+    int           i, k;
+    int           size      = 0;
+    int          *order;
+    int          *first;
+    b32          *dirty;
+    u64          *names;
+    const char  **rel;
+    size_t        cwd_len   = strlen(cwd);
+    size_t        name_len;
+    int           num       = target->private._argc_sources;
+
+    MACE_EARLY_RET(target != NULL, MACE_VOID, assert);
+    MACE_EARLY_RET(target->unity > 0, MACE_VOID, assert);
+
+    /* -- Free previous chunks -- */
+    MACE_FREE(target->private._unity_chunk);
+    mace_argv_free(target->private._unity_sources, target->private._unity_num);
+    mace_argv_free(target->private._unity_objects, target->private._unity_num);
+    target->private._unity_sources = NULL;
+    target->private._unity_objects = NULL;
+    target->private._unity_num     = 0;
+    MACE_EARLY_RET(num > 0, MACE_VOID, MACE_nASSERT);
+
+    rel     = calloc(num, sizeof(*rel));
+    order   = calloc(num, sizeof(*order));
+    first   = calloc(num, sizeof(*first));
+    MACE_MEMCHECK(rel);
+    MACE_MEMCHECK(order);
+    MACE_MEMCHECK(first);
+    target->private._unity_chunk = calloc(num, sizeof(*target->private._unity_chunk));
+    MACE_MEMCHECK(target->private._unity_chunk);
+
+    /* -- Sources by path relative to cwd -- */
+    for (i = 0; i < num; i++) {
+        rel[i] = target->private._argv_sources[i];
+        if ((strncmp(rel[i], cwd, cwd_len) == 0) && (rel[i][cwd_len] == '/'))
+            rel[i] += cwd_len + 1;
+        order[i] = i;
+    }
+    mace_sort_paths = rel;
+    qsort(order, num, sizeof(*order), mace_path_cmp);
+    mace_sort_paths = NULL;
+
+    /* -- Chunks: runs of sorted sources -- */
+    for (i = 0; i < num; i++) {
+        int src = order[i];
+        if (size == 0)
+            first[target->private._unity_num++] = src;
+        target->private._unity_chunk[src] = target->private._unity_num - 1;
+        size++;
+        if (((mace_hash(rel[src]) % target->unity) == 0) ||
+            (size >= 2 * target->unity))
+            size = 0;
+    }
+
+    target->private._unity_sources = calloc(target->private._unity_num,
+                                            sizeof(*target->private._unity_sources));
+    target->private._unity_objects = calloc(target->private._unity_num,
+                                            sizeof(*target->private._unity_objects));
+    dirty = calloc(target->private._unity_num, sizeof(*dirty));
+    names = calloc(target->private._unity_num, sizeof(*names));
+    MACE_MEMCHECK(target->private._unity_sources);
+    MACE_MEMCHECK(target->private._unity_objects);
+    MACE_MEMCHECK(dirty);
+    MACE_MEMCHECK(names);
+
+    name_len = strlen(target->private._name);
+    for (k = 0; k < target->private._unity_num; k++) {
+        char    *name;
+        char    *content;
+        size_t   len;
+        size_t   content_len = 0;
+
+        /* -- Paths: <obj_dir>/<target>_unity<hash>.c, .o -- */
+        names[k] = mace_hash(rel[first[k]]);
+        for (i = 0; i < k; i++) {
+            if (names[i] == names[k]) {
+                names[k]++;
+                i = -1;
+            }
+        }
+        name = calloc(name_len + 32, sizeof(*name));
+        MACE_MEMCHECK(name);
+        sprintf(name, "%s_unity%016lx.c", target->private._name,
+                (unsigned long)names[k]);
+        mace_object_path(name);
+        MACE_FREE(name);
+        len = strlen(object);
+        target->private._unity_objects[k] = calloc(len + 3,
+                                                   sizeof(**target->private._unity_objects));
+        MACE_MEMCHECK(target->private._unity_objects[k]);
+        memcpy(target->private._unity_objects[k], "-o", 2);
+        memcpy(target->private._unity_objects[k] + 2, object, len);
+        target->private._unity_sources[k] = mace_str_buffer(object);
+        target->private._unity_sources[k][len - 1] = 'c';
+
+        /* -- #include sources of chunk, sorted -- */
+        for (i = 0; i < num; i++) {
+            if (target->private._unity_chunk[order[i]] == k)
+                content_len += strlen(target->private._argv_sources[order[i]]) + 12;
+        }
+        content = calloc(content_len + 1, sizeof(*content));
+        MACE_MEMCHECK(content);
+        len = 0;
+        for (i = 0; i < num; i++) {
+            int src = order[i];
+            if (target->private._unity_chunk[src] != k)
+                continue;
+            len += sprintf(content + len, "#include \"%s\"\n",
+                           target->private._argv_sources[src]);
+            if (target->private._recompiles[src])
+                dirty[k] = true;
+        }
+
+        if (mace_write_changed(target->private._unity_sources[k], content))
+            dirty[k] = true;
+        if (access(target->private._unity_objects[k] + 2, F_OK) != 0)
+            dirty[k] = true;
+        MACE_FREE(content);
+    }
+
+    /* -- Chunk recompiles all its sources -- */
+    for (i = 0; i < num; i++) {
+        if (dirty[target->private._unity_chunk[i]])
+            mace_Target_Reason(target, i, MACE_REASON_UNITY);
+    }
+    mace_remove_stale(target, "_unity", target->private._unity_objects,
+                      target->private._unity_num);
+
+    MACE_FREE(rel);
+    MACE_FREE(order);
+    MACE_FREE(first);
+    MACE_FREE(dirty);
+    MACE_FREE(names);
+}
+
+/*  Shard of unity target is a chunk with */
+/*         sources to recompile. */
+/*  @return Weight of longest chunk */
+u64 mace_Target_Unity_Shards(Target *target) {
+    int  i;
+    int  shard_num  = 0;
+    int  num        = target->private._compile_num;
+    int *compile    = target->private._compile_order;
+    int *shard      = NULL;
+    int *shard_of   = NULL;
+    int *counts     = NULL;
+    u64 *loads      = NULL;
+    u64  longest;
+
+    MACE_FREE(target->private._shard_sources);
+    MACE_FREE(target->private._shard_start);
+    target->private._shard_num = 0;
+    MACE_EARLY_RET(num > 0, 0, MACE_nASSERT);
+    MACE_EARLY_RET(target->private._unity_chunk != NULL, 0, assert);
+
+    /* [chunk] */
+    shard       = calloc(target->private._unity_num, sizeof(*shard));
+    MACE_MEMCHECK(shard);
+    for (i = 0; i < target->private._unity_num; i++)
+        shard[i] = -1;
+    /* [compile_num] */
+    shard_of    = calloc(num, sizeof(*shard_of));
+    counts      = calloc(num, sizeof(*counts));
+    loads       = calloc(num, sizeof(*loads));
+    MACE_MEMCHECK(shard_of);
+    MACE_MEMCHECK(counts);
+    MACE_MEMCHECK(loads);
+
+    for (i = 0; i < num; i++) {
+        int chunk = target->private._unity_chunk[compile[i]];
+        if (shard[chunk] < 0)
+            shard[chunk] = shard_num++;
+        shard_of[i]             = shard[chunk];
+        loads[shard[chunk]]    += target->private._weights[compile[i]];
+        counts[shard[chunk]]++;
+    }
+    longest = mace_Target_Shards_Fill(target, shard_num, shard_of,
+                                      loads, counts);
+
+    MACE_FREE(shard);
+    MACE_FREE(shard_of);
+    MACE_FREE(counts);
+    MACE_FREE(loads);
+    return (longest);
+}
+
+/*  Order target's sources to recompile, */
+/*         longest expected compile time first. */
+/*      - Unknown durations estimated from source */
+/*        size, using ms/bytes of known objects */
+void mace_Target_Schedule(Target *target,
+                          u64 ms, u64 bytes) {
+    int i;
+    int slots;
+    u64 sum     = 0;
+    u64 longest = 0;
+
+    MACE_EARLY_RET(target != NULL, MACE_VOID, assert);
+    MACE_FREE(target->private._compile_order);
+    target->private._compile_num    = 0;
+    target->private._cost           = 0;
+    MACE_EARLY_RET(target->private._argc_sources > 0, MACE_VOID, MACE_nASSERT);
+
+    if (target->private._weights == NULL)
+        mace_Target_Durations(target, &ms, &bytes);
+
+    target->private._compile_order = calloc(target->private._argc_sources,
+                                            sizeof(*target->private._compile_order));
+    MACE_MEMCHECK(target->private._compile_order);
+
+    for (i = 0; i < target->private._argc_sources; i++) {
+        u64 *weight = &target->private._weights[i];
+        if (!target->private._recompiles[i])
+            continue;
+
+        /* -- Estimate unknown duration -- */
+        if (*weight == 0) {
+            struct stat st;
+            if (stat(target->private._argv_sources[i], &st) == 0)
+                *weight = (bytes > 0) ? (st.st_size * ms) / bytes : st.st_size;
+            if (*weight == 0)
+                *weight = 1;
+        }
+
+        sum    += *weight;
+        longest = *weight > longest ? *weight : longest;
+        target->private._compile_order[target->private._compile_num++] = i;
+    }
+
+    mace_sort_weights = target->private._weights;
+    qsort(target->private._compile_order, target->private._compile_num,
+          sizeof(*target->private._compile_order), mace_weight_cmp);
+    mace_sort_weights = NULL;
+
+    /* -- Batch, unity: shard takes as long as its sources -- */
+    if (target->unity > 0)
+        longest = mace_Target_Unity_Shards(target);
+    else if (target->batch > 0)
+        longest = mace_Target_Shards(target);
+
+    /* -- Target takes at least its longest object -- */
+    slots = pools[target->private._compile_pool].limit;
+    target->private._cost = slots > 1 ? sum / slots : sum;
+    if (longest > target->private._cost)
+        target->private._cost = longest;
+}
+
+/*  Schedule all targets in build_order. */
+void mace_schedule(void) {
+    int z;
+    u64 ms      = 0;
+    u64 bytes   = 0;
+
+    /* -- Known durations of all dirty objects -- */
+    for (z = 0; z < build_order_num; z++) {
+        mace_Target_Durations(&targets[build_order[z]], &ms, &bytes);
+    }
+
+    /* -- Estimate the rest, order sources -- */
+    for (z = 0; z < build_order_num; z++) {
+        mace_Target_Schedule(&targets[build_order[z]], ms, bytes);
+    }
+
+    mace_build_order_critical();
+}
+
+/*  Reorder build_order: target on longest */
+/*         critical path first, after its */
+/*         dependencies. */
+void mace_build_order_critical(void) {
+    int  i;
+    int  j;
+    int  z;
+    int *order;
+    u64 *path;
+    b32 *placed;
+
+    MACE_EARLY_RET(build_order_num > 1, MACE_VOID, MACE_nASSERT);
+
+    order   = calloc(build_order_num, sizeof(*order));
+    path    = calloc(build_order_num, sizeof(*path));
+    placed  = calloc(build_order_num, sizeof(*placed));
+    MACE_MEMCHECK(order);
+    MACE_MEMCHECK(path);
+    MACE_MEMCHECK(placed);
+
+    /* -- Critical path: cost + longest path of dependents -- */
+    /* Note: dependents are after target in build_order */
+    for (i = build_order_num - 1; i >= 0; i--) {
+        u64 longest = 0;
+        const Target *target = &targets[build_order[i]];
+        for (j = i + 1; j < build_order_num; j++) {
+            const Target *dependent = &targets[build_order[j]];
+            if (mace_Target_hasDep(dependent, target->private._hash) &&
+                (path[j] > longest))
+                longest = path[j];
+        }
+        path[i] = target->private._cost + longest;
+    }
+
+    /* -- Pick ready target with longest critical path -- */
+    for (z = 0; z < build_order_num; z++) {
+        int next = -1;
+        for (i = 0; i < build_order_num; i++) {
+            b32 ready = !placed[i];
+            for (j = 0; ready && (j < build_order_num); j++) {
+                if (placed[j] || (i == j))
+                    continue;
+                if (mace_Target_hasDep(&targets[build_order[i]],
+                                       targets[build_order[j]].private._hash))
+                    ready = false;
+            }
+            if (ready && ((next < 0) || (path[i] > path[next])))
+                next = i;
+        }
+        assert(next >= 0);
+        placed[next]    = true;
+        order[z]        = build_order[next];
+    }
+    memcpy(build_order, order, build_order_num * sizeof(*build_order));
+
+    MACE_FREE(order);
+    MACE_FREE(path);
+    MACE_FREE(placed);
+}
+
+/***************** mace_glob_sources ****************/
+/*  If source is a folder, get all .c files in it. */
+glob_t mace_glob_sources(const char *path) {
+    glob_t  globbed;
+    int     flags   = 0;
+    int     ret     = glob(path, flags, mace_globerr, &globbed);
+
+    if (ret != 0) {
+        fprintf(stderr, "problem with %s (%s), quitting\n", path,
+                (ret == GLOB_ABORTED ? "filesystem problem" :
+                 ret == GLOB_NOMATCH ? "no match of pattern" :
+                 ret == GLOB_NOSPACE ? "no dynamic memory" :
+                 "unknown problem\n"));
+        exit(ret);
+    }
+
+    return (globbed);
+}
+
+int mace_globerr(const char *path, int eerrno) {
+    fprintf(stderr, "%s: %s\n", path, strerror(eerrno));
+    return (eerrno);
+}
+
+/***************** mace_exec ******************/
+/*  Print command to be run in forked process. */
+void mace_exec_print(char *const arguments[],
+                     size_t argnum) {
+    int i;
+
+    for (i = 0; i < argnum; i++) {
+        if (verbose && !silent)
+            printf("%s ", arguments[i]);
+    }
+    if (verbose && !silent)
+        printf("%s", "\n");
+}
+
+/*  Put back arguments array (argv) into a */
+/*         single line for execvp. */
+char *mace_args2line(char *const arguments[]) {
+    int i   =   0;
+    int num =   0;
+    int len = 128;
+
+    char *argline = calloc(len, sizeof(*argline));
+    MACE_MEMCHECK(argline);
+
+    while ((arguments[i] != NULL) &&
+           (i < MACE_MAX_ITERATIONS)) {
+        size_t ilen = strlen(arguments[i]);
+        while ((num + ilen + 1) > len) {
+            size_t bytesize = len * 2 * sizeof(*argline);
+            argline = realloc(argline, bytesize);
+            MACE_MEMCHECK(argline);
+            memset(argline + len, 0, len);
+            len *= 2;
+        }
+        assert(num < len);
+        memcpy(argline + num, arguments[i], ilen);
+        num += ilen;
+        argline[num++] = ' ';
+        i++;
+    }
+    if (i == MACE_MAX_ITERATIONS) {
+        if (!silent)
+            printf("Warning! Max iterations reached. Truncating argv.");
+    }
+    argline[num] = '\0';
+    return (argline);
+}
+
+/*  Execute command in a different fork with */
+/*         execvp and bash. */
+pid_t mace_exec_wbash(const char *exec,
+                      char *const arguments[]) {
+    char    *argline    = mace_args2line(arguments);
+    pid_t    pid;
+
+    /* Child must not write trace buffer again */
+    if (trace_file != NULL)
+        fflush(trace_file);
+    pid = fork();
+    if (pid < 0) {
+        fprintf(stderr, "forking issue\n");
+        assert(0);
+        exit(1);
+    } else if (pid == 0) {
+        char *bashargs[4];
+        bashargs[0] =  "/bin/bash";
+        bashargs[1] =  "-c";
+        bashargs[2] =  argline;
+        bashargs[3] =  NULL;
+        mace_exec_print(bashargs, 3);
+        execvp("/bin/bash", bashargs);
+        exit(0);
+    }
+    stats.processes++;
+    MACE_FREE(argline);
+    return (pid);
+}
+
+/*  Execute command in a different fork */
+/*         with execvp. */
+pid_t mace_exec(const char *exec,
+                char *const arguments[]) {
+    pid_t pid;
+
+    /* Child must not write trace buffer again */
+    if (trace_file != NULL)
+        fflush(trace_file);
+    pid = fork();
+    if (pid < 0) {
+        fprintf(stderr, "forking issue.\n");
+        assert(0);
+        exit(1);
+    } else if (pid == 0) {
+        execvp(exec, arguments);
+        exit(0);
+    }
+    stats.processes++;
+    return (pid);
+}
+
+/*  Wait on process with pid to finish */
+void mace_wait_pid(int pid) {
+    int     i;
+    int     status;
+    pid_t   waited;
+    struct rusage usage;
+
+    /* Process takes a slot while mace waits */
+    mace_util_tick();
+    util.serial = 1;
+    /* Queued processes done meanwhile reaped: */
+    /* tokens back to jobserver, e.g. for make */
+    while (true) {
+        waited = wait4(-1, &status, 0, &usage);
+        if ((waited < 0) && (errno == EINTR))
+            continue;
+        if ((waited < 0) || (waited == pid))
+            break;
+        for (i = 0; i < plen; i++) {
+            if (pqueue[i].pid == waited) {
+                mace_pqueue_reap(i, status, &usage);
+                break;
+            }
+        }
+    }
+    mace_util_tick();
+    util.serial = 0;
+
+    if (waited > 0) {
+        mace_pid_status(status);
+    }
+}
+
+/*  Exit if finished process failed. */
+void mace_pid_status(int status) {
+    if (WIFEXITED(status) && !WEXITSTATUS(status)) {
+        /* pass */
+    } else if (WIFSIGNALED(status)) {
+        fprintf(stderr, "Fork killed by signal %d.\n", WTERMSIG(status));
+        exit(128 + WTERMSIG(status));
+    } else if (WIFEXITED(status) &&  WEXITSTATUS(status)) {
+        if (WEXITSTATUS(status) == 127) {
+            /* execvp failed */
+            fprintf(stderr, "execvp failed.\n");
+            exit(WEXITSTATUS(status));
+        } else {
+            fprintf(stderr, "Fork returned a non-zero status.\n");
+            exit(WEXITSTATUS(status));
+        }
+    } else {
+        fprintf(stderr, "is baka? %d\n", WEXITSTATUS(status));
+        fprintf(stderr, "Fork didn't terminate normally. %d\n", WEXITSTATUS(status));
+        exit(WEXITSTATUS(status));
+    }
+}
+
+/******************* mace_build ********************/
+/*  Path of target's linked output. */
+char *mace_Target_output(const Target *target) {
+    if (target->kind == MACE_EXECUTABLE)
+        return (mace_executable_path(target->private._name));
+    return (mace_library_path(target->private._name, target->kind));
+}
+
+/*  Why target must be linked: MACE_REASON. */
+/*      - NONE if skipped: no object compiled, */
+/*        same link command, no linked target */
+/*        relinked, output newer than objects, */
+/*        linked targets: same second is out */
+/*        of date */
+/*      - linked: order of newer linked target */
+int mace_Target_link_reason(const Target *target, int *linked) {
+    int          i;
+    int          argc_objects;
+    size_t       d;
+    char        *out;
+    char       **argv_objects;
+    struct stat  st;
+    int          reason = MACE_REASON_NONE;
+
+    *linked = -1;
+    if (build_all)
+        return (MACE_REASON_BUILD_ALL);
+    if (target->allatonce)
+        return (MACE_REASON_ALLATONCE);
+    if (target->private._compile_num > 0)
+        return (MACE_REASON_COMPILED);
+
+    out = mace_Target_output(target);
+    if (stat(out, &st) != 0) {
+        MACE_FREE(out);
+        return (MACE_REASON_OUTPUT);
+    }
+    if ((target->kind == MACE_STATIC_LIBRARY) &&
+        (mace_ar_thin(out) != (target->thin != false))) {
+        MACE_FREE(out);
+        return (MACE_REASON_THIN);
+    }
+    MACE_FREE(out);
+    if (mace_Target_Link_Changed(target))
+        return (MACE_REASON_LINK_FLAGS);
+
+    /* -- Objects -- */
+    argv_objects = mace_Target_link_objects(target, &argc_objects);
+    for (i = 0; i < argc_objects; i++) {
+        struct stat obj;
+        if ((stat(argv_objects[i] + strlen("-o"), &obj) != 0) ||
+            (obj.st_mtime >= st.st_mtime))
+            return (MACE_REASON_NEWER);
+    }
+
+    /* -- Linked targets -- */
+    for (d = 0; (d < target->private._deps_links_num) && (reason == MACE_REASON_NONE); d++) {
+        struct stat  dep;
+        char        *dep_out;
+        int          order = mace_target_order(target->private._deps_links[d]);
+        /* Skip libraries that are not targets */
+        if ((order < 0) || (targets[order].kind == MACE_PHONY))
+            continue;
+        /* Object library: its objects newer */
+        if (targets[order].kind == MACE_OBJECT_LIBRARY) {
+            int    argc_deps;
+            char **argv_deps = mace_Target_link_objects(&targets[order], &argc_deps);
+            for (i = 0; i < argc_deps; i++) {
+                if ((stat(argv_deps[i] + strlen("-o"), &dep) != 0) ||
+                    (dep.st_mtime >= st.st_mtime))
+                    break;
+            }
+            if (targets[order].private._relinked || (i < argc_deps)) {
+                reason  = MACE_REASON_LINKED;
+                *linked = order;
+            }
+            continue;
+        }
+        dep_out = mace_Target_output(&targets[order]);
+        if (targets[order].private._relinked ||
+            ((stat(dep_out, &dep) == 0) && (dep.st_mtime >= st.st_mtime))) {
+            reason  = MACE_REASON_LINKED;
+            *linked = order;
+        }
+        MACE_FREE(dep_out);
+    }
+    return (reason);
+}
+
+/*  Fingerprint of target's link command: */
+/*         objects, links, flags, config. */
+u32 mace_Target_link_fingerprint(const Target *target) {
+    int      i;
+    int      argc_objects;
+    int      argc       = 0;
+    int      arg_len    = 8;
+    char   **argv_objects;
+    char   **argv;
+    u64      hash;
+
+    hash = mace_hash((target->kind == MACE_STATIC_LIBRARY) ? ar : cc);
+    hash = (hash * 33ul) ^ (u64)target->kind;
+
+    /* -- Objects, links with object libraries' -- */
+    argv_objects = mace_Target_link_objects(target, &argc_objects);
+    for (i = 0; i < argc_objects; i++)
+        hash = (hash * 33ul) ^ mace_hash(argv_objects[i]);
+    argv = calloc(arg_len, sizeof(*argv));
+    MACE_MEMCHECK(argv);
+    mace_argv_add_links(target, &argv, &argc, &arg_len);
+    for (i = 0; i < argc; i++)
+        hash = (hash * 33ul) ^ mace_hash(argv[i]);
+    MACE_FREE(argv);
+
+    /* -- Flags -- */
+    for (i = 0; i < target->private._argc_link_flags; i++)
+        hash = (hash * 33ul) ^ mace_hash(target->private._argv_link_flags[i]);
+    for (i = 0; i < target->private._argc_flags; i++)
+        hash = (hash * 33ul) ^ mace_hash(target->private._argv_flags[i]);
+
+    /* -- Config -- */
+    for (i = 0; (config_num > 0) && (i < configs[mace_config].private._flag_num); i++)
+        hash = (hash * 33ul) ^ mace_hash(configs[mace_config].private._flags[i]);
+    if ((config_num > 0) && (configs[mace_config].linker != NULL))
+        hash = (hash * 33ul) ^ mace_hash(configs[mace_config].linker);
+    if (mace_lto())
+        hash = (hash * 33ul) ^ mace_hash("-flto");
+    return ((u32)(hash ^ (hash >> 32)));
+}
+
+/*  Path of target's link command fingerprint: */
+/*         <cwd>/<obj_dir>/<target>.link */
+char *mace_Target_link_path(const Target *target) {
+    char *path = calloc(strlen(cwd) + strlen(obj_dir) +
+                        strlen(target->private._name) + 8, sizeof(*path));
+    MACE_MEMCHECK(path);
+    sprintf(path, "%s/%s/%s.link", cwd, obj_dir, target->private._name);
+    return (path);
+}
+
+/*  Check if link command changed since target */
+/*         last linked. */
+/*      - Changed if no .link file */
+b32 mace_Target_Link_Changed(const Target *target) {
+    u32      previous;
+    char    *path;
+    FILE    *fp;
+    b32      changed = true;
+
+    path = mace_Target_link_path(target);
+    fp   = fopen(path, "rb");
+    if (fp != NULL) {
+        if (fread(&previous, sizeof(previous), 1, fp) == 1)
+            changed = (previous != target->private._link_fingerprint);
+        fclose(fp);
+    }
+    MACE_FREE(path);
+    return (changed);
+}
+
+/*  Save link command fingerprint of target, */
+/*         after it linked. */
+void mace_Target_Link_Write(const Target *target) {
+    char    *path;
+    FILE    *fp;
+
+    MACE_EARLY_RET(!dry_run, MACE_VOID, MACE_nASSERT);
+
+    path = mace_Target_link_path(target);
+    fp   = fopen(path, "wb");
+    if (fp != NULL) {
+        fwrite(&target->private._link_fingerprint,
+               sizeof(target->private._link_fingerprint), 1, fp);
+        fclose(fp);
+    }
+    MACE_FREE(path);
+}
+
+/*  Objects linked into target, in argv form. */
+/*      - Unity targets link their chunks */
+char **mace_Target_link_objects(const Target *target, int *argc) {
+    if (target->unity > 0) {
+        *argc = target->private._unity_num;
+        return (target->private._unity_objects);
+    }
+    *argc = target->private._argc_sources;
+    return (target->private._argv_objects);
+}
+
+/*  Add links of target to link command. */
+/*      - Object libraries: their objects, then */
+/*        their own links */
+/*      - Objects of object library added once: */
+/*        diamonds, cycles of links */
+void mace_argv_add_links(const Target *target, char ***argv,
+                         int *argc, int *arg_len) {
+    b32 *visited = calloc(target_num, sizeof(*visited));
+    MACE_MEMCHECK(visited);
+    mace_argv_add_links_visit(target, argv, argc, arg_len, visited);
+    MACE_FREE(visited);
+}
+
+/*  Add links of target to link command. */
+/*      - visited: [target order] objects added */
+void mace_argv_add_links_visit(const Target *target, char ***argv,
+                               int *argc, int *arg_len, b32 *visited) {
+    int i;
+    int j;
+
+    for (i = 0; i < target->private._argc_links; i++) {
+        char  *link  = target->private._argv_links[i];
+        int    order = mace_target_order(mace_hash(link + strlen("-l")));
+        int    argc_objects;
+        char **argv_objects;
+
+        if ((order < 0) || (targets[order].kind != MACE_OBJECT_LIBRARY) ||
+            (&targets[order] == target)) {
+            *argv = mace_argv_grow(*argv, argc, arg_len);
+            (*argv)[(*argc)++] = link;
+            continue;
+        }
+        if (visited[order])
+            continue;
+        visited[order] = true;
+        argv_objects = mace_Target_link_objects(&targets[order], &argc_objects);
+        for (j = 0; j < argc_objects; j++) {
+            *argv = mace_argv_grow(*argv, argc, arg_len);
+            (*argv)[(*argc)++] = argv_objects[j] + strlen("-o");
+        }
+        mace_argv_add_links_visit(&targets[order], argv, argc, arg_len, visited);
+    }
+}
+
+void mace_link_dynamic_library(Target *target) {
+    int      i;
     int      libc;
     int      cfPICflag;
     int      config_endc;
@@ -4605,13 +8327,13 @@ void mace_link_dynamic_library(Target *target) {
     size_t   lib_len;
     size_t   oflag_len;
 
-    int       argc_objects  = target->private._argc_sources;
+    int       argc_objects;
     int       arg_len       = 8;
     int       argc          = 0;
     char     *lib   = mace_library_path(target->private._name,
                                         MACE_DYNAMIC_LIBRARY);
     char    **argv  = calloc(arg_len, sizeof(*argv));
-    char    **argv_objects = target->private._argv_objects;
+    char    **argv_objects = mace_Target_link_objects(target, &argc_objects);
 
     if (!silent)
         printf("Linking  %s\n", lib);
@@ -4653,134 +8375,898 @@ void mace_link_dynamic_library(Target *target) {
     }
 
     /* -- argv links -- */
-    if ((target->private._argc_links > 0) && (target->private._argv_links != NULL)) {
+    mace_argv_add_links(target, &argv, &argc, &arg_len);
+
+    /* -- argv link_flags -- */
+    if ((target->private._argc_link_flags > 0) && (target->private._argv_link_flags != NULL)) {
+        int i;
+        for (i = 0; i < target->private._argc_link_flags; i++) {
+            argv = mace_argv_grow(argv, &argc, &arg_len);
+            argv[argc++] = target->private._argv_link_flags[i];
+        }
+    }
+
+    /* -- argv flags -- */
+    if ((target->private._argc_flags > 0) && (target->private._argv_flags != NULL)) {
         int i;
+        for (i = 0; i < target->private._argc_flags; i++) {
+            argv = mace_argv_grow(argv, &argc, &arg_len);
+            argv[argc++] = target->private._argv_flags[i];
+        }
+    }
+
+    /* --- argv config --- */
+    config_startc   = argc;
+    mace_argv_add_config(target, &argv, &argc, &arg_len);
+    mace_argv_add_linker(&argv, &argc, &arg_len, false);
+    mace_argv_add_lto(&argv, &argc, &arg_len, true);
+    config_endc     = argc;
+
+    /* --- Actual linking --- */
+    mace_exec_print(argv, argc);
+    if (!dry_run) {
+        pid_t pid = mace_exec_wbash(argv[0], argv);
+        mace_pqueue_put(pid, target, MACE_PROCESS_LINK, 0,
+                        target->private._link_pool, 0);
+    }
+
+    MACE_FREE(argv[cfPICflag]);
+    MACE_FREE(argv[csharedflag]);
+    MACE_FREE(argv[libc]);
+    for (i = config_startc; i < config_endc; i++) {
+        MACE_FREE(argv[i]);
+    }
+    MACE_FREE(argv);
+    MACE_FREE(lib);
+}
+
+void mace_link_static_library(Target *target) {
+    int      i;
+    int      libc;
+    int      crcsflag;
+    char    *libv;
+    char    *buffer;
+    char    *token;
+    char    *rcsflag;
+    size_t   lib_len;
+
+    int       argc          = 0;
+    int       arg_len       = 8;
+    int       argc_ar       = 0;
+    int       argc_objects;
+    char     *lib = mace_library_path(target->private._name, MACE_STATIC_LIBRARY);
+    char    **argv_objects  = mace_Target_link_objects(target, &argc_objects);
+    char    **argv          = calloc(arg_len,
+                                     sizeof(*argv));
+
+    if (!silent)
+        printf("Linking  %s\n", lib);
+
+    /* --- Add ar --- */
+
+    /* -- Split ar into tokens -- */
+    /* Note: because tcc -ar is not a standalone executable but a flag 'tcc -ar' */
+    buffer = calloc(strlen(ar) + 1, sizeof(*ar));
+    strncpy(buffer, ar, strlen(ar));
+    token = strtok(buffer, mace_separator);
+    do {
+        char *flag = calloc(strlen(token) + 1, sizeof(*ar));
+        strncpy(flag, token, strlen(token));
+        argv[argc++] = flag;
+        argc_ar = argc;
+        token = strtok(NULL, mace_separator);
+    } while (token != NULL);
+
+    /* --- Adding -rcs flag, T if thin --- */
+    rcsflag = calloc(6, sizeof(*rcsflag));
+    memcpy(rcsflag, target->thin ? "-rcsT" : "-rcs", target->thin ? 5 : 4);
+    crcsflag = argc;
+    argv[argc++] = rcsflag;
+
+    /* --- Adding target --- */
+    lib_len = strlen(lib);
+    libv    = calloc(lib_len + 1, sizeof(*rcsflag));
+    strncpy(libv, lib, lib_len);
+    libc = argc;
+    argv[argc++] = libv;
+
+    /* --- Adding objects --- */
+    if ((argc_objects > 0) && (argv_objects != NULL)) {
+        for (i = 0; i < argc_objects; i++) {
+            argv = mace_argv_grow(argv, &argc, &arg_len);
+            argv[argc++] = argv_objects[i] + strlen("-o");
+        }
+    }
+
+    /* -- argv links -- */
+    if ((target->private._argc_links > 0) && (target->private._argv_links != NULL)) {
         for (i = 0; i < target->private._argc_links; i++) {
             argv = mace_argv_grow(argv, &argc, &arg_len);
             argv[argc++] = target->private._argv_links[i];
         }
     }
 
-    /* -- argv link_flags -- */
-    if ((target->private._argc_link_flags > 0) && (target->private._argv_link_flags != NULL)) {
-        int i;
-        for (i = 0; i < target->private._argc_link_flags; i++) {
-            argv = mace_argv_grow(argv, &argc, &arg_len);
-            argv[argc++] = target->private._argv_link_flags[i];
+    /* --- Actual linking --- */
+    /* Printed only if archiver runs */
+    if (strcmp(ar, MACE_AR_BUILTIN) != 0)
+        mace_exec_print(argv, argc);
+    if (!dry_run && (strcmp(ar, MACE_AR_BUILTIN) == 0) &&
+        !mace_ar_write(target, lib)) {
+        /* -- Objects not archived in-process -- */
+        MACE_FREE(argv[0]);
+        argv[0] = mace_str_buffer((strstr(cc, "clang") != NULL) ? "llvm-ar" :
+                                  (strstr(cc, "gcc") != NULL) ? "gcc-ar" :
+                                  MACE_AR_FALLBACK);
+        mace_exec_print(argv, argc);
+        mace_pqueue_put(mace_exec_wbash(argv[0], argv), target, MACE_PROCESS_LINK, 0,
+                        target->private._link_pool, 0);
+    } else if (!dry_run && (strcmp(ar, MACE_AR_BUILTIN) != 0)) {
+        pid_t pid = mace_exec_wbash(argv[0], argv);
+        mace_pqueue_put(pid, target, MACE_PROCESS_LINK, 0,
+                        target->private._link_pool, 0);
+    } else if (!dry_run) {
+        /* -- Archived in-process -- */
+        mace_Target_Link_Write(target);
+    }
+    MACE_FREE(buffer);
+    for (i = 0; i < argc_ar; ++i) {
+        MACE_FREE(argv[i]);
+    }
+    MACE_FREE(argv[crcsflag]);
+    MACE_FREE(argv[libc]);
+    MACE_FREE(argv);
+    MACE_FREE(lib);
+}
+
+/***************** mace_ar ******************/
+/*  Archive objects of target in-process. */
+/*      - Members of previous archive reused if */
+/*        their object's size, mtime unchanged, */
+/*        or same content if it recompiled */
+/*      - false if objects need external archiver */
+b32 mace_ar_write(const Target *target, const char *lib) {
+    int               i;
+    int               argc_objects;
+    char            **argv_objects;
+    char             *temp;
+    FILE             *out;
+    u64               offset;
+    u64               index_size;
+    Mace_Ar           ar        = {0};
+    Mace_Ar_Previous  previous  = {0};
+    b32               ok        = true;
+    u64               start     = mace_trace_begin();
+
+    argv_objects = mace_Target_link_objects(target, &argc_objects);
+    ar.thin      = target->thin;
+    ar.members   = calloc(argc_objects + 1, sizeof(*ar.members));
+    MACE_MEMCHECK(ar.members);
+    mace_ar_previous(&previous, lib, ar.thin);
+
+    /* --- Members: symbols reused or read --- */
+    for (i = 0; (i < argc_objects) && ok; i++) {
+        Mace_Ar_Member *member = &ar.members[ar.num++];
+        struct stat     st;
+        const char     *slash;
+        int             old;
+        size_t          len     = 0;
+        u8             *buf;
+        b32             reuse;
+
+        member->path        = argv_objects[i] + strlen("-o");
+        member->old         = -1;
+        member->long_name   = -1;
+        if (stat(member->path, &st) != 0) {
+            fprintf(stderr, "Could not archive object '%s'\n", member->path);
+            exit(1);
+        }
+        member->size    = (u64)st.st_size;
+        member->mtime   = (u64)st.st_mtime;
+        slash           = strrchr(member->path, '/');
+        member->name    = (ar.thin || (slash == NULL)) ? member->path : slash + 1;
+        mace_ar_name_add(&ar, member);
+
+        /* -- Unchanged object: symbols from index -- */
+        /* Recompiled in same second as member: */
+        /* size, mtime can match, content not */
+        buf     = NULL;
+        reuse   = false;
+        old     = mace_ar_previous_find(&previous, member->name);
+        if ((old >= 0) && (previous.members[old].size == member->size)) {
+            if (!mace_ar_recompiled(target, i)) {
+                reuse = (previous.members[old].mtime == member->mtime);
+            } else if (!ar.thin) {
+                buf   = mace_ar_file_read(member->path, &len);
+                reuse = mace_ar_previous_same(&previous, old, buf, len);
+            }
+        }
+        if (reuse) {
+            int s;
+            int first = previous.syms[old];
+            previous.used[old]  = true;
+            previous.cursor     = old;
+            member->old         = previous.members[old].old;
+            for (s = first; s < first + previous.members[old].syms_num; s++)
+                mace_ar_symbol_add(&ar, member, previous.symbols[s].name);
+            MACE_FREE(buf);
+            continue;
+        }
+
+        /* -- Changed object: symbols from ELF -- */
+        if (buf == NULL)
+            buf = mace_ar_file_read(member->path, &len);
+        ok  = (mace_ar_elf_symbols(&ar, member, buf, len) >= 0);
+        MACE_FREE(buf);
+    }
+
+    /* --- Layout: index, long names, members --- */
+    index_size  = 4 + 4 * (u64)ar.syms_num + ar.syms_len;
+    offset      = MACE_AR_MAGIC_LEN + MACE_AR_HEADER_LEN +
+                  index_size + (index_size & 1);
+    if (ar.names_len > 0)
+        offset += MACE_AR_HEADER_LEN + ar.names_len + (ar.names_len & 1);
+    for (i = 0; i < ar.num; i++) {
+        ar.members[i].header = offset;
+        offset += MACE_AR_HEADER_LEN;
+        if (!ar.thin)
+            offset += ar.members[i].size + (ar.members[i].size & 1);
+    }
+    /* Index offsets are 32 bits */
+    ok = ok && (offset <= 0xFFFFFFFFul);
+    if (!ok) {
+        mace_ar_previous_free(&previous);
+        mace_ar_free(&ar);
+        mace_trace_end("archive", target->private._name, start);
+        return (false);
+    }
+
+    /* --- Write to temporary file, renamed --- */
+    temp = calloc(strlen(lib) + 5, sizeof(*temp));
+    MACE_MEMCHECK(temp);
+    sprintf(temp, "%s.tmp", lib);
+    out = fopen(temp, "wb");
+    if (out == NULL) {
+        fprintf(stderr, "Could not write archive '%s'\n", temp);
+        exit(1);
+    }
+    fwrite(ar.thin ? MACE_AR_THIN : MACE_AR_MAGIC, 1, MACE_AR_MAGIC_LEN, out);
+
+    /* -- Symbol index: big-endian offsets of members -- */
+    mace_ar_header(out, "/", 0, 0, index_size);
+    mace_ar_be32(out, (u32)ar.syms_num);
+    for (i = 0; i < ar.num; i++) {
+        int s;
+        for (s = 0; s < ar.members[i].syms_num; s++)
+            mace_ar_be32(out, (u32)ar.members[i].header);
+    }
+    fwrite(ar.syms, 1, ar.syms_len, out);
+    if (index_size & 1)
+        fputc('\n', out);
+
+    /* -- Long names: "name/\n" -- */
+    if (ar.names_len > 0) {
+        mace_ar_header(out, "//", 0, 0, ar.names_len);
+        fwrite(ar.names, 1, ar.names_len, out);
+        if (ar.names_len & 1)
+            fputc('\n', out);
+    }
+
+    /* -- Members: from previous archive or objects -- */
+    for (i = 0; i < ar.num; i++) {
+        Mace_Ar_Member *member = &ar.members[i];
+        /* Room for "/<offset>" of any long name */
+        char            name[MACE_AR_NAME_LEN + 24];
+        FILE           *in;
+
+        if (member->long_name >= 0)
+            sprintf(name, "/%ld", (long)member->long_name);
+        else
+            sprintf(name, "%s/", member->name);
+        mace_ar_header(out, name, member->mtime, 0644, member->size);
+        if (ar.thin)
+            continue;
+
+        if (member->old >= 0) {
+            fseek(previous.file, (long)member->old, SEEK_SET);
+            mace_ar_copy(out, previous.file, member->size, lib);
+        } else {
+            in = fopen(member->path, "rb");
+            if (in == NULL) {
+                fprintf(stderr, "Could not archive object '%s'\n", member->path);
+                exit(1);
+            }
+            mace_ar_copy(out, in, member->size, member->path);
+            fclose(in);
+        }
+        if (member->size & 1)
+            fputc('\n', out);
+    }
+
+    if (fclose(out) != 0) {
+        fprintf(stderr, "Could not write archive '%s'\n", temp);
+        exit(1);
+    }
+    if (rename(temp, lib) != 0) {
+        fprintf(stderr, "Could not rename '%s' to '%s'\n", temp, lib);
+        exit(1);
+    }
+    MACE_FREE(temp);
+    mace_ar_previous_free(&previous);
+    mace_ar_free(&ar);
+    mace_trace_end("archive", target->private._name, start);
+    return (true);
+}
+
+/*  Read members, symbol index of previous */
+/*         archive in same format. */
+/*      - false if missing, other format, corrupt */
+b32 mace_ar_previous(Mace_Ar_Previous *previous,
+                     const char *lib, b32 thin) {
+    int     i;
+    int     s;
+    char    magic[MACE_AR_MAGIC_LEN];
+    char    header[MACE_AR_HEADER_LEN];
+    char    field[13];
+    u32     count       = 0;
+    u64     index_size  = 0;
+    u64     pos         = MACE_AR_MAGIC_LEN;
+    size_t  names_size  = 0;
+    b32     ok          = true;
+
+    previous->cursor    = -1;
+    previous->file      = fopen(lib, "rb");
+    MACE_EARLY_RET(previous->file != NULL, false, MACE_nASSERT);
+    if ((fread(magic, 1, MACE_AR_MAGIC_LEN, previous->file) != MACE_AR_MAGIC_LEN) ||
+        (memcmp(magic, thin ? MACE_AR_THIN : MACE_AR_MAGIC, MACE_AR_MAGIC_LEN) != 0)) {
+        mace_ar_previous_free(previous);
+        return (false);
+    }
+
+    /* --- Headers: index, long names, members --- */
+    while (ok && (fseek(previous->file, (long)pos, SEEK_SET) == 0) &&
+           (fread(header, 1, MACE_AR_HEADER_LEN, previous->file) == MACE_AR_HEADER_LEN)) {
+        Mace_Ar_Member *member;
+        u64             size;
+        b32             data = !thin;
+
+        if (memcmp(header + 58, "`\n", 2) != 0) {
+            ok = false;
+            break;
+        }
+        memcpy(field, header + 48, 10);
+        field[10]   = '\0';
+        size        = strtoul(field, NULL, 10);
+
+        if (memcmp(header, "/ ", 2) == 0) {
+            /* -- Symbol index -- */
+            data = true;
+            MACE_FREE(previous->index);
+            previous->index = calloc(size + 1, sizeof(*previous->index));
+            MACE_MEMCHECK(previous->index);
+            ok          = (fread(previous->index, 1, size, previous->file) == size);
+            index_size  = size;
+        } else if (memcmp(header, "// ", 3) == 0) {
+            /* -- Long names: "name/\n" to "name\0\0" -- */
+            data = true;
+            names_size = size + MACE_AR_NAME_LEN;
+            MACE_FREE(previous->names);
+            previous->names = calloc(names_size, sizeof(*previous->names));
+            MACE_MEMCHECK(previous->names);
+            ok = (fread(previous->names, 1, size, previous->file) == size);
+            previous->names_len = size;
+            for (i = 0; (size_t)i < previous->names_len; i++) {
+                if (previous->names[i] != '\n')
+                    continue;
+                previous->names[i] = '\0';
+                if ((i > 0) && (previous->names[i - 1] == '/'))
+                    previous->names[i - 1] = '\0';
+            }
+        } else if ((header[0] == '/') && ((header[1] < '0') || (header[1] > '9'))) {
+            /* -- /SYM64/ index: not reused -- */
+            ok = false;
+        } else {
+            /* -- Member, name in long names or header -- */
+            if (previous->num >= previous->len) {
+                previous->len = (previous->len > 0) ? previous->len * 2 :
+                                MACE_DEFAULT_OBJECT_LEN;
+                previous->members = realloc(previous->members,
+                                            previous->len * sizeof(*previous->members));
+                MACE_MEMCHECK(previous->members);
+            }
+            member = &previous->members[previous->num++];
+            memset(member, 0, sizeof(*member));
+            memcpy(field, header + 16, 12);
+            field[12]       = '\0';
+            member->mtime   = strtoul(field, NULL, 10);
+            member->size    = size;
+            member->header  = pos;
+            member->old     = (i64)(pos + MACE_AR_HEADER_LEN);
+            if (header[0] == '/') {
+                member->long_name = (i64)strtoul(header + 1, NULL, 10);
+                ok = ((size_t)member->long_name < previous->names_len);
+            } else {
+                size_t len = 0;
+                while ((len < MACE_AR_NAME_LEN) && (header[len] != '/'))
+                    len++;
+                if (previous->names_len + len + 1 > names_size) {
+                    names_size = (names_size + len + 1) * 2;
+                    previous->names = realloc(previous->names, names_size);
+                    MACE_MEMCHECK(previous->names);
+                }
+                member->long_name = (i64)previous->names_len;
+                memcpy(previous->names + previous->names_len, header, len);
+                previous->names[previous->names_len + len] = '\0';
+                previous->names_len += len + 1;
+            }
+        }
+        pos += MACE_AR_HEADER_LEN + (data ? size + (size & 1) : 0);
+    }
+
+    /* --- Symbols of index, by member --- */
+    if (ok && (previous->index != NULL) && (index_size >= 4)) {
+        const char *name;
+        const char *end = previous->index + index_size;
+        count   = (u32)mace_ar_elf_read((const u8 *)previous->index, 4, true);
+        ok      = (4 + 4 * (u64)count <= index_size);
+        name    = previous->index + 4 + 4 * (u64)count;
+        previous->symbols = calloc(count + 1, sizeof(*previous->symbols));
+        MACE_MEMCHECK(previous->symbols);
+        for (s = 0; ok && ((u32)s < count); s++) {
+            const u8 *at = (const u8 *)previous->index + 4 + 4 * s;
+            ok = (name < end);
+            previous->symbols[s].header = mace_ar_elf_read(at, 4, true);
+            previous->symbols[s].name   = name;
+            previous->symbols[s].order  = s;
+            name += strlen(name) + 1;
+        }
+        previous->symbols_num = s;
+    } else {
+        /* No index: symbols unknown */
+        ok = false;
+    }
+    if (!ok) {
+        mace_ar_previous_free(previous);
+        return (false);
+    }
+    qsort(previous->symbols, previous->symbols_num,
+          sizeof(*previous->symbols), mace_ar_symbol_cmp);
+
+    previous->syms = calloc(previous->num + 1, sizeof(*previous->syms));
+    MACE_MEMCHECK(previous->syms);
+    previous->used = calloc(previous->num + 1, sizeof(*previous->used));
+    MACE_MEMCHECK(previous->used);
+    s = 0;
+    for (i = 0; i < previous->num; i++) {
+        Mace_Ar_Member *member = &previous->members[i];
+        member->name = previous->names + member->long_name;
+        while ((s < previous->symbols_num) &&
+               (previous->symbols[s].header < member->header))
+            s++;
+        previous->syms[i] = s;
+        while ((s < previous->symbols_num) &&
+               (previous->symbols[s].header == member->header)) {
+            member->syms_num++;
+            s++;
+        }
+    }
+    return (true);
+}
+
+void mace_ar_previous_free(Mace_Ar_Previous *previous) {
+    if (previous->file != NULL)
+        fclose(previous->file);
+    MACE_FREE(previous->members);
+    MACE_FREE(previous->syms);
+    MACE_FREE(previous->used);
+    MACE_FREE(previous->symbols);
+    MACE_FREE(previous->index);
+    MACE_FREE(previous->names);
+    memset(previous, 0, sizeof(*previous));
+    previous->cursor = -1;
+}
+
+/*  Find unused member of previous archive by */
+/*         name, from last found: same order. */
+int mace_ar_previous_find(Mace_Ar_Previous *previous,
+                          const char *name) {
+    int i;
+
+    for (i = 1; i <= previous->num; i++) {
+        int m = (previous->cursor + i) % previous->num;
+        if (!previous->used[m] &&
+            (strcmp(previous->members[m].name, name) == 0))
+            return (m);
+    }
+    return (-1);
+}
+
+/*  Check if member of previous archive has */
+/*         same content as object in buf. */
+b32 mace_ar_previous_same(Mace_Ar_Previous *previous, int old,
+                          const u8 *buf, size_t len) {
+    u8      chunk[BUFSIZ];
+    size_t  done = 0;
+
+    if ((buf == NULL) || (previous->members[old].size != (u64)len) ||
+        (fseek(previous->file, (long)previous->members[old].old, SEEK_SET) != 0))
+        return (false);
+    while (done < len) {
+        size_t size = (len - done < sizeof(chunk)) ? len - done : sizeof(chunk);
+        if ((fread(chunk, 1, size, previous->file) != size) ||
+            (memcmp(chunk, buf + done, size) != 0))
+            return (false);
+        done += size;
+    }
+    return (true);
+}
+
+/*  Check if object i of target, in link */
+/*         objects order, compiled this build. */
+/*      - Unity chunk: any of its sources */
+b32 mace_ar_recompiled(const Target *target, int i) {
+    int src;
+
+    if (build_all)
+        return (true);
+    if (target->unity <= 0)
+        return (target->private._recompiles[i]);
+    for (src = 0; src < target->private._argc_sources; src++) {
+        if ((target->private._unity_chunk[src] == i) &&
+            target->private._recompiles[src])
+            return (true);
+    }
+    return (false);
+}
+
+/*  Sort symbols by member, then index order. */
+int mace_ar_symbol_cmp(const void *a, const void *b) {
+    const Mace_Ar_Symbol *sa = a;
+    const Mace_Ar_Symbol *sb = b;
+
+    if (sa->header != sb->header)
+        return ((sa->header < sb->header) ? -1 : 1);
+    return (sa->order - sb->order);
+}
+
+void mace_ar_symbol_add(Mace_Ar *ar, Mace_Ar_Member *member,
+                        const char *name) {
+    size_t len = strlen(name) + 1;
+
+    if (ar->syms_len + len > ar->syms_size) {
+        ar->syms_size = (ar->syms_size + len) * 2;
+        ar->syms = realloc(ar->syms, ar->syms_size);
+        MACE_MEMCHECK(ar->syms);
+    }
+    memcpy(ar->syms + ar->syms_len, name, len);
+    ar->syms_len += len;
+    ar->syms_num++;
+    member->syms_num++;
+}
+
+/*  Add name of member to long names table, */
+/*         if not short: "name/" in header. */
+void mace_ar_name_add(Mace_Ar *ar, Mace_Ar_Member *member) {
+    size_t len = strlen(member->name);
+
+    if (!ar->thin && (len < MACE_AR_NAME_LEN) &&
+        (strchr(member->name, '/') == NULL) &&
+        (strchr(member->name, ' ') == NULL))
+        return;
+
+    if (ar->names_len + len + 2 > ar->names_size) {
+        ar->names_size = (ar->names_size + len + 2) * 2;
+        ar->names = realloc(ar->names, ar->names_size);
+        MACE_MEMCHECK(ar->names);
+    }
+    member->long_name = (i64)ar->names_len;
+    memcpy(ar->names + ar->names_len, member->name, len);
+    memcpy(ar->names + ar->names_len + len, "/\n", 2);
+    ar->names_len += len + 2;
+}
+
+/*  Add global symbols defined in ELF object. */
+/*      - -1 if object needs external archiver: */
+/*        not ELF, malformed, GCC LTO sections, */
+/*        LLVM bitcode */
+int mace_ar_elf_symbols(Mace_Ar *ar, Mace_Ar_Member *member,
+                        const u8 *buf, size_t len) {
+    u64 i;
+    u64 j;
+    u64 shoff;
+    u64 shentsize;
+    u64 shnum;
+    u64 shstrndx;
+    b32 wide;
+    b32 big;
+    int num = 0;
+
+    /* -- LLVM bitcode, raw or wrapped -- */
+    if ((len >= 4) && ((memcmp(buf, "BC\xC0\xDE", 4) == 0) ||
+                       (memcmp(buf, "\xDE\xC0\x17\x0B", 4) == 0)))
+        return (-1);
+    if ((len < 64) || (memcmp(buf, "\177ELF", 4) != 0))
+        return (-1);
+
+    wide        = (buf[4] == 2);
+    big         = (buf[5] == 2);
+    shoff       = mace_ar_elf_read(buf + (wide ? 0x28 : 0x20), wide ? 8 : 4, big);
+    shentsize   = mace_ar_elf_read(buf + (wide ? 0x3A : 0x2E), 2, big);
+    shnum       = mace_ar_elf_read(buf + (wide ? 0x3C : 0x30), 2, big);
+    shstrndx    = mace_ar_elf_read(buf + (wide ? 0x3E : 0x32), 2, big);
+    if ((shoff == 0) || (shoff >= len) ||
+        (shentsize < (wide ? 64u : 40u)) || (len - shoff < shentsize))
+        return (-1);
+    /* Extended numbering: in section 0 */
+    if (shnum == 0)
+        shnum = mace_ar_elf_read(buf + shoff + (wide ? 32 : 20), wide ? 8 : 4, big);
+    if (shstrndx == 0xFFFF)
+        shstrndx = mace_ar_elf_read(buf + shoff + (wide ? 40 : 24), 4, big);
+    if (shnum > (len - shoff) / shentsize)
+        return (-1);
+
+#define MACE_ELF_SH(k, field64, field32, size64) \
+    mace_ar_elf_read(buf + shoff + (k) * shentsize + (wide ? (field64) : (field32)), \
+                     wide ? (size64) : 4, big)
+
+    /* -- GCC LTO: symbols in sections, not symtab -- */
+    if (shstrndx < shnum) {
+        u64 str_off  = MACE_ELF_SH(shstrndx, 24, 16, 8);
+        u64 str_size = MACE_ELF_SH(shstrndx, 32, 20, 8);
+        if ((str_off <= len) && (str_size <= len - str_off)) {
+            for (i = 0; i < shnum; i++) {
+                u64 name = MACE_ELF_SH(i, 0, 0, 4);
+                if ((name < str_size) && (str_size - name >= 9) &&
+                    (memcmp(buf + str_off + name, ".gnu.lto_", 9) == 0))
+                    return (-1);
+            }
         }
     }
 
-    /* -- argv flags -- */
-    if ((target->private._argc_flags > 0) && (target->private._argv_flags != NULL)) {
-        int i;
-        for (i = 0; i < target->private._argc_flags; i++) {
-            argv = mace_argv_grow(argv, &argc, &arg_len);
-            argv[argc++] = target->private._argv_flags[i];
+    /* -- Global, weak symbols defined in symtabs -- */
+    for (i = 0; i < shnum; i++) {
+        u64 sym_off, sym_size, sym_ent, link, str_off, str_size;
+        if (MACE_ELF_SH(i, 4, 4, 4) != 2) /* SHT_SYMTAB */
+            continue;
+        sym_off     = MACE_ELF_SH(i, 24, 16, 8);
+        sym_size    = MACE_ELF_SH(i, 32, 20, 8);
+        sym_ent     = MACE_ELF_SH(i, 56, 36, 8);
+        link        = MACE_ELF_SH(i, 40, 24, 4);
+        if ((link >= shnum) || (sym_ent < (wide ? 24u : 16u)) ||
+            (sym_off > len) || (sym_size > len - sym_off))
+            continue;
+        str_off     = MACE_ELF_SH(link, 24, 16, 8);
+        str_size    = MACE_ELF_SH(link, 32, 20, 8);
+        if ((str_off > len) || (str_size > len - str_off))
+            continue;
+
+        for (j = 1; j < sym_size / sym_ent; j++) {
+            const u8 *sym   = buf + sym_off + j * sym_ent;
+            u64       name  = mace_ar_elf_read(sym, 4, big);
+            u8        info  = wide ? sym[4] : sym[12];
+            u64       shndx = mace_ar_elf_read(sym + (wide ? 6 : 14), 2, big);
+            int       bind  = info >> 4;
+            /* STB_GLOBAL, STB_WEAK, STB_GNU_UNIQUE */
+            if (((bind != 1) && (bind != 2) && (bind != 10)) || (shndx == 0))
+                continue;
+            if ((name >= str_size) ||
+                (memchr(buf + str_off + name, '\0', str_size - name) == NULL))
+                continue;
+            mace_ar_symbol_add(ar, member, (const char *)(buf + str_off + name));
+            num++;
         }
     }
+#undef MACE_ELF_SH
+    return (num);
+}
 
-    /* --- argv config --- */
-    config_startc   = argc;
-    mace_argv_add_config(target, &argv, &argc, &arg_len);
-    config_endc     = argc;
+/*  Read unsigned integer of bytes, endianness. */
+u64 mace_ar_elf_read(const u8 *p, int bytes, b32 big) {
+    int i;
+    u64 out = 0;
 
-    /* --- Actual linking --- */
-    mace_exec_print(argv, argc);
-    if (!dry_run) {
-        pid_t pid = mace_exec_wbash(argv[0], argv);
-        mace_wait_pid(pid);
-    }
+    for (i = 0; i < bytes; i++)
+        out |= (u64)p[big ? (bytes - 1 - i) : i] << (8 * i);
+    return (out);
+}
 
-    MACE_FREE(argv[cfPICflag]);
-    MACE_FREE(argv[csharedflag]);
-    MACE_FREE(argv[libc]);
-    for (i = config_startc; i < config_endc; i++) {
-        MACE_FREE(argv[i]);
-    }
-    MACE_FREE(argv);
-    MACE_FREE(lib);
+void mace_ar_be32(FILE *file, u32 value) {
+    u8 be[4];
+
+    be[0] = (u8)(value >> 24);
+    be[1] = (u8)(value >> 16);
+    be[2] = (u8)(value >> 8);
+    be[3] = (u8)value;
+    fwrite(be, 1, 4, file);
 }
 
-void mace_link_static_library(Target *target) {
-    int      i;
-    int      libc;
-    int      crcsflag;
-    char    *libv;
-    char    *buffer;
-    char    *token;
-    char    *rcsflag;
-    size_t   lib_len;
+/*  Write 60 bytes header of member. */
+/*  Write member header, fields fit their width. */
+/*      - Sizes above 4GiB archived by fallback */
+void mace_ar_header(FILE *file, const char *name,
+                    u64 mtime, int mode, u64 size) {
+    /* Room for widest values of all fields */
+    char header[MACE_AR_HEADER_LEN + 64];
 
-    int       argc          = 0;
-    int       arg_len       = 8;
-    int       argc_ar       = 0;
-    int       argc_objects  = target->private._argc_sources;
-    char     *lib = mace_library_path(target->private._name, MACE_STATIC_LIBRARY);
-    char    **argv_objects  = target->private._argv_objects;
-    char    **argv          = calloc(arg_len,
-                                     sizeof(*argv));
+    if (mtime > 999999999999ul)
+        mtime = 0;
+    mode &= 07777777;
+    assert(size <= 9999999999ul);
+    sprintf(header, "%-16.16s%-12lu%-6d%-6d%-8o%-10lu`\n",
+            name, (unsigned long)mtime, 0, 0, mode, (unsigned long)size);
+    fwrite(header, 1, MACE_AR_HEADER_LEN, file);
+}
 
-    if (!silent)
-        printf("Linking  %s\n", lib);
+void mace_ar_copy(FILE *out, FILE *in, u64 size, const char *path) {
+    static char buffer[MACE_AR_COPY];
 
-    /* --- Add ar --- */
+    while (size > 0) {
+        size_t chunk = (size > MACE_AR_COPY) ? MACE_AR_COPY : (size_t)size;
+        if (fread(buffer, 1, chunk, in) != chunk) {
+            fprintf(stderr, "Could not read '%s'\n", path);
+            exit(1);
+        }
+        fwrite(buffer, 1, chunk, out);
+        size -= chunk;
+    }
+}
 
-    /* -- Split ar into tokens -- */
-    /* Note: because tcc -ar is not a standalone executable but a flag 'tcc -ar' */
-    buffer = calloc(strlen(ar) + 1, sizeof(*ar));
-    strncpy(buffer, ar, strlen(ar));
-    token = strtok(buffer, mace_separator);
-    do {
-        char *flag = calloc(strlen(token) + 1, sizeof(*ar));
-        strncpy(flag, token, strlen(token));
-        argv[argc++] = flag;
-        argc_ar = argc;
-        token = strtok(NULL, mace_separator);
-    } while (token != NULL);
+u8 *mace_ar_file_read(const char *path, size_t *len) {
+    long  size;
+    u8   *buf;
+    FILE *file = fopen(path, "rb");
 
-    /* --- Adding -rcs flag --- */
-    rcsflag = calloc(5, sizeof(*rcsflag));
-    memcpy(rcsflag, "-rcs", 4);
-    crcsflag = argc;
-    argv[argc++] = rcsflag;
+    if (file == NULL) {
+        fprintf(stderr, "Could not read object '%s'\n", path);
+        exit(1);
+    }
+    fseek(file, 0L, SEEK_END);
+    size = ftell(file);
+    fseek(file, 0L, SEEK_SET);
+    buf = calloc(size + 1, sizeof(*buf));
+    MACE_MEMCHECK(buf);
+    *len = fread(buf, 1, size, file);
+    fclose(file);
+    return (buf);
+}
 
-    /* --- Adding target --- */
-    lib_len = strlen(lib);
-    libv    = calloc(lib_len + 1, sizeof(*rcsflag));
-    strncpy(libv, lib, lib_len);
-    libc = argc;
-    argv[argc++] = libv;
+/*  Is archive thin: members refer to objects. */
+b32 mace_ar_thin(const char *lib) {
+    char  magic[MACE_AR_MAGIC_LEN];
+    b32   thin = false;
+    FILE *file = fopen(lib, "rb");
 
-    /* --- Adding objects --- */
-    if ((argc_objects > 0) && (argv_objects != NULL)) {
-        for (i = 0; i < argc_objects; i++) {
-            argv = mace_argv_grow(argv, &argc, &arg_len);
-            argv[argc++] = argv_objects[i] + strlen("-o");
+    MACE_EARLY_RET(file != NULL, false, MACE_nASSERT);
+    if (fread(magic, 1, MACE_AR_MAGIC_LEN, file) == MACE_AR_MAGIC_LEN)
+        thin = (memcmp(magic, MACE_AR_THIN, MACE_AR_MAGIC_LEN) == 0);
+    fclose(file);
+    return (thin);
+}
+
+void mace_ar_free(Mace_Ar *ar) {
+    MACE_FREE(ar->members);
+    MACE_FREE(ar->syms);
+    MACE_FREE(ar->names);
+}
+
+/*  Partially link objects of executable by */
+/*         source directory: one cc -r each, into */
+/*         <obj_dir>/<target>_partial<hash>.o */
+/*      - Named by hash of its objects: adding, */
+/*        removing sources changes it */
+/*      - Relinked in link pool if missing, or */
+/*        objects newer. Waited for */
+/*  @return Partial objects to link, in argv form */
+char **mace_link_partial(Target *target, int *argc) {
+    int      i;
+    int      g;
+    int      num        = target->private._argc_sources;
+    int     *group      = calloc(num > 0 ? num : 1, sizeof(*group));
+    int     *heads      = calloc(num > 0 ? num : 1, sizeof(*heads));
+    int      heads_num  = 0;
+    char   **partials;
+    char   **sources    = target->private._argv_sources;
+    char   **objects    = target->private._argv_objects;
+    size_t   len        = strlen(obj_dir) + strlen(target->private._name) + 32;
+
+    MACE_MEMCHECK(group);
+    MACE_MEMCHECK(heads);
+
+    /* -- Group sources by directory -- */
+    for (i = 0; i < num; i++) {
+        const char *slash   = strrchr(sources[i], '/');
+        size_t      dir_len = (slash != NULL) ? (size_t)(slash - sources[i]) : 0;
+        for (g = 0; g < heads_num; g++) {
+            const char *head       = sources[heads[g]];
+            const char *head_slash = strrchr(head, '/');
+            size_t      head_len   = (head_slash != NULL) ? (size_t)(head_slash - head) : 0;
+            if ((head_len == dir_len) && (strncmp(head, sources[i], dir_len) == 0))
+                break;
         }
-    }
+        if (g == heads_num)
+            heads[heads_num++] = i;
+        group[i] = g;
+    }
+
+    partials = calloc(heads_num > 0 ? heads_num : 1, sizeof(*partials));
+    MACE_MEMCHECK(partials);
+    for (g = 0; g < heads_num; g++) {
+        struct stat  st;
+        b32          dirty;
+        u64          hash = 5381ul;
+        int          argc_partial = 0;
+        int          arg_len      = 16;
+        int          config_startc;
+        int          config_endc;
+        char       **argv;
+
+        for (i = 0; i < num; i++) {
+            if (group[i] == g)
+                hash = (hash * 33ul) ^ mace_hash(objects[i] + strlen("-o"));
+        }
+        partials[g] = calloc(len, sizeof(**partials));
+        MACE_MEMCHECK(partials[g]);
+        sprintf(partials[g], "-o%s/%s_partial%08lx.o", obj_dir,
+                target->private._name, (unsigned long)((hash ^ (hash >> 32)) & 0xFFFFFFFFul));
+
+        /* -- Skip if newer than its objects -- */
+        /* Object in same second: maybe after */
+        dirty = build_all || (stat(partials[g] + strlen("-o"), &st) != 0);
+        for (i = 0; (i < num) && !dirty; i++) {
+            struct stat obj;
+            if (group[i] != g)
+                continue;
+            dirty = (stat(objects[i] + strlen("-o"), &obj) != 0) ||
+                    (obj.st_mtime >= st.st_mtime);
+        }
+        if (!dirty)
+            continue;
 
-    /* -- argv links -- */
-    if ((target->private._argc_links > 0) && (target->private._argv_links != NULL)) {
-        for (i = 0; i < target->private._argc_links; i++) {
-            argv = mace_argv_grow(argv, &argc, &arg_len);
-            argv[argc++] = target->private._argv_links[i];
+        argv = calloc(arg_len, sizeof(*argv));
+        MACE_MEMCHECK(argv);
+        argv[argc_partial++] = cc;
+        argv[argc_partial++] = "-r";
+        argv[argc_partial++] = partials[g];
+        for (i = 0; i < num; i++) {
+            if (group[i] != g)
+                continue;
+            argv = mace_argv_grow(argv, &argc_partial, &arg_len);
+            argv[argc_partial++] = objects[i] + strlen("-o");
+        }
+        /* Same target, ABI as executable: -m32, */
+        /* --sysroot, -fuse-ld */
+        for (i = 0; i < target->private._argc_flags; i++) {
+            argv = mace_argv_grow(argv, &argc_partial, &arg_len);
+            argv[argc_partial++] = target->private._argv_flags[i];
+        }
+        argv = mace_argv_grow(argv, &argc_partial, &arg_len);
+        config_startc = argc_partial;
+        mace_argv_add_config(target, &argv, &argc_partial, &arg_len);
+        mace_argv_add_linker(&argv, &argc_partial, &arg_len, true);
+        config_endc = argc_partial;
+        argv = mace_argv_grow(argv, &argc_partial, &arg_len);
+        argv[argc_partial] = NULL;
+
+        mace_exec_print(argv, argc_partial);
+        if (!dry_run) {
+            pid_t pid;
+            mace_pool_wait(target->private._link_pool, 0);
+            pid = mace_exec_wbash(argv[0], argv);
+            mace_pqueue_put(pid, target, MACE_PROCESS_LINK, g + 1,
+                            target->private._link_pool, 0);
         }
+        for (i = config_startc; i < config_endc; i++)
+            MACE_FREE(argv[i]);
+        MACE_FREE(argv);
     }
+    mace_Target_wait(target, true);
 
-    /* --- Actual linking --- */
-    mace_exec_print(argv, argc);
-    if (!dry_run) {
-        pid_t pid = mace_exec_wbash(argv[0], argv);
-        mace_wait_pid(pid);
-    }
-    MACE_FREE(buffer);
-    for (i = 0; i < argc_ar; ++i) {
-        MACE_FREE(argv[i]);
-    }
-    MACE_FREE(argv[crcsflag]);
-    MACE_FREE(argv[libc]);
-    MACE_FREE(argv);
-    MACE_FREE(lib);
+    /* -- Groups changed: their partials removed -- */
+    mace_remove_stale(target, "_partial", partials, heads_num);
+
+    MACE_FREE(group);
+    MACE_FREE(heads);
+    *argc = heads_num;
+    return (partials);
 }
 
 void mace_link_executable(Target *target) {
@@ -4796,17 +9282,22 @@ void mace_link_executable(Target *target) {
 
     int    argc         = 0;
     int    arg_len      = 16;
-    int    argc_links   = target->private._argc_links;
     int    argc_flags   = target->private._argc_flags;
-    int    argc_objects = target->private._argc_sources;
+    int    argc_objects;
     char  *exec         = mace_executable_path(target->private._name);
     char **argv         = calloc(arg_len, sizeof(*argv));
-    char **argv_links   = target->private._argv_links;
     char **argv_flags   = target->private._argv_flags;
-    char **argv_objects = target->private._argv_objects;
+    char **argv_objects = mace_Target_link_objects(target, &argc_objects);
+    char **argv_partial = NULL;
 
     if (!silent)
         printf("Linking  %s\n", exec);
+
+    /* --- Objects partially linked first --- */
+    if (target->partial && (target->unity <= 0) && !mace_lto()) {
+        argv_partial = mace_link_partial(target, &argc_objects);
+        argv_objects = argv_partial;
+    }
     argv[argc++] = cc;
 
     /* --- Adding executable output --- */
@@ -4834,12 +9325,7 @@ void mace_link_executable(Target *target) {
     }
 
     /* -- argv links -- */
-    if ((argc_links > 0) && (argv_links != NULL)) {
-        for (i = 0; i < argc_links; i++) {
-            argv = mace_argv_grow(argv, &argc, &arg_len);
-            argv[argc++] = argv_links[i];
-        }
-    }
+    mace_argv_add_links(target, &argv, &argc, &arg_len);
 
     /* -- argv link_flags -- */
     if ((target->private._argc_link_flags > 0) &&
@@ -4854,6 +9340,8 @@ void mace_link_executable(Target *target) {
     argv = mace_argv_grow(argv, &argc, &arg_len);
     config_startc = argc;
     mace_argv_add_config(target, &argv, &argc, &arg_len);
+    mace_argv_add_linker(&argv, &argc, &arg_len, false);
+    mace_argv_add_lto(&argv, &argc, &arg_len, true);
     config_endc = argc;
 
     /* -- argv -L flag for build_dir -- */
@@ -4869,7 +9357,8 @@ void mace_link_executable(Target *target) {
     mace_exec_print(argv, argc);
     if (!dry_run) {
         pid_t pid = mace_exec_wbash(argv[0], argv);
-        mace_wait_pid(pid);
+        mace_pqueue_put(pid, target, MACE_PROCESS_LINK, 0,
+                        target->private._link_pool, 0);
     }
 
     MACE_FREE(argv[oflag_i]);
@@ -4877,34 +9366,394 @@ void mace_link_executable(Target *target) {
     for (i = config_startc; i < config_endc; i++) {
         MACE_FREE(argv[i]);
     }
-    MACE_FREE(argv);
-    MACE_FREE(exec);
+    if (argv_partial != NULL) {
+        for (i = 0; i < argc_objects; i++)
+            MACE_FREE(argv_partial[i]);
+        MACE_FREE(argv_partial);
+    }
+    MACE_FREE(argv);
+    MACE_FREE(exec);
+}
+
+/*  Compile target's obj file all at once. */
+void mace_Target_compile_allatonce(Target *target) {
+    /* Compile ALL objects at once */
+    /* -- Move to obj_dir -- */
+    mace_chdir(obj_dir);
+
+    /* -- Prepare argv -- */
+    mace_Target_argv_allatonce(target);
+
+    /* -- Actual compilation -- */
+    mace_exec_print(target->private._argv, target->private._argc);
+    if (!dry_run) {
+        int   cause = mace_util_cause(MACE_IDLE_SERIAL);
+        pid_t pid   = mace_exec_wbash(target->private._argv[0], target->private._argv);
+        mace_wait_pid(pid);
+        mace_util_cause(cause);
+    }
+
+    /* -- Go back to cwd -- */
+    mace_chdir(cwd);
+}
+
+/*  Compile target's shards in parallel, */
+/*         one compiler call per shard. */
+/*      - Each call runs in shard's object */
+/*        directory, where objects are written */
+/*      - Relative paths in flags made absolute */
+void mace_Target_compile_batch(Target *target) {
+    int     i;
+    int     shard;
+    int     pool        = target->private._compile_pool;
+    int     argc_other  = target->private._argc - MACE_ARGV_OTHER;
+    b32     path        = false;
+    char  **argv_other;
+
+    MACE_EARLY_RET(target, MACE_VOID, assert);
+    MACE_EARLY_RET(target->private._argv, MACE_VOID, assert);
+
+    target->private._argv[MACE_ARGV_CC] = cc;
+
+    /* - Shard if not done in pre-build - */
+    if (target->private._compile_order == NULL) {
+        mace_Target_Schedule(target, 0, 0);
+    }
+
+    /* -- Common flags, paths from cwd -- */
+    argv_other = calloc(argc_other + 1, sizeof(*argv_other));
+    MACE_MEMCHECK(argv_other);
+    for (i = 0; i < argc_other; i++) {
+        char *flag  = target->private._argv[MACE_ARGV_OTHER + i];
+        int   pre   = path ? 0 : mace_path_flag(flag);
+        path        = (pre > 0) && (flag[pre] == '\0');
+        argv_other[i] = mace_flag_abs(flag, pre);
+    }
+
+    for (shard = 0; shard < target->private._shard_num; shard++) {
+        int      argc   = 0;
+        int      start  = target->private._shard_start[shard];
+        int      end    = target->private._shard_start[shard + 1];
+        u64      rss    = 0;
+        char   **argv   = calloc(end - start + argc_other + 2, sizeof(*argv));
+        MACE_MEMCHECK(argv);
+
+        /* -- cc, shard sources, common flags -- */
+        argv[argc++] = cc;
+        for (i = start; i < end; i++) {
+            int src = target->private._shard_sources[i];
+            argv[argc++] = target->private._argv_sources[src];
+            if ((target->private._rss != NULL) && (target->private._rss[src] > rss))
+                rss = target->private._rss[src];
+        }
+        for (i = 0; i < argc_other; i++) {
+            char *flag = target->private._argv[MACE_ARGV_OTHER + i];
+            argv[argc++] = (argv_other[i] != NULL) ? argv_other[i] : flag;
+        }
+        argv[argc] = NULL;
+
+        /* - Wait for free slot in pool, memory - */
+        mace_pool_wait(pool, rss);
+        if (!silent) {
+            for (i = start; i < end; i++)
+                printf("Compiling %s\n", argv[1 + i - start]);
+        }
+
+        /* -- Actual compilation -- */
+        mace_exec_print(argv, argc);
+        if (!dry_run) {
+            pid_t pid;
+            int   first = target->private._shard_sources[start];
+            char *dir   = mace_str_buffer(target->private._argv_objects[first] + 2);
+            *strrchr(dir, '/') = '\0';
+
+            mace_chdir(dir);
+            pid = mace_exec_wbash(argv[0], argv);
+            mace_chdir(cwd);
+            if (target->base_dir != NULL)
+                mace_chdir(target->base_dir);
+            mace_pqueue_put(pid, target, MACE_PROCESS_SHARD, shard, pool, rss);
+            MACE_FREE(dir);
+        }
+        MACE_FREE(argv);
+    }
+
+    for (i = 0; i < argc_other; i++)
+        MACE_FREE(argv_other[i]);
+    MACE_FREE(argv_other);
+}
+
+/*  Compile target's dirty unity chunks */
+/*         in parallel, longest first. */
+void mace_Target_compile_unity(Target *target) {
+    int i;
+    int shard;
+    int pool        = target->private._compile_pool;
+
+    MACE_EARLY_RET(target, MACE_VOID, assert);
+    MACE_EARLY_RET(target->private._argv, MACE_VOID, assert);
+
+    target->private._argv[MACE_ARGV_CC] = cc;
+
+    /* - Chunk if not done in pre-build - */
+    if (target->private._compile_order == NULL) {
+        mace_Target_Schedule(target, 0, 0);
+    }
+
+    for (shard = 0; shard < target->private._shard_num; shard++) {
+        int      start  = target->private._shard_start[shard];
+        int      end    = target->private._shard_start[shard + 1];
+        int      chunk  = target->private._unity_chunk[target->private._shard_sources[start]];
+        u64      rss    = 0;
+
+        /* -- Unity source, object of chunk -- */
+        target->private._argv[MACE_ARGV_SOURCE] = target->private._unity_sources[chunk];
+        target->private._argv[MACE_ARGV_OBJECT] = target->private._unity_objects[chunk];
+        for (i = start; i < end; i++) {
+            int src = target->private._shard_sources[i];
+            if ((target->private._rss != NULL) && (target->private._rss[src] > rss))
+                rss = target->private._rss[src];
+        }
+
+        /* - Wait for free slot in pool, memory - */
+        mace_pool_wait(pool, rss);
+        if (!silent)
+            printf("Compiling %s\n", target->private._unity_sources[chunk]);
+
+        /* -- Actual compilation -- */
+        mace_exec_print(target->private._argv, target->private._argc);
+        if (!dry_run) {
+            pid_t pid = mace_exec_wbash(target->private._argv[0], target->private._argv);
+            mace_pqueue_put(pid, target, MACE_PROCESS_SHARD, shard, pool, rss);
+        }
+    }
+}
+
+/*  Compile precompiled header of target, */
+/*         with the same flags as its sources. */
+/*      - cc writes its dependencies to .d */
+void mace_Target_compile_pch(Target *target) {
+    int      i;
+    int      argc   = 0;
+    int      pool   = target->private._compile_pool;
+    char    *oflag;
+    char    *depfile;
+    char   **argv;
+    size_t   len;
+
+    MACE_EARLY_RET(target != NULL, MACE_VOID, assert);
+    MACE_EARLY_RET(target->private._pch_out != NULL, MACE_VOID, assert);
+    MACE_EARLY_RET(target->private._argc_pch > 0, MACE_VOID, assert);
+
+    len     = strlen(target->private._pch_out);
+    oflag   = calloc(len + 3, sizeof(*oflag));
+    depfile = calloc(len + 3, sizeof(*depfile));
+    argv    = calloc(target->private._argc + 8, sizeof(*argv));
+    MACE_MEMCHECK(oflag);
+    MACE_MEMCHECK(depfile);
+    MACE_MEMCHECK(argv);
+    sprintf(oflag,   "-o%s", target->private._pch_out);
+    sprintf(depfile, "%s.d", target->private._pch_out);
+
+    /* -- cc, stub as header, common flags but -include -- */
+    argv[argc++] = cc;
+    argv[argc++] = "-x";
+    argv[argc++] = "c-header";
+    argv[argc++] = target->private._argv[target->private._argc_pch + 1];
+    argv[argc++] = oflag;
+    for (i = MACE_ARGV_OTHER; i < target->private._argc; i++) {
+        if (i == target->private._argc_pch) {
+            i++;
+            continue;
+        }
+        argv[argc++] = target->private._argv[i];
+    }
+    argv[argc++] = "-MMD";
+    argv[argc++] = "-MF";
+    argv[argc++] = depfile;
+    argv[argc]   = NULL;
+
+    /* - Wait for free slot in pool - */
+    mace_pool_wait(pool, 0);
+    if (!silent)
+        printf("Precompiling %s\n", target->pch);
+
+    /* -- Actual compilation -- */
+    mace_exec_print(argv, argc);
+    if (!dry_run) {
+        pid_t pid = mace_exec_wbash(argv[0], argv);
+        mace_pqueue_put(pid, target, MACE_PROCESS_PCH, 0, pool, 0);
+    }
+
+    MACE_FREE(oflag);
+    MACE_FREE(depfile);
+    MACE_FREE(argv);
+}
+
+/*  Extension of headers precompiled by cc. */
+/*  @return NULL if cc can't precompile headers */
+const char *mace_pch_ext(void) {
+    if (strstr(cc, "clang") != NULL)
+        return (".pch");
+    if (strstr(cc, "gcc") != NULL)
+        return (".gch");
+    return (NULL);
+}
+
+/*  Write stub of target's precompiled header, */
+/*         add -include stub to compile argv. */
+void mace_Target_Pch(Target *target) {
+    char        *real;
+    char        *stub;
+    char        *content;
+    size_t       len;
+    const char  *ext = mace_pch_ext();
+
+    MACE_EARLY_RET(target != NULL, MACE_VOID, assert);
+    MACE_EARLY_RET(target->pch != NULL, MACE_VOID, assert);
+
+    real = calloc(PATH_MAX, sizeof(*real));
+    MACE_MEMCHECK(real);
+    if (realpath(target->pch, real) == NULL) {
+        fprintf(stderr, "Precompiled header '%s' does not exist.\n", target->pch);
+        exit(1);
+    }
+
+    /* -- Stub: <cwd>/<obj_dir>/pch/<target>_pch.h -- */
+    /* Note: own name, else checksum of pch is shared */
+    len  = strlen(cwd) + strlen(obj_dir) + strlen(target->private._name);
+    stub = calloc(len + 16, sizeof(*stub));
+    MACE_MEMCHECK(stub);
+    sprintf(stub, "%s/%s/pch", cwd, obj_dir);
+    mace_mkdir(stub);
+    sprintf(stub + strlen(stub), "/%s_pch.h", target->private._name);
+
+    content = calloc(strlen(real) + 16, sizeof(*content));
+    MACE_MEMCHECK(content);
+    sprintf(content, "#include \"%s\"\n", real);
+    mace_write_changed(stub, content);
+    MACE_FREE(content);
+    MACE_FREE(real);
+
+    /* -- Precompiled stub, if cc can -- */
+    if (ext != NULL) {
+        len = strlen(stub);
+        target->private._pch_out = calloc(len + strlen(ext) + 1,
+                                          sizeof(*target->private._pch_out));
+        MACE_MEMCHECK(target->private._pch_out);
+        memcpy(target->private._pch_out, stub, len);
+        memcpy(target->private._pch_out + len, ext, strlen(ext));
+    }
+
+    /* -- -include stub, freed with argv tail -- */
+    if (target->private._argc_pch > 0) {
+        MACE_FREE(target->private._argv[target->private._argc_pch + 1]);
+        target->private._argv[target->private._argc_pch + 1] = stub;
+        return;
+    }
+    mace_Target_argv_grow(target);
+    target->private._argc_pch = target->private._argc;
+    target->private._argv[target->private._argc++] = mace_str_buffer("-include");
+    mace_Target_argv_grow(target);
+    target->private._argv[target->private._argc++] = stub;
+    target->private._argv[target->private._argc]   = NULL;
+}
+
+/*  Read headers precompiled header depends on */
+/*         from its .d file, written by cc. */
+void mace_Target_Pch_Deps(Target *target) {
+    FILE    *fd;
+    long     size;
+    char    *deps;
+    char    *depfile;
+    char    *header;
+    int      len     = 8;
+    size_t   cwd_len = strlen(cwd);
+
+    MACE_EARLY_RET(target->private._pch_out != NULL, MACE_VOID, assert);
+    MACE_FREE(target->private._pch_deps);
+    target->private._pch_deps_num = 0;
+
+    depfile = calloc(strlen(target->private._pch_out) + 3, sizeof(*depfile));
+    MACE_MEMCHECK(depfile);
+    sprintf(depfile, "%s.d", target->private._pch_out);
+    fd = fopen(depfile, "rb");
+    MACE_FREE(depfile);
+    if (fd == NULL)
+        return;
+
+    fseek(fd, 0L, SEEK_END);
+    size = ftell(fd);
+    fseek(fd, 0L, SEEK_SET);
+    deps = calloc(size + 1, sizeof(*deps));
+    MACE_MEMCHECK(deps);
+    if (fread(deps, 1, size, fd) != (size_t)size)
+        deps[0] = '\0';
+    fclose(fd);
+
+    target->private._pch_deps = calloc(len, sizeof(*target->private._pch_deps));
+    MACE_MEMCHECK(target->private._pch_deps);
+
+    /* -- Split headers into tokens -- */
+    header = strtok(deps, " \t\n\\");
+    while (header != NULL) {
+        u64   hash;
+        char *dot = strrchr(header, '.');
+
+        /* Skip if not a header, or not in cwd */
+        if ((dot == NULL) || (dot[1] != 'h') ||
+            (target->private._checkcwd && (strncmp(header, cwd, cwd_len) != 0))) {
+            header = strtok(NULL, " \t\n\\");
+            continue;
+        }
+
+        if (target->private._pch_deps_num >= len) {
+            len *= 2;
+            target->private._pch_deps = realloc(target->private._pch_deps,
+                                                len * sizeof(*target->private._pch_deps));
+            MACE_MEMCHECK(target->private._pch_deps);
+        }
+        hash = mace_Target_Header_Add(target, header);
+        target->private._pch_deps[target->private._pch_deps_num++] =
+                mace_Target_header_order(target, hash);
+        header = strtok(NULL, " \t\n\\");
+    }
+    MACE_FREE(deps);
 }
 
-/*  Compile target's obj file all at once. */
-void mace_Target_compile_allatonce(Target *target) {
-    /* Compile ALL objects at once */
-    /* -- Move to obj_dir -- */
-    mace_chdir(obj_dir);
+/*  Check if precompiled header must be rebuilt. */
+/*      - If so, all sources recompile with it */
+void mace_Target_Pch_Check(Target *target) {
+    int      i;
+    b32      dirty;
+    char    *depfile;
 
-    /* -- Prepare argv -- */
-    mace_Target_argv_allatonce(target);
+    MACE_EARLY_RET(target->private._pch_out != NULL, MACE_VOID, assert);
 
-    /* -- Actual compilation -- */
-    mace_exec_print(target->private._argv, target->private._argc);
-    if (!dry_run) {
-        pid_t pid = mace_exec_wbash(target->private._argv[0], target->private._argv);
-        mace_wait_pid(pid);
+    depfile = calloc(strlen(target->private._pch_out) + 3, sizeof(*depfile));
+    MACE_MEMCHECK(depfile);
+    sprintf(depfile, "%s.d", target->private._pch_out);
+    dirty = build_all ||
+            (access(target->private._pch_out, F_OK) != 0) ||
+            (access(depfile, F_OK) != 0);
+    MACE_FREE(depfile);
+
+    for (i = 0; i < target->private._pch_deps_num; i++) {
+        if (target->private._hdrs_changed[target->private._pch_deps[i]])
+            dirty = true;
     }
 
-    /* -- Go back to cwd -- */
-    mace_chdir(cwd);
+    target->private._pch_dirty = dirty;
+    for (i = 0; dirty && (i < target->private._argc_sources); i++)
+        mace_Target_Reason(target, i, MACE_REASON_PCH);
 }
 
 /*  Target pre-compilation: check which file */
 /*         needs to be recompiled */
 void mace_Target_precompile(Target *target) {
-    int argc = 0;
+    int argc  = 0;
+    int pool  = target->private._compile_pool;
+    u64 start = mace_time_us();
 
     /* Compute latest object dependencies .d file */
     MACE_EARLY_RET(target, MACE_VOID, assert);
@@ -4928,6 +9777,7 @@ void mace_Target_precompile(Target *target) {
             pid_t pid;
             size_t len;
 
+            mace_pool_wait(pool, 0);
             if (verbose)
                 printf("Pre-Compile %s\n", target->private._argv_sources[argc]);
             target->private._argv[MACE_ARGV_SOURCE] = target->private._argv_sources[argc];
@@ -4941,91 +9791,78 @@ void mace_Target_precompile(Target *target) {
             mace_exec_print(target->private._argv, target->private._argc);
             assert(target->private._argv[target->private._argc] == NULL);
             pid = mace_exec_wbash(target->private._argv[0], target->private._argv);
-            mace_pqueue_put(pid);
+            mace_pqueue_put(pid, target, MACE_PROCESS_PRECOMPILE, argc - 1, pool, 0);
 
             target->private._argv[MACE_ARGV_OBJECT][len - 1] = 'o';
         }
 
-        /* Prioritize adding process to queue */
-        if ((argc < target->private._argc_sources) &&
-            (pnum < plen))
-            continue;
-
-        /* Wait for process */
-        if (pnum > 0) {
-            pid_t wait = mace_pqueue_pop();
-            if (wait > 0) {
-                mace_wait_pid(wait);
-            }
-        }
-
-        /* Check if more to compile */
-        if ((pnum <= 0) &&
-            (argc >= target->private._argc_sources))
+        /* Check if more to pre-compile */
+        /* Only this target's .d files are read: */
+        /* other targets' processes keep running */
+        if (argc >= target->private._argc_sources) {
+            while (mace_pqueue_running(target, MACE_PROCESS_PRECOMPILE))
+                mace_pqueue_wait();
             break;
+        }
     }
     target->private._argv[--target->private._argc] = NULL;
+    stats.pre_depfiles += mace_time_us() - start;
 
     /* -- Object dependencies (headers) -- */
     /* - Read .d file and hashes the filenames, write all headers to .ho files. - */
+    start = mace_time_us();
     mace_Target_Parse_Objdeps(target);
+    if (target->private._pch_out != NULL)
+        mace_Target_Pch_Deps(target);
+    stats.pre_objdeps += mace_time_us() - start;
 
     /* - Compute checksums of all headers - */
+    start = mace_time_us();
     mace_Headers_Checksums(target);
 
     /* - Check if any source's header changed - */
     mace_Headers_Checksums_Checks(target);
+    if (target->private._pch_out != NULL)
+        mace_Target_Pch_Check(target);
+    stats.pre_headers += mace_time_us() - start;
 }
 
-/*  Compile targets' objects one at a time */
+/*  Compile targets' objects one at a time, */
+/*         in _compile_order: longest first */
+/*      - Does not wait for objects to finish */
 void mace_Target_compile(Target *target) {
-    int argc = 0;
+    int i;
+    int pool = target->private._compile_pool;
 
     MACE_EARLY_RET(target, MACE_VOID, assert);
     MACE_EARLY_RET(target->private._argv, MACE_VOID, assert);
 
     target->private._argv[MACE_ARGV_CC] = cc;
 
-    /* - Single source argv - */
-    while (true) {
-        /* - Skip if no recompiles - */
-        if ((argc < target->private._argc_sources) &&
-            (!target->private._recompiles[argc])) {
-            argc++;
-            continue;
-        }
-
-        /* - Add process to queue - */
-        if (argc < target->private._argc_sources) {
-            if (!silent)
-                printf("Compiling %s\n", target->private._argv_sources[argc]);
-            target->private._argv[MACE_ARGV_SOURCE] = target->private._argv_sources[argc];
-            target->private._argv[MACE_ARGV_OBJECT] = target->private._argv_objects[argc];
-            argc++;
+    /* - Schedule if not done in pre-build - */
+    if (target->private._compile_order == NULL) {
+        mace_Target_Schedule(target, 0, 0);
+    }
 
-            /* -- Actual compilation -- */
-            mace_exec_print(target->private._argv, target->private._argc);
-            if (!dry_run) {
-                pid_t pid = mace_exec_wbash(target->private._argv[0], target->private._argv);
-                mace_pqueue_put(pid);
-            }
-        }
+    /* - Single source argv - */
+    for (i = 0; i < target->private._compile_num; i++) {
+        int argc = target->private._compile_order[i];
+        u64 rss;
 
-        /* Prioritize adding process to queue */
-        if ((argc < target->private._argc_sources) &&
-            (pnum < plen))
-            continue;
+        /* - Wait for free slot in pool, memory - */
+        rss = (target->private._rss != NULL) ? target->private._rss[argc] : 0;
+        mace_pool_wait(pool, rss);
+        if (!silent)
+            printf("Compiling %s\n", target->private._argv_sources[argc]);
+        target->private._argv[MACE_ARGV_SOURCE] = target->private._argv_sources[argc];
+        target->private._argv[MACE_ARGV_OBJECT] = target->private._argv_objects[argc];
 
-        /* Wait for process */
-        if (pnum > 0) {
-            pid_t wait = mace_pqueue_pop();
-            mace_wait_pid(wait);
+        /* -- Actual compilation -- */
+        mace_exec_print(target->private._argv, target->private._argc);
+        if (!dry_run) {
+            pid_t pid = mace_exec_wbash(target->private._argv[0], target->private._argv);
+            mace_pqueue_put(pid, target, MACE_PROCESS_COMPILE, argc, pool, rss);
         }
-
-        /* Check if more to compile */
-        if ((pnum <= 0) &&
-            (argc >= target->private._argc_sources))
-            break;
     }
 }
 
@@ -5095,6 +9932,63 @@ void mace_Target_Recompiles_Add(Target *target, b32 add) {
     target->private._recompiles[target->private._argc_sources - 1] = add;
 }
 
+/*  Recompile source, keeping first reason. */
+void mace_Target_Reason(Target *target, int source_i, int reason) {
+    target->private._recompiles[source_i] = true;
+    if (target->private._reasons[source_i] == MACE_REASON_NONE)
+        target->private._reasons[source_i] = reason;
+}
+
+/*  Path of target's compile command fingerprint: */
+/*         <cwd>/<obj_dir>/<target>.flags */
+char *mace_Target_flags_path(const Target *target) {
+    char *path = calloc(strlen(cwd) + strlen(obj_dir) +
+                        strlen(target->private._name) + 9, sizeof(*path));
+    MACE_MEMCHECK(path);
+    sprintf(path, "%s/%s/%s.flags", cwd, obj_dir, target->private._name);
+    return (path);
+}
+
+/*  Recompile all sources if compile command */
+/*         changed since target last compiled. */
+/*      - Unknown if no .flags file: no recompile */
+void mace_Target_Flags_Check(Target *target) {
+    int      i;
+    u32      previous;
+    char    *path;
+    FILE    *fp;
+    b32      changed = false;
+
+    path = mace_Target_flags_path(target);
+    fp   = fopen(path, "rb");
+    if (fp != NULL) {
+        if (fread(&previous, sizeof(previous), 1, fp) == 1)
+            changed = (previous != target->private._fingerprint);
+        fclose(fp);
+    }
+    MACE_FREE(path);
+
+    for (i = 0; changed && (i < target->private._argc_sources); i++)
+        mace_Target_Reason(target, i, MACE_REASON_FLAGS);
+}
+
+/*  Save compile command fingerprint of target, */
+/*         after its objects compiled. */
+void mace_Target_Flags_Write(const Target *target) {
+    char    *path;
+    FILE    *fp;
+
+    MACE_EARLY_RET(!dry_run, MACE_VOID, MACE_nASSERT);
+
+    path = mace_Target_flags_path(target);
+    fp   = fopen(path, "wb");
+    if (fp != NULL) {
+        fwrite(&target->private._fingerprint, sizeof(target->private._fingerprint), 1, fp);
+        fclose(fp);
+    }
+    MACE_FREE(path);
+}
+
 /*  Add object needing to be compiled to target. */
 b32 mace_Target_Object_Add(Target *target, char *token) {
     u64      hash;
@@ -5154,44 +10048,161 @@ b32 mace_Target_Object_Add(Target *target, char *token) {
     return (exists);
 }
 
+/*  Hash of target's header path, checksum path. */
+u64 mace_header_check_hash(const Target *target, int header_order) {
+    return ((mace_hash(target->private._headers_checksum[header_order]) * 33ul) ^
+            target->private._headers_hash[header_order]);
+}
+
+/*  Index of header in hdrs_checked, from hash */
+/*         of its path and checksum path. */
+/*  @return -1 if not checked yet */
+int mace_header_checked(u64 hash) {
+    int i;
+    for (i = 0; i < hdrs_checked_num; i++) {
+        if (hdrs_checked[i].hash == hash)
+            return (i);
+    }
+    return (-1);
+}
+
 /*  Check if any source/header file changed
 **         for object. */
+/*      - Counts recompiles each changed header */
+/*        caused, saved after pre-build */
+/*      - Header checksums written after build: */
+/*        objects compiled by interrupted build */
+/*        with current headers skipped, from */
+/*        digest of headers in their .hs */
 void mace_Headers_Checksums_Checks(Target *target) {
-    int i;
-    int j;
+    int     i;
+    int     j;
+    u32    *caused;
 
     MACE_EARLY_RET(target != NULL, MACE_VOID, assert);
     MACE_EARLY_RET(target->private._hdrs_changed != NULL, MACE_VOID, assert);
 
     if (build_all) {
-        size_t bytesize = target->private._argc_sources * sizeof(*target->private._recompiles);
-        memset(target->private._recompiles, 1, bytesize);
+        for (i = 0; i < target->private._argc_sources; i++)
+            mace_Target_Reason(target, i, MACE_REASON_BUILD_ALL);
         return;
     }
 
+    caused = calloc(target->private._headers_num + 1, sizeof(*caused));
+    MACE_MEMCHECK(caused);
+
     /* For every source file */
     for (i = 0; i < target->private._argc_sources; i++) {
-        /* Check if any header has changed */
-        if (target->private._recompiles[i] == true) {
-            continue;
-        }
+        u64     digest;
+        b32     changed = false;
+
+        target->private._hdrs_digests[i] = 0;
         if (target->private._deps_headers[i] == NULL) {
             /* No headers */
             continue;
         }
+
+        /* Check if any header has changed */
         for (j = 0;  j < target->private._deps_headers_num[i]; j++) {
             int header_order = target->private._deps_headers[i][j];
             if (target->private._hdrs_changed[header_order]) {
-                target->private._recompiles[i] = true;
+                changed = true;
                 break;
             }
         }
+        if (!changed)
+            continue;
+
+        /* Staged: written once object compiled */
+        digest = mace_Target_headers_digest(target, i);
+        target->private._hdrs_digests[i] = digest;
+        if (target->private._recompiles[i] == true)
+            continue;
+
+        /* Object compiled with current headers */
+        if ((digest != 0) &&
+            (mace_headers_digest_read(target->private._argv_objects[i] + 2) == digest))
+            continue;
+
+        /* All changed headers caused recompile */
+        for (j = 0;  j < target->private._deps_headers_num[i]; j++) {
+            int header_order = target->private._deps_headers[i][j];
+            if (target->private._hdrs_changed[header_order]) {
+                mace_Target_Reason(target, i, MACE_REASON_HEADER);
+                caused[header_order]++;
+            }
+        }
+    }
+
+    for (i = 0; i < target->private._headers_num; i++) {
+        int checked;
+        if (!target->private._hdrs_changed[i])
+            continue;
+        checked = mace_header_checked(mace_header_check_hash(target, i));
+        if (checked >= 0)
+            hdrs_checked[checked].caused += caused[i];
+    }
+    MACE_FREE(caused);
+}
+
+/*  Digest of current checksums of source's */
+/*         headers, from this build's checks. */
+/*  @return 0 if unknown */
+u64 mace_Target_headers_digest(const Target *target, int source_i) {
+    int i;
+    int k;
+    u64 digest = 5381ul;
+
+    for (i = 0; i < target->private._deps_headers_num[source_i]; i++) {
+        int header_order    = target->private._deps_headers[source_i][i];
+        u64 hash            = mace_header_check_hash(target, header_order);
+        int checked         = mace_header_checked(hash);
+        if (checked < 0)
+            return (0);
+        digest = (digest * 33ul) ^ hash;
+        for (k = 0; k < SHA1DC_LEN; k++)
+            digest = (digest * 33ul) ^ hdrs_checked[checked].staged[k];
+    }
+    return ((digest == 0) ? 1 : digest);
+}
+
+/*  Path of .hs file of object, next to it. */
+char *mace_headers_digest_path(const char *object) {
+    size_t  len     = strlen(object);
+    char   *path    = calloc(len + 2, sizeof(*path));
+    MACE_MEMCHECK(path);
+    memcpy(path, object, len);
+    memcpy(path + len - 1, "hs", 2);
+    return (path);
+}
+
+/*  Read digest of headers object compiled with. */
+/*  @return 0 if unknown */
+u64 mace_headers_digest_read(const char *object) {
+    u64      digest = 0;
+    char    *path   = mace_headers_digest_path(object);
+    FILE    *fp     = fopen(path, "rb");
+
+    if (fp != NULL) {
+        if (fread(&digest, sizeof(digest), 1, fp) != 1)
+            digest = 0;
+        fclose(fp);
     }
+    MACE_FREE(path);
+    return (digest);
+}
+
+/*  Write digest of headers object compiled with. */
+void mace_headers_digest_write(const char *object, u64 digest) {
+    char    *path   = mace_headers_digest_path(object);
+    mace_file_write(path, &digest, sizeof(digest));
+    MACE_FREE(path);
 }
 
 /*  Compute checksums for all headers. */
 void mace_Headers_Checksums(const Target *target) {
     int i;
+    u64 start = mace_trace_begin();
 
     /* --- HEADERS CHECKSUMS --- */
     mace_chdir(cwd);
@@ -5199,30 +10210,128 @@ void mace_Headers_Checksums(const Target *target) {
     for (i = 0; i < target->private._headers_num; i++) {
         const char *header_path     = target->private._headers[i];
         const char *checksum_path   = target->private._headers_checksum[i];
+        u64         hash            = mace_header_check_hash(target, i);
+        int         checked;
+        b32         changed;
+        u8          staged[SHA1DC_LEN];
+
+        /* -- Already checked by previous target -- */
+        checked = mace_header_checked(hash);
+        if (checked >= 0) {
+            target->private._hdrs_changed[i] = hdrs_checked[checked].changed;
+            continue;
+        }
 
-        b32 changed = mace_file_changed(checksum_path, header_path);
-
+        changed = mace_file_changed(checksum_path, header_path, staged);
         target->private._hdrs_changed[i] = changed;
+
+        if (hdrs_checked_num >= hdrs_checked_len) {
+            hdrs_checked_len = (hdrs_checked_len > 0) ? hdrs_checked_len * 2 :
+                               MACE_DEFAULT_OBJECT_LEN;
+            hdrs_checked = realloc(hdrs_checked, hdrs_checked_len * sizeof(*hdrs_checked));
+            MACE_MEMCHECK(hdrs_checked);
+        }
+        hdrs_checked[hdrs_checked_num].hash     = hash;
+        hdrs_checked[hdrs_checked_num].checksum = checksum_path;
+        hdrs_checked[hdrs_checked_num].changed  = changed;
+        hdrs_checked[hdrs_checked_num].caused   = 0;
+        memcpy(hdrs_checked[hdrs_checked_num].staged, staged, SHA1DC_LEN);
+        hdrs_checked_num++;
     }
+    mace_trace_end("checksum headers", target->private._name, start);
 
     if (target->base_dir != NULL) {
         mace_chdir(target->base_dir);
     }
 }
 
+/*  Path of source checksum, from its object. */
+char *mace_Source_checksum_path(const Target *target,
+                                const char *obj_path) {
+    char *checksum_path;
+
+    if (target->batch > 0) {
+        /* Mirrored objects: same filenames, next to object */
+        const char *obj = obj_path + 2; /* skip "-o" */
+        size_t len      = strlen(obj);
+        checksum_path   = calloc(len + MACE_SHA1_EXT_LEN, sizeof(*checksum_path));
+        MACE_MEMCHECK(checksum_path);
+        memcpy(checksum_path, obj, len - 2);
+        memcpy(checksum_path + len - 2, MACE_SHA1_EXT, MACE_SHA1_EXT_LEN);
+        return (checksum_path);
+    }
+    return (mace_checksum_filename(obj_path, MACE_CHECKSUM_MODE_SRC));
+}
+
+/*  Write staged checksum of source, digest */
+/*         of its headers, after its object compiled. */
+void mace_Target_Checksum_Commit(Target *target, int source_i) {
+    char *checksum_path;
+
+    MACE_EARLY_RET(target->private._staged != NULL, MACE_VOID, MACE_nASSERT);
+    if (dry_run)
+        return;
+    if (target->private._hdrs_digests[source_i] != 0) {
+        mace_headers_digest_write(target->private._argv_objects[source_i] + 2,
+                                  target->private._hdrs_digests[source_i]);
+        target->private._hdrs_digests[source_i] = 0;
+    }
+    if (target->private._pgo_digests[source_i] != 0) {
+        char *path = mace_pgo_digest_path(target->private._argv_objects[source_i] + 2);
+        mace_file_write(path, &target->private._pgo_digests[source_i], sizeof(u64));
+        target->private._pgo_digests[source_i] = 0;
+        MACE_FREE(path);
+    }
+    if (!target->private._staged[source_i])
+        return;
+
+    checksum_path = mace_Source_checksum_path(target,
+                                              target->private._argv_objects[source_i]);
+    mace_checksum_write(checksum_path, target->private._checksums + source_i * SHA1DC_LEN);
+    target->private._staged[source_i] = false;
+    MACE_FREE(checksum_path);
+}
+
+/*  Write staged checksums of all sources, */
+/*         after all objects of target compiled. */
+/*      - allatonce, pch, missed by processes */
+void mace_Target_Checksums_Commit(Target *target) {
+    int i;
+    for (i = 0; i < target->private._argc_sources; i++)
+        mace_Target_Checksum_Commit(target, i);
+}
+
+/*  Write staged checksums of changed headers, */
+/*         after all objects compiled. */
+/*      - Objects compiled before build stopped */
+/*        have digest of current headers: */
+/*        not recompiled */
+void mace_headers_commit(void) {
+    int i;
+
+    MACE_EARLY_RET(!dry_run && !report, MACE_VOID, MACE_nASSERT);
+    for (i = 0; i < hdrs_checked_num; i++) {
+        if (hdrs_checked[i].changed)
+            mace_checksum_write(hdrs_checked[i].checksum, hdrs_checked[i].staged);
+    }
+}
+
 /*  Compute checksums for all sources. */
 b32 mace_Source_Checksum(const Target  *target,
                          const char    *source_path,
-                         const char    *obj_path) {
+                         const char    *obj_path,
+                         u8            *staged) {
     /* --- SOURCE CHECKSUM --- */
     /* - Compute current checksum - */
     b32      changed        = true;
     char    *checksum_path  = NULL;
+    u64      start          = mace_trace_begin();
 
     /* - Read existing checksum file - */
     mace_chdir(cwd);
-    checksum_path = mace_checksum_filename(obj_path, MACE_CHECKSUM_MODE_SRC);
-    changed = mace_file_changed(checksum_path, source_path);
+    checksum_path = mace_Source_checksum_path(target, obj_path);
+    changed = mace_file_changed(checksum_path, source_path, staged);
+    mace_trace_end("checksum", source_path, start);
 
     MACE_FREE(checksum_path);
 
@@ -5287,13 +10396,27 @@ void mace_Target_Parse_Source(Target *target,
     if (excluded)
         return;
 
-    mace_object_path(src);
-    exists  = mace_Target_Object_Add(target, object);
     i = target->private._argc_sources - 1;
+    if (target->batch > 0)
+        mace_object_path_mirror(target->private._argv_sources[i]);
+    else
+        mace_object_path(src);
+    exists  = mace_Target_Object_Add(target, object);
+    /* Unity: objects are chunks', checked in mace_Target_Unity */
+    if (target->unity > 0)
+        exists = true;
     changed_src = mace_Source_Checksum(target, 
                                 target->private._argv_sources[i],
-                                target->private._argv_objects[i]);
+                                target->private._argv_objects[i],
+                                target->private._checksums + i * SHA1DC_LEN);
+    target->private._staged[i] = changed_src && !report;
     mace_Target_Recompiles_Add(target, !excluded && (changed_src || !exists));
+    if (!exists)
+        mace_Target_Reason(target, i, MACE_REASON_OBJECT);
+    else if (changed_src)
+        mace_Target_Reason(target, i, MACE_REASON_SOURCE);
+    if ((target->unity <= 0) && mace_Target_Profile(target, i))
+        mace_Target_Reason(target, i, MACE_REASON_PROFILE);
 }
 
 /*  Globbed files for sources and parse objects. */
@@ -5301,7 +10424,9 @@ void mace_compile_glob( Target *target,
                         const char *globsrc,
                         const char *flags) {
     int i;
-    glob_t globbed = mace_glob_sources(globsrc);
+    u64 start       = mace_trace_begin();
+    glob_t globbed  = mace_glob_sources(globsrc);
+    mace_trace_end("glob", globsrc, start);
 
     for (i = 0; i < globbed.gl_pathc; i++) {
         char *pos;
@@ -5451,6 +10576,32 @@ void mace_object_path(const char *source) {
 
     MACE_FREE(path);
 }
+
+/*  Write object path mirroring source */
+/*         directories to global object. */
+/*         Makes object directories. */
+/*      - Relative to cwd if source is in it */
+void mace_object_path_mirror(const char *source) {
+    char        *slash;
+    const char  *relative   = source;
+    size_t       cwd_len    = strlen(cwd);
+    size_t       prefix_len = cwd_len + strlen(obj_dir) + 1;
+
+    if ((strncmp(source, cwd, cwd_len) == 0) && (source[cwd_len] == '/'))
+        relative = source + cwd_len + 1;
+    while (relative[0] == '/')
+        relative++;
+    mace_object_path(relative);
+
+    /* --- Make directories in obj_dir --- */
+    slash = strchr(object + prefix_len + 1, '/');
+    while (slash != NULL) {
+        *slash = '\0';
+        mace_mkdir(object);
+        *slash = '/';
+        slash = strchr(slash + 1, '/');
+    }
+}
 /*  Copy input str into calloc'ed buffer */
 char *mace_str_buffer(const char *strlit) {
     size_t  litlen;
@@ -5479,6 +10630,98 @@ void mace_chdir(const char *path) {
     }
 }
 
+/*  Write file if its content changed. */
+/*  @return true if file was written */
+b32 mace_write_changed(const char *path, const char *content) {
+    FILE    *fp;
+    char    *previous;
+    b32      same;
+    size_t   len = strlen(content);
+
+    /* -- Compare with previous content -- */
+    previous = calloc(len + 1, sizeof(*previous));
+    MACE_MEMCHECK(previous);
+    fp = fopen(path, "rb");
+    same = false;
+    if (fp != NULL) {
+        same = (fread(previous, 1, len + 1, fp) == len) &&
+               (memcmp(previous, content, len) == 0);
+        fclose(fp);
+    }
+    MACE_FREE(previous);
+    if (same)
+        return (false);
+
+    fp = fopen(path, "wb");
+    if (fp == NULL) {
+        fprintf(stderr, "Could not write file '%s'\n", path);
+        exit(1);
+    }
+    fwrite(content, 1, len, fp);
+    fclose(fp);
+    return (true);
+}
+
+/*  Remove generated files of target no longer */
+/*         built: <obj_dir>/<target><kind><hex>.* */
+/*      - keep: objects built, in argv form */
+/*      - All extensions: .c, .o, .d, .ho, .t... */
+void mace_remove_stale(const Target *target, const char *kind,
+                       char **keep, int keep_num) {
+    int          k;
+    size_t       i;
+    size_t       name_len;
+    char        *pattern;
+    glob_t       globbed;
+    const char  *hex = "0123456789abcdef";
+
+    MACE_EARLY_RET(!dry_run, MACE_VOID, MACE_nASSERT);
+
+    name_len = strlen(target->private._name) + strlen(kind);
+    pattern  = calloc(strlen(cwd) + strlen(obj_dir) + name_len + 4,
+                      sizeof(*pattern));
+    MACE_MEMCHECK(pattern);
+    sprintf(pattern, "%s/%s/%s%s*", cwd, obj_dir, target->private._name, kind);
+    if (glob(pattern, 0, NULL, &globbed) != 0) {
+        MACE_FREE(pattern);
+        return;
+    }
+
+    for (i = 0; i < globbed.gl_pathc; i++) {
+        const char *id  = strrchr(globbed.gl_pathv[i], '/') + 1 + name_len;
+        size_t      len = strspn(id, hex);
+        b32         kept = false;
+
+        /* Not <hex>.*: other target with same prefix */
+        if ((len == 0) || (id[len] != '.'))
+            continue;
+        for (k = 0; !kept && (k < keep_num); k++) {
+            const char *keep_id = strrchr(keep[k], '/');
+            keep_id = (keep_id != NULL) ? keep_id + 1 + name_len :
+                                          keep[k] + strlen("-o") + name_len;
+            kept = (strncmp(keep_id, id, len) == 0) && (keep_id[len] == '.');
+        }
+        if (!kept)
+            remove(globbed.gl_pathv[i]);
+    }
+    globfree(&globbed);
+    MACE_FREE(pattern);
+}
+
+/*  Write str to file as JSON string. */
+void mace_json_string(FILE *file, const char *str) {
+    fputc('"', file);
+    for (; (str != NULL) && (*str != '\0'); str++) {
+        if ((*str == '"') || (*str == '\\'))
+            fprintf(file, "\\%c", *str);
+        else if ((unsigned char)*str < 0x20)
+            fprintf(file, "\\u%04x", (unsigned char)*str);
+        else
+            fputc(*str, file);
+    }
+    fputc('"', file);
+}
+
 /**************** mace_build ******************/
 /*  Run command input as a single long char string. */
 /*      - Split tokens between spaces i.e. " " */
@@ -5493,6 +10736,7 @@ void mace_run_commands(const char *commands,
 
     int argc    = 0;
     int len     = 8;
+    int cause;
 
     if (commands == NULL)
         return;
@@ -5500,6 +10744,7 @@ void mace_run_commands(const char *commands,
     printf("Running command-%s, target '%s'\n",
            preorpost, target);
     mace_chdir(cwd);
+    cause = mace_util_cause(MACE_IDLE_CMD);
 
     argv = calloc(len, sizeof(*argv));
 
@@ -5520,12 +10765,19 @@ void mace_run_commands(const char *commands,
 
         mace_exec_print(argv, argc);
         if (!dry_run) {
-            pid_t pid = mace_exec(argv[0], argv);
+            u64   start = mace_trace_begin();
+            pid_t pid   = mace_exec(argv[0], argv);
             mace_wait_pid(pid);
+            if (trace_file != NULL) {
+                char cat[16];
+                sprintf(cat, "cmd_%.8s", preorpost);
+                mace_trace_event(argv[0], cat, token, 0, start, mace_time_us());
+            }
         }
 
         token = strtok(NULL, mace_command_separator);
     } while (token != NULL);
+    mace_util_cause(cause);
 
     /* FREE */
     if (argv != NULL) {
@@ -5545,6 +10797,7 @@ void mace_run_commands(const char *commands,
 void mace_prebuild_target(Target *target) {
     char *token;
     char *buffer;
+    u64   start;
 
     MACE_EARLY_RET(target != NULL, MACE_VOID, assert);
 
@@ -5577,6 +10830,11 @@ void mace_prebuild_target(Target *target) {
     if (target->sources == NULL) {
         return;
     }
+    start = mace_time_us();
+
+    /* --- Precompiled header, included by sources --- */
+    if ((target->pch != NULL) && !target->allatonce)
+        mace_Target_Pch(target);
     /* -- Copy sources into modifiable buffer -- */
     buffer = mace_str_buffer(target->sources);
 
@@ -5612,13 +10870,28 @@ void mace_prebuild_target(Target *target) {
         token = strtok(NULL, mace_separator);
     } while (token != NULL);
 
+    /* --- Compile command changed: recompile all --- */
+    target->private._fingerprint = mace_Target_fingerprint(target);
+    mace_Target_Flags_Check(target);
+    stats.pre_sources += mace_time_us() - start;
+
     mace_Target_precompile(target);
     MACE_FREE(buffer);
     mace_chdir(cwd);
+
+    /* --- Unity: chunk sources, after header checks --- */
+    if (target->unity > 0) {
+        start = mace_time_us();
+        mace_Target_Unity(target);
+        stats.pre_unity += mace_time_us() - start;
+    }
 }
 
 /*  Build input target: compile then link. */
 void mace_build_target(Target *target) {
+    int reason;
+    int linked;
+
     /* --- Skip if invalic type target --- */
     if ((target->kind <= MACE_TARGET_NULL) ||
         (target->kind >= MACE_TARGET_KIND_NUM)) {
@@ -5639,8 +10912,23 @@ void mace_build_target(Target *target) {
         mace_chdir(target->base_dir);
     }
 
-    /* -- allatonce -- */
-    if (target->allatonce) {
+    /* -- Precompiled header before sources -- */
+    if (target->private._pch_dirty) {
+        mace_Target_compile_pch(target);
+        mace_Target_wait(target, false);
+    }
+
+    /* -- Sources not compiled, objects reused -- */
+    if (!target->allatonce)
+        stats.objects_skipped += target->private._argc_sources -
+                                 target->private._compile_num;
+
+    /* -- unity, batch, allatonce -- */
+    if (target->unity > 0) {
+        mace_Target_compile_unity(target);
+    } else if (target->batch > 0) {
+        mace_Target_compile_batch(target);
+    } else if (target->allatonce) {
         mace_Target_compile_allatonce(target);
     } else {
         mace_Target_compile(target);
@@ -5649,8 +10937,45 @@ void mace_build_target(Target *target) {
     /* --- Move back to cwd to link --- */
     mace_chdir(cwd);
 
-    /* --- Linking --- */
-    mace_link[target->kind - 1](target);
+    /* --- Link after objects, dependencies --- */
+    mace_Target_wait(target, false);
+    mace_Target_wait_deps(target);
+    mace_pool_wait(target->private._link_pool, 0);
+
+    /* --- Objects compiled with current flags, sources --- */
+    mace_Target_Flags_Write(target);
+    mace_Target_Checksums_Commit(target);
+
+    /* --- Object library: dependents link objects --- */
+    /* Relinked if its linked object libraries were:
+    ** dependents link objects of all of them. */
+    if (target->kind == MACE_OBJECT_LIBRARY) {
+        size_t d;
+        target->private._relinked = target->allatonce ||
+                                    (target->private._compile_num > 0);
+        for (d = 0; d < target->private._deps_links_num; d++) {
+            int order = mace_target_order(target->private._deps_links[d]);
+            if ((order >= 0) && (targets[order].kind == MACE_OBJECT_LIBRARY))
+                target->private._relinked |= targets[order].private._relinked;
+        }
+        mace_chdir(cwd);
+        return;
+    }
+
+    /* --- Linking, if output out of date --- */
+    target->private._link_fingerprint = mace_Target_link_fingerprint(target);
+    reason = mace_Target_link_reason(target, &linked);
+    if (reason == MACE_REASON_NONE) {
+        stats.links_skipped++;
+    } else {
+        if (explain && (linked >= 0))
+            printf("Relink %s: %s '%s'\n", target->private._name,
+                   mace_reasons[reason], targets[linked].private._name);
+        else if (explain)
+            printf("Relink %s: %s\n", target->private._name, mace_reasons[reason]);
+        target->private._relinked = true;
+        mace_link[target->kind - 1](target);
+    }
     mace_chdir(cwd);
 }
 
@@ -5822,14 +11147,33 @@ void mace_make_dirs(void) {
     mace_mkdir(build_dir);
 }
 
+/*  Add flag to config's _flags, growing it. */
+void mace_Config_flag_add(Config *config, const char *token, int *len) {
+    char *flag = calloc(strlen(token) + 1, sizeof(*flag));
+    MACE_MEMCHECK(flag);
+    strncpy(flag, token, strlen(token));
+    config->private._flags[config->private._flag_num++] = flag;
+    /* Increase config->private._flags size */
+    if (config->private._flag_num >= *len) {
+        size_t bytesize;
+        *len *= 2;
+        bytesize = *len * sizeof(*config->private._flags);
+        config->private._flags  = realloc(config->private._flags, bytesize);
+        MACE_MEMCHECK(config->private._flags);
+        memset(config->private._flags + *len / 2, 0, bytesize / 2);
+    }
+}
+
 /*  Read config string, splitting string */
 /*         into _flags using mace_separator. */
+/*      - split_dwarf, pgo add their flags after: */
+/*        compile and link commands, fingerprint */
 void mace_parse_config(Config *config) {
     int      len = 8;
     char    *buffer;
     char    *token;
 
-    mace_Config_Free(config);
+    mace_Config_Free_flags(config);
 
     if (config->flags == NULL) {
         fprintf(stderr, "Config has no flags.\n");
@@ -5843,23 +11187,24 @@ void mace_parse_config(Config *config) {
 
     buffer = mace_str_buffer(config->flags);
     token  = strtok(buffer, mace_separator);
-    do {
-        char *flag = calloc(strlen(token) + 1, sizeof(*flag));
-        MACE_MEMCHECK(flag);
-        strncpy(flag, token, strlen(token));
-        config->private._flags[config->private._flag_num++] = flag;
-        /* Increase config->private._flags size */
-        if (config->private._flag_num >= len) {
-            size_t bytesize;
-            len *= 2;
-            bytesize = len * sizeof(*config->private._flags);
-            config->private._flags  = realloc(config->private._flags, bytesize);
-            MACE_MEMCHECK(config->private._flags);
-            memset(config->private._flags + len / 2, 0, len / 2);
-        }
+    while (token != NULL) {
+        mace_Config_flag_add(config, token, &len);
         token = strtok(NULL, mace_separator);
-    } while (token != NULL);
+    }
     MACE_FREE(buffer);
+
+    if (config->split_dwarf)
+        mace_Config_flag_add(config, "-gsplit-dwarf", &len);
+
+    /* -- Profiles of sources edited since training: */
+    /*    warnings, not errors -- */
+    if (config->pgo == MACE_PGO_GENERATE) {
+        mace_Config_flag_add(config, "-fprofile-generate", &len);
+    } else if (config->pgo == MACE_PGO_USE) {
+        mace_Config_flag_add(config, "-fprofile-use", &len);
+        mace_Config_flag_add(config, "-Wno-missing-profile", &len);
+        mace_Config_flag_add(config, "-Wno-error=coverage-mismatch", &len);
+    }
 }
 
 void mace_parse_configs(void) {
@@ -5915,40 +11260,120 @@ void mace_build_order(void) {
 /*         needs to be recompiled */
 void mace_pre_build(void) {
     int z;
+    b32 fresh;
+    u64 start;
+    u64 pre_build = mace_time_us();
+
+    /* --- Slot utilization from here to end of build --- */
+    util.last   = pre_build;
+    util.cause  = MACE_IDLE_PREBUILD;
+
+    /* --- No-op: plan fresh, skip builds --- */
+    /* Inputs edited after now: stale in plan */
+    stats.plan_time = (u64)time(NULL);
+    start = mace_time_us();
+    fresh = mace_plan_fresh();
+    mace_trace_end("plan", NULL, start);
+    stats.pre_plan = mace_time_us() - start;
+    if (fresh) {
+        if (!silent)
+            printf("Build plan fresh, nothing to build\n");
+        mace_util_cause(MACE_IDLE_MACE);
+        stats.pre_build = mace_time_us() - pre_build;
+        return;
+    }
 
     /* --- Make output directories --- */
     mace_make_dirs();
 
     /* --- Build order from target links, deps --- */
+    start = mace_time_us();
     mace_build_order();
+    mace_trace_end("build order", NULL, start);
+    stats.pre_schedule += mace_time_us() - start;
 
     /* Actually prebuild all targets */
     for (z = 0; z < build_order_num; z++) {
+        Target *target = &targets[build_order[z]];
         assert(build_order[z] >= 0);
-        mace_Target_Grow_Headers(&targets[build_order[z]]);
-        mace_prebuild_target(&targets[build_order[z]]);
+        start = mace_time_us();
+        mace_Target_Grow_Headers(target);
+        mace_prebuild_target(target);
+        mace_trace_end("pre-build", target->private._name, start);
+        target->private._prebuild_time = mace_time_us() - start;
     }
+
+    /* --- Recompiles caused by headers --- */
+    mace_recompiles_record();
+    if (explain)
+        mace_explain();
+
+    /* --- Longest critical path first --- */
+    start = mace_time_us();
+    mace_schedule();
+    mace_trace_end("schedule", NULL, start);
+    stats.pre_schedule += mace_time_us() - start;
+
+    mace_util_cause(MACE_IDLE_MACE);
+    stats.pre_build = mace_time_us() - pre_build;
 }
 
 /*  Actually compile and link target. */
 void mace_build(void) {
     /* Actually build all targets */
     int z;
+    u64 start = mace_time_us();
+
+    /* --- Report on previous builds instead --- */
+    if (report) {
+        mace_report();
+        return;
+    }
     for (z = 0; z < build_order_num; z++) {
         Target *target = &targets[build_order[z]];
         /* -- config argv -- */
         mace_argv_add_config(target, &target->private._argv, &target->private._argc, &target->private._arg_len);
+        mace_argv_add_lto(&target->private._argv, &target->private._argc, &target->private._arg_len, false);
 
         assert(target->private._name != NULL);
         mace_print_message(target->msg_pre);
+        /* -- Commands may use dependencies -- */
+        if (target->cmd_pre != NULL)
+            mace_Target_wait_deps(target);
         mace_run_commands(target->cmd_pre, "pre", target->private._name);
         mace_build_target(target);
+        /* -- Post messages, commands wait for link -- */
+        if ((target->msg_post != NULL) || (target->cmd_post != NULL))
+            mace_Target_wait(target, true);
         mace_print_message(target->msg_post);
         mace_run_commands(target->cmd_post, "post", target->private._name);
     }
+    mace_util_cause(MACE_IDLE_DRAIN);
+    mace_pqueue_drain();
+    mace_util_tick();
+    util.last   = 0;
+
+    /* --- All objects compiled: headers seen --- */
+    mace_headers_commit();
+
+    /* --- Instrumented targets relinked: train --- */
+    mace_pgo_train();
+
+    /* --- Files built, their stats for no-op --- */
+    if (!stats.plan_fresh && !no_plan)
+        mace_plan_write();
+    stats.build = mace_time_us() - start;
 }
 
 void mace_Config_Free(Config *config) {
+    MACE_EARLY_RET(config != NULL, MACE_VOID, MACE_nASSERT);
+
+    mace_Config_Free_flags(config);
+    MACE_FREE(config->private._name);
+}
+
+/*  Free parsed flags, keeping name. */
+void mace_Config_Free_flags(Config *config) {
     int i;
 
     MACE_EARLY_RET(config != NULL, MACE_VOID, MACE_nASSERT);
@@ -5958,14 +11383,15 @@ void mace_Config_Free(Config *config) {
             MACE_FREE(config->private._flags[i]);
         }
     }
-    MACE_FREE(config->private._name);
     MACE_FREE(config->private._flags);
+    config->private._flag_num = 0;
 }
 
 void mace_Target_Free(Target *target) {
     MACE_EARLY_RET(target != NULL, MACE_VOID, assert);
 
     MACE_FREE(target->private._name);
+    MACE_FREE(target->private._deps_links);
     mace_Target_Free_argv(target);
     mace_Target_Free_notargv(target);
     mace_Target_Free_excludes(target);
@@ -6016,8 +11442,29 @@ void mace_Target_Free_excludes(Target *target) {
 void mace_Target_Free_notargv(Target *target) {
     MACE_EARLY_RET(target != NULL, MACE_VOID, assert);
 
-    MACE_FREE(target->private._deps_links);
     MACE_FREE(target->private._recompiles);
+    MACE_FREE(target->private._reasons);
+    MACE_FREE(target->private._checksums);
+    MACE_FREE(target->private._staged);
+    MACE_FREE(target->private._hdrs_digests);
+    MACE_FREE(target->private._pgo_digests);
+    MACE_FREE(target->private._weights);
+    MACE_FREE(target->private._rss);
+    MACE_FREE(target->private._compile_order);
+    target->private._compile_num = 0;
+    MACE_FREE(target->private._shard_sources);
+    MACE_FREE(target->private._shard_start);
+    target->private._shard_num = 0;
+    MACE_FREE(target->private._unity_chunk);
+    mace_argv_free(target->private._unity_sources, target->private._unity_num);
+    mace_argv_free(target->private._unity_objects, target->private._unity_num);
+    target->private._unity_sources = NULL;
+    target->private._unity_objects = NULL;
+    target->private._unity_num     = 0;
+    MACE_FREE(target->private._pch_out);
+    MACE_FREE(target->private._pch_deps);
+    target->private._pch_deps_num  = 0;
+    target->private._pch_dirty     = false;
 }
 
 void mace_Target_Free_argv(Target *target) {
@@ -6340,6 +11787,7 @@ char *mace_Target_Read_d(Target *target, int source_i) {
         fprintf(stderr, "Object dependency file '%s' does not exist.\n", obj_file);
         exit(1);
     }
+    stats.d_loads++;
     target->private._deps_headers_num[source_i] = 0;
 
     /* Parse all dependencies, " " separated */
@@ -6472,6 +11920,7 @@ void mace_Target_Read_ho(Target *target, int source_i) {
         MACE_FREE(obj_file);
         return;
     }
+    stats.ho_loads++;
 
     /* Get total number of bytes in file */
     fseek(fho, 0L, SEEK_END);
@@ -6496,16 +11945,21 @@ void mace_Target_Read_ho(Target *target, int source_i) {
 void mace_Target_Parse_Objdeps(Target *target) {
     /* Loop over all _argv_sources */
     int i;
+    u64 start = mace_trace_begin();
     for (i = 0; i < target->private._argc_sources; i++) {
         mace_Target_Parse_Objdep(target, i);
         mace_Target_Read_ho(target, i);
     }
+    mace_trace_end("read .d, .ho", target->private._name, start);
 }
 
 /*  Alloc stuff in preparation for user  */
 /*         to set targets, configs, etc. */
 void mace_pre_user(const Mace_Args *args) {
+    u64 start = mace_time_us();
     mace_post_build(NULL);
+    memset(&stats, 0, sizeof(stats));
+    memset(&util,  0, sizeof(util));
 
     /* --- 1. Initialize variables --- */
     target_num      = 0;
@@ -6517,6 +11971,14 @@ void mace_pre_user(const Mace_Args *args) {
     
     mace_default_target_hash = 0ul;
     mace_default_config_hash = 0ul;
+    linker_ok                = -1;
+
+    /* -- Default pools, compile limit set post-user -- */
+    memset(pools, 0, sizeof(pools));
+    pool_num = MACE_POOL_DEFAULT_NUM;
+    pools[MACE_POOL_COMPILE].hash   = mace_hash("compile");
+    pools[MACE_POOL_LINK].hash      = mace_hash("link");
+    pools[MACE_POOL_LINK].limit     = MACE_LINK_JOBS_DEFAULT;
 
     /* --- 2. Set switches --- */
     if (args != NULL) {
@@ -6524,6 +11986,12 @@ void mace_pre_user(const Mace_Args *args) {
         dry_run        = args->dry_run;
         verbose        = dry_run ? true : args->debug;
         build_all      = args->build_all;
+        report         = args->report;
+        explain        = args->explain;
+        no_plan        = args->no_plan;
+        jobs_min       = args->jobs_min;
+        if (args->trace != NULL)
+            mace_trace_open(args->trace);
     }
 
     /* --- 3. Record cwd --- */
@@ -6542,6 +12010,10 @@ void mace_pre_user(const Mace_Args *args) {
     /* --- 5. Default output folders --- */
     mace_set_build_dir(MACE_DEFAULT_BUILD_DIR);
     mace_set_obj_dir(MACE_DEFAULT_OBJ_DIR);
+
+    /* --- 6. User mace() starts now --- */
+    stats.start     = mace_time_us();
+    stats.pre_user  = stats.start - start;
 }
 
 /*  Prepare for build after user added */
@@ -6556,7 +12028,7 @@ void mace_post_user(const Mace_Args *args) {
     /*      b- config */
     /*      c- macefile */
     /*   6- Computes default target order from default target_hash. */
-    /*   7- Allocs queue for processes. */
+    /*   7- Resolves pools, allocs queue for processes. */
     /*   8- Overrides compiler with priority: */
     /*      a- input argument */
     /*      b- config */
@@ -6567,6 +12039,9 @@ void mace_post_user(const Mace_Args *args) {
     /*      c- macefile */
     /*   10- Checks that compiler and archiver are set. */
     Config *config;
+    u64     start = mace_time_us();
+
+    stats.user = start - stats.start;
 
     /* 1. Move to args->dir */
     if ((args != NULL) && (args->dir != NULL)) {
@@ -6610,12 +12085,17 @@ void mace_post_user(const Mace_Args *args) {
     mace_config_resolve(&targets[mace_target]);
     config = &configs[mace_config];
 
+    /* 7.b Instrumented objects, outputs apart */
+    if ((config_num > 0) && (config->pgo == MACE_PGO_GENERATE))
+        mace_pgo_dirs();
+
     /* 8. Process queue alloc */
     assert(args->jobs >= 1);
     assert(pqueue == NULL);
-    plen = args->jobs;
+    mace_pools_resolve(args, config);
     pqueue = calloc(plen, sizeof(*pqueue));
     MACE_MEMCHECK(pqueue);
+    mace_trace_slots(plen);
 
     /* 8.b Override compiler with config */
     mace_set_compiler(config->cc);
@@ -6628,11 +12108,21 @@ void mace_post_user(const Mace_Args *args) {
 
     /* 9.c Override archiver with input arguments */
     mace_set_archiver(args->ar);
+
+    /* 10. Jobserver, once compiler is known */
+    mace_jobserver_init(pools[MACE_POOL_COMPILE].limit,
+                        mace_jobserver_wanted());
+
+    stats.post_user = mace_time_us() - start;
 }
 
 void mace_post_build(Mace_Args *args) {
     int i;
 
+    /* --- 0. Print stats before targets freed --- */
+    if ((args != NULL) && (args->stats != MACE_STATS_NONE))
+        mace_stats_print(args->stats);
+
     /* --- 1. Free everything --- */
     Mace_Args_Free(args);
     for (i = 0; i < target_num; i++) {
@@ -6645,6 +12135,15 @@ void mace_post_build(Mace_Args *args) {
     }
     MACE_FREE(configs);
     MACE_FREE(pqueue);
+    pnum = 0;
+    mace_jobserver_free();
+    mace_trace_close();
+    MACE_FREE(hdrs_checked);
+    hdrs_checked_num = 0;
+    hdrs_checked_len = 0;
+    memset(&jobs_sample, 0, sizeof(jobs_sample));
+    memset(pools, 0, sizeof(pools));
+    pool_num = 0;
     MACE_FREE(object);
     MACE_FREE(obj_dir);
     MACE_FREE(build_dir);
@@ -6813,17 +12312,49 @@ char *mace_checksum_filename(const char *file, int mode) {
 void mace_checksum_w(Mace_Checksum *checksum) {
     MACE_EARLY_RET(checksum->file == NULL, MACE_VOID, assert);
 
-    checksum->file = fopen(checksum->checksum_path, "wb");
-    if (checksum->file == NULL) {
-        fprintf(stderr,
-                "Could not write to checksum file '%s'\n",
-                checksum->checksum_path);
-        exit(1);
+    mace_checksum_write(checksum->checksum_path, checksum->hash_current);
+}
+
+/*  Write checksum file, never half-written. */
+void mace_checksum_write(const char *checksum_path,
+                         const u8 *hash) {
+    mace_file_write(checksum_path, hash, SHA1DC_LEN);
+}
+
+/*  Write data to temporary file, renamed */
+/*         over file: never half-written. */
+/*      - Relative paths from cwd, any dir */
+void mace_file_write(const char *file_path,
+                     const void *data,
+                     size_t size) {
+    char *path;
+    char *temp;
+    FILE *file;
+
+    if (file_path[0] == '/') {
+        path = mace_str_buffer(file_path);
+    } else {
+        path = calloc(strlen(cwd) + strlen(file_path) + 2, sizeof(*path));
+        MACE_MEMCHECK(path);
+        sprintf(path, "%s/%s", cwd, file_path);
     }
+    temp = calloc(strlen(path) + 5, sizeof(*temp));
+    MACE_MEMCHECK(temp);
+    sprintf(temp, "%s.tmp", path);
 
-    fwrite(checksum->hash_current, 1, SHA1DC_LEN, checksum->file);
-    fclose(checksum->file);
-    checksum->file = NULL;
+    file = fopen(temp, "wb");
+    if (file == NULL) {
+        fprintf(stderr, "Could not write to file '%s'\n", temp);
+        exit(1);
+    }
+    fwrite(data, 1, size, file);
+    fclose(file);
+    if (rename(temp, path) != 0) {
+        fprintf(stderr, "Could not rename '%s' to '%s'\n", temp, path);
+        exit(1);
+    }
+    MACE_FREE(temp);
+    MACE_FREE(path);
 }
 
 void mace_checksum_r(Mace_Checksum *checksum) {
@@ -6845,11 +12376,13 @@ void mace_checksum_r(Mace_Checksum *checksum) {
 }
 
 b32 mace_file_changed(const char *checksum_path,
-                      const char *file_path) {
+                      const char *file_path,
+                      u8 *staged) {
     /* Returns true if
     **      1. hash changed.
     **      2. file didn't exist.
-    ** Also writes new checksum file if changed */
+    ** Also writes new checksum file if changed,
+    ** or copies it to staged if not NULL */
     Mace_Checksum checksum  = {0};
     checksum.checksum_path  = checksum_path;
     checksum.file_path      = file_path;
@@ -6857,8 +12390,11 @@ b32 mace_file_changed(const char *checksum_path,
 
     /* --- Did checksum file exist? --- */
     mace_checksum(&checksum);
+    if (staged != NULL)
+        memcpy(staged, checksum.hash_current, SHA1DC_LEN);
     if (checksum.file == NULL) {
-        mace_checksum_w(&checksum); 
+        if (!report && (staged == NULL))
+            mace_checksum_w(&checksum); 
         return (true);
     }
 
@@ -6869,7 +12405,8 @@ b32 mace_file_changed(const char *checksum_path,
             fclose(checksum.file);
             checksum.file = NULL;
         } 
-        mace_checksum_w(&checksum);
+        if (!report && (staged == NULL))
+            mace_checksum_w(&checksum);
 
         return (true);
     }
@@ -6905,6 +12442,7 @@ void mace_checksum(Mace_Checksum *checksum) {
     while (true) {
         size = fread(buffer, 1, (USHRT_MAX + 1), file);
         SHA1DCUpdate(&ctx2, buffer, (unsigned)(size));
+        stats.bytes_hashed += size;
         if (size != (USHRT_MAX + 1))
             break;
     }
@@ -6917,6 +12455,8 @@ void mace_checksum(Mace_Checksum *checksum) {
         exit(1);
     }
 
+    stats.files_hashed++;
+
     /* - check for collision - */
     foundcollision = SHA1DCFinal(checksum->hash_current, &ctx2);
 
@@ -6938,11 +12478,17 @@ static struct parg_opt longopts[] = {
     {"directory",   PARG_REQARG, 0, 'C', "DIR",  "Move to directory before anything else"},
     {"cc",          PARG_REQARG, 0, 'c', "CC",   "Override C compiler"},
     {"debug",       PARG_NOARG,  0, 'd', NULL,   "Print debug info"},
+    {"explain",     PARG_NOARG,  0, 'E', NULL,   "Print why objects recompile, targets relink"},
     {"config",      PARG_REQARG, 0, 'g', "NAME", "Name of config"},
     {"help",        PARG_NOARG,  0, 'h', NULL,   "Display help and exit"},
     {"jobs",        PARG_REQARG, 0, 'j', "INT",  "Allow N jobs at once"},
+    {"jobs-min",    PARG_REQARG, 0, 'J', "INT",  "Keep N jobs at once, despite load or memory"},
     {"dry-run",     PARG_NOARG,  0, 'n', NULL,   "Don't build, just echo commands"},
+    {"pool",        PARG_REQARG, 0, 'P', "NAME=INT", "Allow N jobs at once in pool"},
+    {"report",      PARG_NOARG,  0, 'R', NULL,   "Report slowest objects, regressions, don't build"},
     {"silent",      PARG_NOARG,  0, 's', NULL,   "Don't echo commands"},
+    {"stats",       PARG_OPTARG, 0, 'S', "json", "Print phase times, counters after build"},
+    {"trace",       PARG_REQARG, 0, 'T', "FILE", "Write Chrome trace-event JSON of build"},
     {"version",     PARG_NOARG,  0, 'v', NULL,   "Display version and exit"},
     {NULL,          PARG_NOARG,  0,  0,  NULL,   "Convenience executable options:"},
     {"file",        PARG_REQARG, 0, 'f', "FILE", "Specify input macefile. Defaults to macefile.c"},
@@ -6955,13 +12501,20 @@ Mace_Args Mace_Args_default = {
     /* .dir                = */ NULL,
     /* .cc                 = */ NULL,
     /* .ar                 = */ NULL,
+    /* .pools              = */ NULL,
+    /* .trace              = */ NULL,
     /* .user_target_hash   = */ 0,
     /* .user_config_hash   = */ 0,
     /* .jobs               = */ MACE_JOBS_DEFAULT,
+    /* .jobs_min           = */ MACE_JOBS_MIN_DEFAULT,
+    /* .stats              = */ MACE_STATS_NONE,
     /* .debug              = */ false,
     /* .silent             = */ false,
     /* .dry_run            = */ false,
     /* .build_all          = */ false,
+    /* .report             = */ false,
+    /* .explain            = */ false,
+    /* .no_plan            = */ false,
 };
 
 /*  Compare user flag input arguments */
@@ -6978,13 +12531,20 @@ Mace_Args mace_combine_args_env(Mace_Args user,
     b32 _dir               = (user.dir              != Mace_Args_default.dir);
     b32 _cc                = (user.cc               != Mace_Args_default.cc);
     b32 _ar                = (user.ar               != Mace_Args_default.cc);
+    b32 _pools             = (user.pools            != Mace_Args_default.pools);
+    b32 _trace             = (user.trace            != Mace_Args_default.trace);
     b32 _user_target_hash  = (user.user_target_hash != Mace_Args_default.user_target_hash);
     b32 _user_config_hash  = (user.user_config_hash != Mace_Args_default.user_config_hash);
     b32 _jobs              = (user.jobs             >= 1);
+    b32 _jobs_min          = (user.jobs_min         != Mace_Args_default.jobs_min);
+    b32 _stats             = (user.stats            != Mace_Args_default.stats);
     b32 _debug             = (user.debug            != Mace_Args_default.debug);
     b32 _silent            = (user.silent           != Mace_Args_default.silent);
     b32 _dry_run           = (user.dry_run          != Mace_Args_default.dry_run);
     b32 _build_all         = (user.build_all        != Mace_Args_default.build_all);
+    b32 _report            = (user.report           != Mace_Args_default.report);
+    b32 _explain           = (user.explain          != Mace_Args_default.explain);
+    b32 _no_plan           = (user.no_plan          != Mace_Args_default.no_plan);
 
     out.user_target      = _user_target      ? user.user_target      : env.user_target;
     out.macefile         = _macefile         ? user.macefile         : env.macefile;
@@ -6992,13 +12552,20 @@ Mace_Args mace_combine_args_env(Mace_Args user,
     out.dir              = _dir              ? user.dir              : env.dir;
     out.cc               = _cc               ? user.cc               : env.cc;
     out.ar               = _ar               ? user.ar               : env.ar;
+    out.pools            = _pools            ? user.pools            : env.pools;
+    out.trace            = _trace            ? user.trace            : env.trace;
     out.user_target_hash = _user_target_hash ? user.user_target_hash : env.user_target_hash;
     out.user_config_hash = _user_config_hash ? user.user_config_hash : env.user_config_hash;
     out.jobs             = _jobs             ? user.jobs             : env.jobs;
+    out.jobs_min         = _jobs_min         ? user.jobs_min         : env.jobs_min;
+    out.stats            = _stats            ? user.stats            : env.stats;
     out.debug            = _debug            ? user.debug            : env.debug;
     out.silent           = _silent           ? user.silent           : env.silent;
     out.dry_run          = _dry_run          ? user.dry_run          : env.dry_run;
     out.build_all        = _build_all        ? user.build_all        : env.build_all;
+    out.report           = _report           ? user.report           : env.report;
+    out.explain          = _explain          ? user.explain          : env.explain;
+    out.no_plan          = _no_plan          ? user.no_plan          : env.no_plan;
     return (out);
 }
 
@@ -7041,7 +12608,7 @@ Mace_Args mace_parse_args(int argc, char *argv[]) {
     MACE_EARLY_RET(argc > 1, out_args, MACE_nASSERT);
 
     while ((c = parg_getopt_long(&ps, argc, argv,
-                                 "a:Bc:C:df:g:hj:no:sv",
+                                 "a:Bc:C:dEf:g:hj:J:no:P:RsS::T:v",
                                  longopts, &longindex)) != -1) {
         switch (c) {
             case 1:
@@ -7071,6 +12638,9 @@ Mace_Args mace_parse_args(int argc, char *argv[]) {
             case 'd':
                 out_args.debug = true;
                 break;
+            case 'E':
+                out_args.explain = true;
+                break;
             case 'f': {
                 len = strlen(ps.optarg);
                 out_args.macefile = calloc(len + 1, sizeof(*out_args.macefile));
@@ -7093,12 +12663,48 @@ Mace_Args mace_parse_args(int argc, char *argv[]) {
                     fprintf(stderr, "Set number of jobs above 1.\n");
                 }
                 break;
+            case 'J':
+                out_args.jobs_min = atoi(ps.optarg);
+                if (out_args.jobs_min < 1) {
+                    fprintf(stderr, "Set minimum number of jobs above 1.\n");
+                    out_args.jobs_min = MACE_JOBS_MIN_DEFAULT;
+                }
+                break;
             case 'n':
                 out_args.dry_run = true;
                 break;
+            case 'P': {
+                /* Pools accumulate, space separated */
+                size_t prev = (out_args.pools != NULL) ? strlen(out_args.pools) : 0;
+                len = strlen(ps.optarg);
+                out_args.pools = realloc(out_args.pools, prev + len + 2);
+                MACE_MEMCHECK(out_args.pools);
+                if (prev > 0)
+                    out_args.pools[prev++] = ' ';
+                memcpy(out_args.pools + prev, ps.optarg, len + 1);
+                break;
+            }
+            case 'R':
+                out_args.report = true;
+                break;
             case 's':
                 out_args.silent = true;
                 break;
+            case 'S':
+                out_args.stats = MACE_STATS_TEXT;
+                if (ps.optarg == NULL)
+                    break;
+                if (strcmp(ps.optarg, "json") != 0) {
+                    fprintf(stderr, "Unknown stats format '%s'. Use 'json'.\n", ps.optarg);
+                    exit(1);
+                }
+                out_args.stats = MACE_STATS_JSON;
+                break;
+            case 'T':
+                len = strlen(ps.optarg);
+                out_args.trace = calloc(len + 1, sizeof(*out_args.trace));
+                strncpy(out_args.trace, ps.optarg, len);
+                break;
             case 'v':
                 printf("mace version %s\n", MACE_VER_STRING);
                 exit(0);
@@ -7111,6 +12717,12 @@ Mace_Args mace_parse_args(int argc, char *argv[]) {
                     printf("option -a/--ar requires an argument\n");
                 } else if (ps.optopt == 'j') {
                     printf("option -j/--jobs requires an argument\n");
+                } else if (ps.optopt == 'J') {
+                    printf("option -J/--jobs-min requires an argument\n");
+                } else if (ps.optopt == 'P') {
+                    printf("option -P/--pool requires an argument\n");
+                } else if (ps.optopt == 'T') {
+                    printf("option -T/--trace requires an argument\n");
                 } else if (ps.optopt == 'f') {
                     printf("option -f/--file requires an argument\n");
                 } else {
@@ -7137,6 +12749,8 @@ void Mace_Args_Free(Mace_Args *args) {
     MACE_FREE(args->dir);
     MACE_FREE(args->cc);
     MACE_FREE(args->ar);
+    MACE_FREE(args->pools);
+    MACE_FREE(args->trace);
 }
 
 /*  Automatic usage/help printing */
@@ -7157,7 +12771,8 @@ void mace_parg_usage(const char              *name,
     }
     printf("Usage: %s [TARGET] [OPTIONS]\n", name);
     for (i = 0; longopts[i].doc; ++i) {
-        if ((i >= 11) && !is_mace) {
+        /* Convenience executable options after header */
+        if (!longopts[i].name && !longopts[i].val && !is_mace) {
             break;
         }
         if (longopts[i].val)
@@ -7221,6 +12836,7 @@ int main(int argc, char *argv[]) {
     return (0);
 }
 #endif /* MACE_OVERRIDE_MAIN */
+#endif /* MACE_LIBRARY */
 
 /*----------------------------------------------*/
 /*               MACE SOURCE END                */
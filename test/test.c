@@ -17,6 +17,7 @@
 
 #include "../mace.h"
 #include <fcntl.h>
+#include <utime.h>
 
 /* --- Testing library --- */
 #ifndef __NOURSTEST_H__
@@ -76,6 +77,21 @@ static void nourstest_run(char *name, void (*test)(void)) {
 #endif /*__NOURSTEST_H__ */
 
 #define BUILDDIR "build/"
+
+/* --- Fixture: user phase with test directories --- */
+void test_fixture(Mace_Args *args) {
+    mace_pre_user(args);
+    mace_set_obj_dir(MACE_TEST_OBJ_DIR);
+    mace_set_build_dir(MACE_TEST_BUILD_DIR);
+    mace_set_separator(' ');
+}
+
+/* --- Fixture: post-user, pre-build of target --- */
+void test_fixture_prebuild(Mace_Args *args, int target) {
+    mace_default_target = target;
+    mace_post_user(args);
+    mace_pre_build();
+}
 /* TODO: test multiple commands in pre/post commands */
 /* with separator e.g. && */
 void test_isFunc(void) {
@@ -91,10 +107,11 @@ void test_isFunc(void) {
 void test_globbing(void) {
     glob_t globbed;
     globbed = mace_glob_sources(MACE_ROOT"*.c");
-    nourstest_true(globbed.gl_pathc == 3);
+    nourstest_true(globbed.gl_pathc == 4);
     nourstest_true(strcmp(globbed.gl_pathv[0], MACE_ROOT"convenience_executable.c") == 0);
     nourstest_true(strcmp(globbed.gl_pathv[1], MACE_ROOT"example_macefile.c") == 0);
     nourstest_true(strcmp(globbed.gl_pathv[2], MACE_ROOT"installer_macefile.c") == 0);
+    nourstest_true(strcmp(globbed.gl_pathv[3], MACE_ROOT"libmace.c") == 0);
     globfree(&globbed);
 
     globbed = mace_glob_sources(MACE_ROOT"*.h");
@@ -660,6 +677,34 @@ void test_post_user(void) {
     mace_post_build(&args);
 }
 
+void test_pid_status(void) {
+    pid_t pid;
+    int status = 0;
+
+    /* mace exits if process killed by signal */
+    pid = fork();
+    if (pid < 0) {
+        perror("Error: forking issue. \n");
+        exit(1);
+    } else if (pid == 0) {
+        int   killed;
+        int   fd = open("/dev/null", O_WRONLY | O_CREAT, 0666);
+        pid_t child;
+        dup2(fd, fileno(stderr));
+        dup2(fd, fileno(stdout));
+        child = fork();
+        if (child == 0)
+            abort();
+        waitpid(child, &killed, 0);
+        mace_pid_status(killed);
+        close(fd);
+        exit(0);
+    }
+    nourstest_true(waitpid(pid, &status, 0) > 0);
+    nourstest_true(WIFEXITED(status));
+    nourstest_true(WEXITSTATUS(status) != 0);
+}
+
 void test_separator(void) {
     int pid;
     int status;
@@ -1479,8 +1524,9 @@ void test_config_global(void) {
     Config debug    = {0};
     Config release  = {0};
 
-    release.flags   = "-pie -O2";
-    debug.flags     = "-g -O0";
+    release.flags       = "-pie,-O2";
+    release.split_dwarf = true;
+    debug.flags         = "-g -O0";
     mace_pre_user(NULL);
 
     mace_set_obj_dir(MACE_TEST_OBJ_DIR);
@@ -1508,6 +1554,14 @@ void test_config_global(void) {
     mace_parse_config(&configs[0]);
     nourstest_true(config_num == 2);
     assert(configs[0].private._flags[0] != NULL);
+
+    /* -- Added flags are their own tokens -- */
+    mace_parse_config(&configs[1]);
+    nourstest_true(configs[1].private._flag_num == 3);
+    nourstest_true(strcmp(configs[1].private._flags[1], "-O2") == 0);
+    nourstest_true(strcmp(configs[1].private._flags[2], "-gsplit-dwarf") == 0);
+    /* Name kept for config commands */
+    nourstest_true(strcmp(configs[1].private._name, "release") == 0);
     mace_post_build(NULL);
 }
 
@@ -1557,6 +1611,1609 @@ void test_target_no_includes(void) {
     silent = false;
 }
 
+void test_schedule(void) {
+    Target tnecs    = {0};
+    Target A        = {0};
+    Target B        = {0};
+    Target C        = {0};
+    Mace_Args args  = Mace_Args_default;
+    Mace_Record record;
+    char *obj1;
+    char *obj2;
+
+    mace_post_build(NULL);
+    args.silent = true;
+    test_fixture(&args);
+
+    /* --- Longest recorded compile time first --- */
+    tnecs.sources            = "test1.c test2.c";
+    tnecs.base_dir           = ".";
+    tnecs.kind               = MACE_STATIC_LIBRARY;
+    MACE_ADD_TARGET(tnecs);
+    test_fixture_prebuild(&args, 0);
+    nourstest_true(targets[0].private._compile_num == 2);
+
+    obj1 = targets[0].private._argv_objects[0] + 2;
+    obj2 = targets[0].private._argv_objects[1] + 2;
+    record.duration =  10;
+    record.rss      = 100;
+    mace_record_write(obj1, &record);
+    record.duration = 500;
+    record.rss      =   0;
+    mace_record_write(obj2, &record);
+    mace_record_read(obj1, &record);
+    nourstest_true(record.duration ==  10);
+    nourstest_true(record.rss      == 100);
+    mace_record_read(obj2, &record);
+    nourstest_true(record.duration == 500);
+
+    mace_schedule();
+    nourstest_true(targets[0].private._compile_num      == 2);
+    nourstest_true(targets[0].private._compile_order[0] == 1);
+    nourstest_true(targets[0].private._compile_order[1] == 0);
+    nourstest_true(targets[0].private._cost             == 500);
+    /* Unknown memory is largest known */
+    nourstest_true(targets[0].private._rss[0]           == 100);
+    nourstest_true(targets[0].private._rss[1]           == 100);
+    mace_post_build(NULL);
+
+    /* --- Longest critical path first --- */
+    mace_pre_user(&args);
+    A.sources   = "a.c";
+    A.kind      = MACE_STATIC_LIBRARY;
+    B.sources   = "b.c";
+    B.kind      = MACE_STATIC_LIBRARY;
+    C.sources   = "c.c";
+    C.links     = "A";
+    C.kind      = MACE_EXECUTABLE;
+    MACE_ADD_TARGET(A);
+    MACE_ADD_TARGET(B);
+    MACE_ADD_TARGET(C);
+    build_order[0]  = 0;
+    build_order[1]  = 1;
+    build_order[2]  = 2;
+    build_order_num = 3;
+    targets[0].private._cost =   1;
+    targets[1].private._cost =  10;
+    targets[2].private._cost = 100;
+
+    /* A -> C is critical path, B is not */
+    mace_build_order_critical();
+    nourstest_true(build_order[0] == 0);
+    nourstest_true(build_order[1] == 2);
+    nourstest_true(build_order[2] == 1);
+
+    mace_post_build(NULL);
+    silent = false;
+}
+
+void test_pools(void) {
+    Target tnecs    = {0};
+    Config debug    = {0};
+    Mace_Args args  = Mace_Args_default;
+    char *argv[]    = {"builder", "-P", "link=2", "--pool", "heavy=4"};
+    char *argv_true[] = {"true", NULL};
+    pid_t pid;
+
+    /* --- Input arguments accumulate --- */
+    args = mace_parse_args(5, argv);
+    nourstest_true(args.pools != NULL);
+    nourstest_true(strcmp(args.pools, "link=2 heavy=4") == 0);
+    Mace_Args_Free(&args);
+
+    /* --- Default pools --- */
+    mace_post_build(NULL);
+    args        = Mace_Args_default;
+    args.silent = true;
+    args.jobs   = 3;
+    mace_pre_user(&args);
+    nourstest_true(pool_num == 2);
+    nourstest_true(pools[MACE_POOL_LINK].limit == MACE_LINK_JOBS_DEFAULT);
+    nourstest_true(mace_pool_order(mace_hash("compile")) == MACE_POOL_COMPILE);
+    nourstest_true(mace_pool_order(mace_hash("heavy"))   == MACE_POOL_NULL);
+
+    /* --- Priority: args > config > macefile --- */
+    MACE_SET_POOL(heavy, 8);
+    MACE_SET_POOL(link,  8);
+    nourstest_true(pool_num == 3);
+    debug.flags = "-g";
+    debug.pools = "link=1 heavy=4";
+    MACE_ADD_CONFIG(debug);
+    args.pools  = "heavy=2";
+
+    tnecs.sources       = "tnecs.c";
+    tnecs.compile_pool  = "heavy";
+    tnecs.kind          = MACE_STATIC_LIBRARY;
+    MACE_ADD_TARGET(tnecs);
+    mace_default_target = 0;
+    mace_post_user(&args);
+    nourstest_true(pools[MACE_POOL_COMPILE].limit  == 3);
+    nourstest_true(pools[MACE_POOL_LINK].limit     == 1);
+    nourstest_true(pools[2].limit                  == 2);
+    nourstest_true(plen                            == 6);
+    nourstest_true(targets[0].private._compile_pool == 2);
+    nourstest_true(targets[0].private._link_pool    == MACE_POOL_LINK);
+
+    /* --- Process counted in its pool only --- */
+    pid = mace_exec("true", argv_true);
+    mace_pqueue_put(pid, &targets[0], MACE_PROCESS_LINK, 0, 2, 0);
+    nourstest_true(pools[2].num == 1);
+    nourstest_true(pools[MACE_POOL_COMPILE].num == 0);
+    nourstest_true( mace_pqueue_busy(&targets[0], true));
+    nourstest_true(!mace_pqueue_busy(&targets[0], false));
+    mace_Target_wait(&targets[0], true);
+    nourstest_true(pools[2].num == 0);
+    nourstest_true(pnum         == 0);
+
+    /* --- Pre-compile waits on its target's processes only --- */
+    pid = mace_exec("true", argv_true);
+    mace_pqueue_put(pid, NULL, MACE_PROCESS_PRECOMPILE, 0, MACE_POOL_COMPILE, 0);
+    nourstest_true( mace_pqueue_running(NULL, MACE_PROCESS_PRECOMPILE));
+    nourstest_true(!mace_pqueue_running(NULL, MACE_PROCESS_COMPILE));
+    nourstest_true(!mace_pqueue_running(&targets[0], MACE_PROCESS_PRECOMPILE));
+    mace_pqueue_drain();
+    nourstest_true(!mace_pqueue_running(NULL, MACE_PROCESS_PRECOMPILE));
+
+    args.pools = NULL;
+    mace_post_build(NULL);
+    silent = false;
+}
+
+void test_jobs(void) {
+    Target tnecs    = {0};
+    Mace_Args args  = Mace_Args_default;
+    char *argv[]    = {"builder", "-J", "3"};
+    char *argv_true[] = {"true", NULL};
+    u64 huge        = ULONG_MAX / 2;
+    u64 sampled;
+    pid_t pid;
+
+    args = mace_parse_args(3, argv);
+    nourstest_true(args.jobs_min == 3);
+    Mace_Args_Free(&args);
+
+    mace_post_build(NULL);
+    args        = Mace_Args_default;
+    args.silent = true;
+    mace_pre_user(&args);
+    nourstest_true(jobs_min == MACE_JOBS_MIN_DEFAULT);
+    tnecs.sources   = "tnecs.c";
+    tnecs.kind      = MACE_STATIC_LIBRARY;
+    MACE_ADD_TARGET(tnecs);
+    mace_default_target = 0;
+    mace_post_user(&args);
+
+    /* --- No job running: always admitted --- */
+    nourstest_true(mace_jobs_admit(huge));
+
+    /* --- Memory full: wait, unless under jobs_min --- */
+    pid = mace_exec("true", argv_true);
+    mace_pqueue_put(pid, NULL, MACE_PROCESS_PRECOMPILE, 0, MACE_POOL_COMPILE, 0);
+    if (mace_mem_available() > 0) {
+        nourstest_true(!mace_jobs_admit(huge));
+        jobs_min = 2;
+        nourstest_true(mace_jobs_admit(huge));
+    }
+
+    /* --- Load, memory sampled once per interval --- */
+    jobs_min = MACE_JOBS_MIN_DEFAULT;
+    mace_jobs_admit(huge);
+    nourstest_true(jobs_sample.time > 0);
+    sampled = jobs_sample.time;
+    mace_jobs_admit(huge);
+    nourstest_true(jobs_sample.time == sampled);
+    jobs_sample.time = mace_time_us() - MACE_JOBS_SAMPLE;
+    mace_jobs_admit(huge);
+    nourstest_true(jobs_sample.time > sampled);
+    mace_pqueue_drain();
+    nourstest_true(pnum == 0);
+
+    mace_post_build(NULL);
+    jobs_min    = MACE_JOBS_MIN_DEFAULT;
+    silent      = false;
+}
+
+void test_jobserver(void) {
+    Target tnecs    = {0};
+    Mace_Args args  = Mace_Args_default;
+    char *argv_true[]   = {"true", NULL};
+    char *argv_sleep[]  = {"sleep", "0.2", NULL};
+    int  fds[2];
+    int  token1;
+    int  token2;
+    char auth[64];
+    pid_t pid;
+
+    /* --- Server: jobs - 1 tokens, exported --- */
+    unsetenv("MAKEFLAGS");
+    pnum = 1;
+    nourstest_true(mace_jobserver_server(3));
+    nourstest_true(getenv("MAKEFLAGS") != NULL);
+    nourstest_true(strstr(getenv("MAKEFLAGS"), "-j3 --jobserver-auth=") != NULL);
+    nourstest_true(mace_jobserver_acquire());
+    token1 = jobserver.held;
+    jobserver.held = -1;
+    nourstest_true(token1 == '+');
+    nourstest_true(mace_jobserver_acquire());
+    token2 = jobserver.held;
+    jobserver.held = -1;
+    nourstest_true(!mace_jobserver_acquire());
+    mace_jobserver_release(token1);
+    mace_jobserver_release(token2);
+    mace_jobserver_free();
+    nourstest_true(getenv("MAKEFLAGS") == NULL);
+
+    /* --- Client: parent's pipe --- */
+    nourstest_true(pipe(fds) == 0);
+    nourstest_true(write(fds[1], "ab", 2) == 2);
+    sprintf(auth, "-j4 --jobserver-fds=0,0 --jobserver-auth=%d,%d", fds[0], fds[1]);
+    nourstest_true(mace_jobserver_client(auth));
+    nourstest_true(mace_jobserver_acquire());
+    nourstest_true(jobserver.held == 'a');
+    /* Held token used by next job */
+    nourstest_true(mace_jobserver_acquire());
+    nourstest_true(jobserver.held == 'a');
+    mace_jobserver_free();
+    nourstest_true(read(fds[0], auth, 2) == 2);
+    nourstest_true(auth[0] == 'b');
+    nourstest_true(auth[1] == 'a');
+    close(fds[0]);
+    close(fds[1]);
+
+    /* --- First job uses implicit token --- */
+    pnum = 0;
+    nourstest_true(!mace_jobserver_client("-j4"));
+    nourstest_true(mace_jobserver_acquire());
+
+    /* --- Served only if children can use tokens --- */
+    mace_post_build(NULL);
+    args        = Mace_Args_default;
+    args.silent = true;
+    args.jobs   = 3;
+    test_fixture(&args);
+    tnecs.sources   = "tnecs.c";
+    tnecs.kind      = MACE_STATIC_LIBRARY;
+    MACE_ADD_TARGET(tnecs);
+    mace_default_target = 0;
+    mace_post_user(&args);
+    nourstest_true(!jobserver.server);
+    nourstest_true(getenv("MAKEFLAGS") == NULL);
+    nourstest_true( pools[MACE_POOL_LINK].link);
+    nourstest_true(!pools[MACE_POOL_COMPILE].link);
+
+    /* --- Queued processes reaped during serial wait --- */
+    pid = mace_exec("true", argv_true);
+    mace_pqueue_put(pid, NULL, MACE_PROCESS_PRECOMPILE, 0, MACE_POOL_COMPILE, 0);
+    mace_wait_pid(mace_exec("sleep", argv_sleep));
+    nourstest_true(pnum == 0);
+    mace_post_build(NULL);
+
+    /* --- Commands may run make: served --- */
+    test_fixture(&args);
+    tnecs.cmd_pre   = "true";
+    MACE_ADD_TARGET(tnecs);
+    mace_default_target = 0;
+    mace_post_user(&args);
+    nourstest_true(jobserver.server);
+    nourstest_true(getenv("MAKEFLAGS") != NULL);
+    mace_post_build(NULL);
+    nourstest_true(getenv("MAKEFLAGS") == NULL);
+    silent = false;
+}
+
+void test_batch(void) {
+    Target tnecs    = {0};
+    Mace_Args args  = Mace_Args_default;
+    FILE *fd;
+    char *obj_a;
+    char *obj_b;
+    int   shard;
+
+    mace_post_build(NULL);
+    args.silent = true;
+    test_fixture(&args);
+
+    /* --- Same filename in two directories --- */
+    mace_mkdir(MACE_TEST_OBJ_DIR);
+    mace_mkdir(MACE_TEST_OBJ_DIR"/batch");
+    mace_mkdir(MACE_TEST_OBJ_DIR"/batch/a");
+    mace_mkdir(MACE_TEST_OBJ_DIR"/batch/b");
+    mace_mkdir(MACE_TEST_OBJ_DIR"/batch/inc");
+    fd = fopen(MACE_TEST_OBJ_DIR"/batch/inc/batch.h", "w");
+    fprintf(fd, "#define BATCH_A 1\n");
+    fclose(fd);
+    fd = fopen(MACE_TEST_OBJ_DIR"/batch/a/dup.c", "w");
+    fprintf(fd, "#include \"batch.h\"\n");
+    fprintf(fd, "int dup_a(void) { return (BATCH_A); }\n");
+    fclose(fd);
+    fd = fopen(MACE_TEST_OBJ_DIR"/batch/a/other.c", "w");
+    fprintf(fd, "int other_a(void) { return (2); }\n");
+    fclose(fd);
+    fd = fopen(MACE_TEST_OBJ_DIR"/batch/b/dup.c", "w");
+    fprintf(fd, "int dup_b(void) { return (3); }\n");
+    fclose(fd);
+
+    tnecs.sources   = MACE_TEST_OBJ_DIR"/batch/a "MACE_TEST_OBJ_DIR"/batch/b";
+    tnecs.kind      = MACE_STATIC_LIBRARY;
+    tnecs.batch     = 2;
+    /* Relative to cwd, not object directory */
+    tnecs.flags     = "-I"MACE_TEST_OBJ_DIR"/batch/inc";
+    MACE_ADD_TARGET(tnecs);
+    test_fixture_prebuild(&args, 0);
+    nourstest_true(targets[0].private._compile_num == 3);
+
+    /* --- Objects mirror source directories --- */
+    obj_a = targets[0].private._argv_objects[0] + 2;
+    obj_b = targets[0].private._argv_objects[2] + 2;
+    nourstest_true(strstr(obj_a, "/"MACE_TEST_OBJ_DIR"/batch/a/dup.o") != NULL);
+    nourstest_true(strstr(obj_b, "/"MACE_TEST_OBJ_DIR"/batch/b/dup.o") != NULL);
+
+    /* --- Shards in ratio of weight, one directory each --- */
+    /* a: 2 sources, 2 shards. b: 1 source, 1 shard */
+    nourstest_true(targets[0].private._shard_num        == 3);
+    nourstest_true(targets[0].private._shard_start[0]   == 0);
+    nourstest_true(targets[0].private._shard_start[3]   == 3);
+    for (shard = 0; shard < 3; shard++) {
+        int start   = targets[0].private._shard_start[shard];
+        int end     = targets[0].private._shard_start[shard + 1];
+        int first   = targets[0].private._shard_sources[start];
+        char *dir   = strrchr(targets[0].private._argv_sources[first], '/') - 1;
+        int i;
+        for (i = start; i < end; i++) {
+            int src = targets[0].private._shard_sources[i];
+            char *d = strrchr(targets[0].private._argv_sources[src], '/') - 1;
+            nourstest_true(*d == *dir);
+        }
+    }
+
+    mace_build();
+    nourstest_true(access(obj_a, F_OK) == 0);
+    nourstest_true(access(obj_b, F_OK) == 0);
+
+    mace_post_build(NULL);
+    silent = false;
+}
+
+void test_unity(void) {
+    Target tnecs    = {0};
+    Mace_Args args  = Mace_Args_default;
+    FILE *fd;
+    int   i;
+    int   chunk;
+    int   num;
+    char  path[64];
+    char *chunks[8];
+
+    mace_mkdir(MACE_TEST_OBJ_DIR);
+    mace_mkdir(MACE_TEST_OBJ_DIR"/unity");
+    for (i = 0; i < 4; i++) {
+        sprintf(path, MACE_TEST_OBJ_DIR"/unity/%c.c", 'a' + i);
+        fd = fopen(path, "w");
+        fprintf(fd, "static int unity_s%d(void) { return (%d); }\n", i, i);
+        fprintf(fd, "int unity_%c(void) { return (unity_s%d()); }\n", 'a' + i, i);
+        fclose(fd);
+    }
+
+    /* --- First build: all chunks --- */
+    mace_post_build(NULL);
+    args.silent = true;
+    test_fixture(&args);
+    tnecs.sources   = MACE_TEST_OBJ_DIR"/unity";
+    tnecs.kind      = MACE_STATIC_LIBRARY;
+    tnecs.unity     = 2;
+    MACE_ADD_TARGET(tnecs);
+    test_fixture_prebuild(&args, 0);
+    num = targets[0].private._unity_num;
+    nourstest_true(num >= 1);
+    nourstest_true(num <= 2);
+    nourstest_true(targets[0].private._compile_num  == 4);
+    nourstest_true(targets[0].private._shard_num    == num);
+    mace_build();
+    for (i = 0; i < num; i++) {
+        nourstest_true(access(targets[0].private._unity_sources[i], F_OK) == 0);
+        nourstest_true(access(targets[0].private._unity_objects[i] + 2, F_OK) == 0);
+    }
+    nourstest_true(access(targets[0].private._argv_objects[0] + 2, F_OK) != 0);
+    mace_post_build(NULL);
+
+    /* --- Edit one source: only its chunk recompiles --- */
+    fd = fopen(MACE_TEST_OBJ_DIR"/unity/c.c", "a");
+    fprintf(fd, "int unity_c2(void) { return (5); }\n");
+    fclose(fd);
+    test_fixture(&args);
+    MACE_ADD_TARGET(tnecs);
+    test_fixture_prebuild(&args, 0);
+    nourstest_true(targets[0].private._unity_num == num);
+    nourstest_true(targets[0].private._shard_num == 1);
+    chunk = targets[0].private._unity_chunk[2];
+    for (i = 0; i < 4; i++) {
+        b32 same = targets[0].private._unity_chunk[i] == chunk;
+        nourstest_true(targets[0].private._recompiles[i] == same);
+    }
+    mace_build();
+    mace_post_build(NULL);
+
+    /* --- Add source: only its chunk recompiles --- */
+    fd = fopen(MACE_TEST_OBJ_DIR"/unity/e.c", "w");
+    fprintf(fd, "int unity_e(void) { return (4); }\n");
+    fclose(fd);
+    test_fixture(&args);
+    MACE_ADD_TARGET(tnecs);
+    test_fixture_prebuild(&args, 0);
+    nourstest_true(targets[0].private._argc_sources == 5);
+    nourstest_true(targets[0].private._shard_num == 1);
+    nourstest_true(targets[0].private._compile_num  <  5);
+    for (i = 0; i < 5; i++) {
+        if (strstr(targets[0].private._argv_sources[i], "/e.c") != NULL)
+            chunk = targets[0].private._unity_chunk[i];
+    }
+    for (i = 0; i < 5; i++) {
+        b32 same = targets[0].private._unity_chunk[i] == chunk;
+        nourstest_true(targets[0].private._recompiles[i] == same);
+    }
+    num = targets[0].private._unity_num;
+    nourstest_true(num >= 2);
+    for (i = 0; i < num; i++)
+        chunks[i] = mace_str_buffer(targets[0].private._unity_sources[i]);
+    mace_post_build(NULL);
+
+    /* --- Sources removed: their chunks' files deleted --- */
+    for (i = 1; i < 5; i++) {
+        sprintf(path, MACE_TEST_OBJ_DIR"/unity/%c.c", 'a' + i);
+        remove(path);
+    }
+    test_fixture(&args);
+    MACE_ADD_TARGET(tnecs);
+    test_fixture_prebuild(&args, 0);
+    nourstest_true(targets[0].private._unity_num == 1);
+    for (i = 0; i < num; i++) {
+        b32 kept = (strcmp(chunks[i], targets[0].private._unity_sources[0]) == 0);
+        nourstest_true((access(chunks[i], F_OK) == 0) == kept);
+        free(chunks[i]);
+    }
+
+    mace_post_build(NULL);
+    silent = false;
+}
+
+void test_pch(void) {
+    Target tnecs    = {0};
+    Mace_Args args  = Mace_Args_default;
+    FILE *fd;
+    int   i;
+
+    mace_mkdir(MACE_TEST_OBJ_DIR);
+    mace_mkdir(MACE_TEST_OBJ_DIR"/pchsrc");
+    fd = fopen(MACE_TEST_OBJ_DIR"/pchsrc/umbrella.h", "w");
+    fprintf(fd, "#ifndef UMBRELLA_H\n#define UMBRELLA_H\n");
+    fprintf(fd, "#include <stdio.h>\n#define UMBRELLA 1\n#endif\n");
+    fclose(fd);
+    for (i = 0; i < 2; i++) {
+        char path[64];
+        sprintf(path, MACE_TEST_OBJ_DIR"/pchsrc/%c.c", 'a' + i);
+        fd = fopen(path, "w");
+        fprintf(fd, "int pch_%c(void) { return (UMBRELLA); }\n", 'a' + i);
+        fclose(fd);
+    }
+
+    /* --- First build: pch, then sources --- */
+    mace_post_build(NULL);
+    args.silent = true;
+    test_fixture(&args);
+    tnecs.sources   = MACE_TEST_OBJ_DIR"/pchsrc";
+    tnecs.pch       = MACE_TEST_OBJ_DIR"/pchsrc/umbrella.h";
+    tnecs.kind      = MACE_STATIC_LIBRARY;
+    MACE_ADD_TARGET(tnecs);
+    test_fixture_prebuild(&args, 0);
+    nourstest_true(targets[0].private._pch_dirty);
+    nourstest_true(targets[0].private._argc_pch > 0);
+    nourstest_true(strcmp(targets[0].private._argv[targets[0].private._argc_pch], "-include") == 0);
+    nourstest_true(access(targets[0].private._argv[targets[0].private._argc_pch + 1], F_OK) == 0);
+    nourstest_true(strstr(targets[0].private._pch_out, "/pch/tnecs_pch.h.gch") != NULL);
+    mace_build();
+    nourstest_true(access(targets[0].private._pch_out, F_OK) == 0);
+    nourstest_true(access(targets[0].private._argv_objects[0] + 2, F_OK) == 0);
+    mace_post_build(NULL);
+
+    /* --- Nothing changed: no pch, no sources --- */
+    /* Pre-build, not skipped by build plan */
+    args.no_plan = true;
+    test_fixture(&args);
+    MACE_ADD_TARGET(tnecs);
+    test_fixture_prebuild(&args, 0);
+    nourstest_true(!targets[0].private._pch_dirty);
+    nourstest_true(targets[0].private._pch_deps_num >= 2);
+    nourstest_true(targets[0].private._compile_num == 0);
+    mace_post_build(NULL);
+
+    /* --- pch dependency changed: pch, all sources --- */
+    fd = fopen(MACE_TEST_OBJ_DIR"/pchsrc/umbrella.h", "a");
+    fprintf(fd, "/* changed */\n");
+    fclose(fd);
+    test_fixture(&args);
+    MACE_ADD_TARGET(tnecs);
+    test_fixture_prebuild(&args, 0);
+    nourstest_true(targets[0].private._pch_dirty);
+    nourstest_true(targets[0].private._compile_num == 2);
+
+    mace_post_build(NULL);
+    silent = false;
+}
+
+void test_trace(void) {
+    Target tnecs    = {0};
+    Mace_Args args  = Mace_Args_default;
+    char *argv[]    = {"builder", "--trace", MACE_TEST_OBJ_DIR"/trace.json"};
+    char *trace;
+    FILE *fd;
+    long  size;
+    int   i;
+    int   status = 0;
+    pid_t pid;
+
+    /* --- -T,--trace FILE --- */
+    args = mace_parse_args(3, argv);
+    nourstest_true(args.trace != NULL);
+    nourstest_true(strcmp(args.trace, MACE_TEST_OBJ_DIR"/trace.json") == 0);
+
+    mace_mkdir(MACE_TEST_OBJ_DIR);
+    mace_mkdir(MACE_TEST_OBJ_DIR"/trace");
+    for (i = 0; i < 2; i++) {
+        char path[64];
+        sprintf(path, MACE_TEST_OBJ_DIR"/trace/%c.c", 'a' + i);
+        fd = fopen(path, "w");
+        fprintf(fd, "int trace_%c(void) { return (%d); }\n", 'a' + i, i);
+        fclose(fd);
+    }
+
+    /* --- Build, tracing --- */
+    mace_post_build(NULL);
+    args.silent = true;
+    test_fixture(&args);
+    tnecs.sources   = MACE_TEST_OBJ_DIR"/trace/*.c";
+    tnecs.cmd_pre   = "true";
+    tnecs.kind      = MACE_STATIC_LIBRARY;
+    MACE_ADD_TARGET(tnecs);
+    mace_default_target = 0;
+    /* Link process: archiver not in-process */
+    mace_set_archiver("ar");
+    mace_post_user(&args);
+    mace_pre_build();
+    mace_build();
+    mace_post_build(&args);
+    mace_set_archiver(MACE_AR_BUILTIN);
+    nourstest_true(trace_file == NULL);
+
+    /* --- Slices of processes, spans of phases --- */
+    fd = fopen(MACE_TEST_OBJ_DIR"/trace.json", "rb");
+    nourstest_true(fd != NULL);
+    fseek(fd, 0L, SEEK_END);
+    size = ftell(fd);
+    fseek(fd, 0L, SEEK_SET);
+    trace = calloc(size + 1, sizeof(*trace));
+    fread(trace, 1, size, fd);
+    fclose(fd);
+    nourstest_true(strncmp(trace, "{\"traceEvents\":[", 16) == 0);
+    nourstest_true(strcmp(trace + size - 4, "\n]}\n") == 0);
+    nourstest_true(strstr(trace, "\"name\":\"slot 0\"")         != NULL);
+    nourstest_true(strstr(trace, "\"cat\":\"precompile\"")      != NULL);
+    nourstest_true(strstr(trace, "\"name\":\"a.c\",\"cat\":\"compile\"") != NULL);
+    nourstest_true(strstr(trace, "\"name\":\"tnecs\",\"cat\":\"link\"")  != NULL);
+    nourstest_true(strstr(trace, "\"cat\":\"cmd_pre\"")         != NULL);
+    nourstest_true(strstr(trace, "\"name\":\"glob\"")           != NULL);
+    nourstest_true(strstr(trace, "\"name\":\"checksum\"")       != NULL);
+    nourstest_true(strstr(trace, "\"name\":\"read .d, .ho\"")   != NULL);
+    nourstest_true(strstr(trace, "\"name\":\"build order\"")    != NULL);
+    free(trace);
+
+    /* --- Failed build: trace ended at exit --- */
+    fd = fopen(MACE_TEST_OBJ_DIR"/trace/fail.c", "w");
+    fprintf(fd, "int trace_fail(void) { return (; }\n");
+    fclose(fd);
+    remove(MACE_TEST_OBJ_DIR"/trace.json");
+    pid = fork();
+    if (pid < 0) {
+        perror("Error: forking issue. \n");
+        exit(1);
+    } else if (pid == 0) {
+        int fdn = open("/dev/null", O_WRONLY | O_CREAT, 0666);
+        dup2(fdn, fileno(stderr));
+        dup2(fdn, fileno(stdout));
+        args        = mace_parse_args(3, argv);
+        args.silent = true;
+        test_fixture(&args);
+        MACE_ADD_TARGET(tnecs);
+        test_fixture_prebuild(&args, 0);
+        mace_build();
+        exit(0);
+    }
+    nourstest_true(waitpid(pid, &status, 0) > 0);
+    nourstest_true(WEXITSTATUS(status) != 0);
+    fd = fopen(MACE_TEST_OBJ_DIR"/trace.json", "rb");
+    nourstest_true(fd != NULL);
+    fseek(fd, 0L, SEEK_END);
+    size = ftell(fd);
+    fseek(fd, 0L, SEEK_SET);
+    trace = calloc(size + 1, sizeof(*trace));
+    fread(trace, 1, size, fd);
+    fclose(fd);
+    nourstest_true(strcmp(trace + size - 4, "\n]}\n") == 0);
+    free(trace);
+    remove(MACE_TEST_OBJ_DIR"/trace/fail.c");
+    silent = false;
+}
+
+/*  Age objects of target: output linked in the */
+/*  same second as its objects is out of date */
+void test_age_objects(const Target *target) {
+    struct utimbuf   old;
+    char           **argv_objects;
+    int              argc_objects;
+    int              i;
+
+    old.actime  = time(NULL) - 10;
+    old.modtime = old.actime;
+    argv_objects = mace_Target_link_objects(target, &argc_objects);
+    for (i = 0; i < argc_objects; i++)
+        utime(argv_objects[i] + strlen("-o"), &old);
+}
+
+void test_stats(void) {
+    Target tnecs    = {0};
+    Mace_Args args  = Mace_Args_default;
+    char *argv[]    = {"builder", "--stats=json"};
+    char *argv_S[]  = {"builder", "-S"};
+    int   i;
+    int   run;
+
+    /* --- -S,--stats[=json] --- */
+    args = mace_parse_args(2, argv);
+    nourstest_true(args.stats == MACE_STATS_JSON);
+    args = mace_parse_args(2, argv_S);
+    nourstest_true(args.stats == MACE_STATS_TEXT);
+
+    mace_mkdir(MACE_TEST_OBJ_DIR);
+    mace_mkdir(MACE_TEST_OBJ_DIR"/stats");
+    for (i = 0; i < 2; i++) {
+        char  path[64];
+        FILE *fd;
+        sprintf(path, MACE_TEST_OBJ_DIR"/stats/%c.c", 'a' + i);
+        fd = fopen(path, "w");
+        fprintf(fd, "int stats_%c(void) { return (%d); }\n", 'a' + i, i);
+        fclose(fd);
+    }
+
+    /* --- Second build: objects, link skipped --- */
+    for (run = 0; run < 2; run++) {
+        args         = Mace_Args_default;
+        args.silent  = true;
+        /* Pre-build, not skipped by build plan */
+        args.no_plan = true;
+        mace_post_build(NULL);
+        test_fixture(&args);
+        tnecs.sources   = MACE_TEST_OBJ_DIR"/stats/*.c";
+        tnecs.kind      = MACE_STATIC_LIBRARY;
+        MACE_ADD_TARGET(tnecs);
+        test_fixture_prebuild(&args, 0);
+        mace_build();
+
+        nourstest_true(stats.files_hashed   >= 2);
+        nourstest_true(stats.bytes_hashed   >  0);
+        nourstest_true(stats.d_loads        == 2);
+        nourstest_true(stats.pre_build      >= targets[0].private._prebuild_time);
+        nourstest_true(targets[0].private._prebuild_time >=
+                       stats.pre_sources + stats.pre_depfiles +
+                       stats.pre_objdeps + stats.pre_headers);
+        /* -- Slot utilization stopped after build -- */
+        nourstest_true(util.last  == 0);
+        nourstest_true(util.cause == MACE_IDLE_DRAIN);
+        nourstest_true(util.idle[MACE_IDLE_PREBUILD] > 0);
+        if (run == 0) {
+            nourstest_true(stats.processes       > 2);
+            nourstest_true(stats.objects_skipped == 0);
+            nourstest_true(stats.links_skipped   == 0);
+            nourstest_true(targets[0].private._relinked);
+            nourstest_true(util.busy > 0);
+            test_age_objects(&targets[0]);
+        } else {
+            nourstest_true(stats.processes       == 0);
+            nourstest_true(stats.objects_skipped == 2);
+            nourstest_true(stats.links_skipped   == 1);
+            nourstest_true(!targets[0].private._relinked);
+        }
+        mace_post_build(&args);
+    }
+    silent = false;
+}
+
+void test_relink(void) {
+    Target tnecs    = {0};
+    Mace_Args args  = Mace_Args_default;
+    struct utimbuf old;
+    FILE *fd;
+    int   run;
+
+    mace_mkdir(MACE_TEST_OBJ_DIR);
+    mace_mkdir(MACE_TEST_OBJ_DIR"/relink");
+    fd = fopen(MACE_TEST_OBJ_DIR"/relink/main.c", "w");
+    fprintf(fd, "int main(void) { return (0); }\n");
+    fclose(fd);
+    /* Inputs older than build: plan can be fresh */
+    old.actime  = time(NULL) - 60;
+    old.modtime = old.actime;
+    utime(MACE_TEST_OBJ_DIR"/relink/main.c", &old);
+    utime(MACE_TEST_OBJ_DIR"/relink", &old);
+
+    /* --- Build, no-op, links changed through plan --- */
+    /* --- Plan ignored: link skipped, unchanged --- */
+    for (run = 0; run < 4; run++) {
+        args         = Mace_Args_default;
+        args.silent  = true;
+        args.no_plan = (run == 3);
+        mace_post_build(NULL);
+        test_fixture(&args);
+        tnecs.sources   = MACE_TEST_OBJ_DIR"/relink";
+        tnecs.links     = (run < 2) ? NULL : "m";
+        tnecs.kind      = MACE_EXECUTABLE;
+        MACE_ADD_TARGET(tnecs);
+        test_fixture_prebuild(&args, 0);
+        nourstest_true(stats.plan_fresh == (run == 1));
+        mace_build();
+
+        if (run == 1) {
+            nourstest_true(stats.processes == 0);
+            nourstest_true(!targets[0].private._relinked);
+        } else if (run == 2) {
+            nourstest_true(stats.objects_skipped == 1);
+            nourstest_true(stats.links_skipped   == 0);
+            nourstest_true(targets[0].private._relinked);
+            test_age_objects(&targets[0]);
+        } else if (run == 3) {
+            nourstest_true(stats.links_skipped   == 1);
+            nourstest_true(!targets[0].private._relinked);
+        }
+        mace_post_build(&args);
+    }
+    silent = false;
+}
+
+void test_report(void) {
+    Target tnecs    = {0};
+    Mace_Args args  = Mace_Args_default;
+    Mace_Record record  = {0};
+    Mace_Record records[MACE_RECORD_HISTORY];
+    char *argv[]    = {"builder", "--report"};
+    char  time_file[128];
+    char *obj;
+    char *checksum;
+    FILE *fd;
+    u32   legacy[2];
+    u32   fingerprint;
+    int   i;
+    int   run;
+
+    /* --- -R,--report --- */
+    args = mace_parse_args(2, argv);
+    nourstest_true(args.report);
+
+    mace_mkdir(MACE_TEST_OBJ_DIR);
+    mace_mkdir(MACE_TEST_OBJ_DIR"/report");
+    fd = fopen(MACE_TEST_OBJ_DIR"/report/report.c", "w");
+    fprintf(fd, "int report_a(void) { return (0); }\n");
+    fclose(fd);
+
+    /* --- Build records, then report without building --- */
+    for (run = 0; run < 2; run++) {
+        args        = Mace_Args_default;
+        args.silent = true;
+        args.report = (run == 1);
+        mace_post_build(NULL);
+        test_fixture(&args);
+        tnecs.sources   = MACE_TEST_OBJ_DIR"/report/*.c";
+        tnecs.kind      = MACE_STATIC_LIBRARY;
+        MACE_ADD_TARGET(tnecs);
+        test_fixture_prebuild(&args, 0);
+        mace_build();
+
+        obj = targets[0].private._argv_objects[0] + 2;
+        nourstest_true(mace_record_history(obj, records) == 1);
+        nourstest_true(records[0].status      == 0);
+        nourstest_true(records[0].fingerprint != 0);
+        fingerprint = records[0].fingerprint;
+        if (run == 1) {
+            /* -- Checksum kept: next build compiles edit -- */
+            checksum = mace_checksum_filename(targets[0].private._argv_objects[0],
+                                              MACE_CHECKSUM_MODE_SRC);
+            nourstest_true(mace_file_changed(checksum, MACE_TEST_OBJ_DIR"/report/report.c", NULL));
+            free(checksum);
+            break;
+        }
+        mace_post_build(&args);
+
+        /* -- Edit source: report must not compile it -- */
+        fd = fopen(MACE_TEST_OBJ_DIR"/report/report.c", "w");
+        fprintf(fd, "int report_a(void) { return (1); }\n");
+        fclose(fd);
+    }
+
+    /* --- History: newest first, oldest dropped --- */
+    for (i = 1; i <= MACE_RECORD_HISTORY + 2; i++) {
+        record.duration = i;
+        record.status   = (i % 2);
+        mace_record_write(obj, &record);
+    }
+    nourstest_true(mace_record_history(obj, records) == MACE_RECORD_HISTORY);
+    nourstest_true(records[0].duration == MACE_RECORD_HISTORY + 2);
+    nourstest_true(records[MACE_RECORD_HISTORY - 1].duration == 3);
+    nourstest_true(records[1].status   == 1);
+    mace_record_read(obj, &record);
+    nourstest_true(record.duration == MACE_RECORD_HISTORY + 2);
+    nourstest_true(fingerprint == mace_Target_fingerprint(&targets[0]));
+
+    /* --- Legacy .t: duration, then duration and rss --- */
+    strcpy(time_file, obj);
+    time_file[strlen(time_file) - 1] = 't';
+    for (i = 1; i <= 2; i++) {
+        legacy[0] = 40 + i;
+        legacy[1] = 50;
+        fd = fopen(time_file, "wb");
+        fwrite(legacy, sizeof(*legacy), i, fd);
+        fclose(fd);
+        nourstest_true(mace_record_history(obj, records) == 1);
+        nourstest_true(records[0].duration    == 40 + i);
+        nourstest_true(records[0].rss         == ((i == 2) ? 50 : 0));
+        nourstest_true(records[0].fingerprint == 0);
+        mace_record_write(obj, &record);
+        nourstest_true(mace_record_history(obj, records) == 2);
+        nourstest_true(records[1].duration    == 40 + i);
+    }
+    mace_post_build(&args);
+    silent = false;
+}
+
+void test_fanout(void) {
+    Target fanA     = {0};
+    Target fanB     = {0};
+    Mace_Args args  = Mace_Args_default;
+    u32   counts[MACE_RECORD_HISTORY];
+    FILE *fd;
+    int   h;
+    int   run;
+
+    mace_mkdir(MACE_TEST_OBJ_DIR);
+    mace_mkdir(MACE_TEST_OBJ_DIR"/fanout");
+    fd = fopen(MACE_TEST_OBJ_DIR"/fanout/fanA.c", "w");
+    fprintf(fd, "#include \"fan.h\"\nint fan_a(void) { return (FAN); }\n");
+    fclose(fd);
+    fd = fopen(MACE_TEST_OBJ_DIR"/fanout/fanB.c", "w");
+    fprintf(fd, "#include \"fan.h\"\nint fan_b(void) { return (FAN); }\n");
+    fclose(fd);
+
+    /* --- Header shared by targets changes --- */
+    for (run = 0; run < 2; run++) {
+        fd = fopen(MACE_TEST_OBJ_DIR"/fanout/fan.h", "w");
+        fprintf(fd, "#define FAN %d\n", run);
+        fclose(fd);
+
+        args        = Mace_Args_default;
+        args.silent = true;
+        mace_post_build(NULL);
+        test_fixture(&args);
+        fanA.sources    = MACE_TEST_OBJ_DIR"/fanout/fanA*.c";
+        fanA.kind       = MACE_STATIC_LIBRARY;
+        fanB.sources    = MACE_TEST_OBJ_DIR"/fanout/fanB*.c";
+        fanB.kind       = MACE_STATIC_LIBRARY;
+        fanB.links      = "fanA";
+        MACE_ADD_TARGET(fanA);
+        MACE_ADD_TARGET(fanB);
+        test_fixture_prebuild(&args, 1);
+        if (run == 0) {
+            mace_build();
+            mace_post_build(&args);
+        }
+    }
+
+    /* -- Both targets see change, recompiles saved -- */
+    nourstest_true(targets[0].private._recompiles[0]);
+    nourstest_true(targets[1].private._recompiles[0]);
+    nourstest_true(targets[0].private._headers_num == 1);
+    h = mace_recompiles_history(targets[0].private._headers_checksum[0], counts);
+    nourstest_true(h >= 1);
+    nourstest_true(counts[0] == 2);
+    mace_build();
+    mace_post_build(&args);
+    silent = false;
+}
+
+void test_explain(void) {
+    Target explained    = {0};
+    Mace_Args args      = Mace_Args_default;
+    char *argv[]        = {"./test", "--explain"};
+    FILE *fd;
+    int   run;
+
+    args = mace_parse_args(2, argv);
+    nourstest_true(args.explain);
+    Mace_Args_Free(&args);
+
+    mace_mkdir(MACE_TEST_OBJ_DIR);
+    mace_mkdir(MACE_TEST_OBJ_DIR"/explain");
+    fd = fopen(MACE_TEST_OBJ_DIR"/explain/explain.c", "w");
+    fprintf(fd, "#include \"explain.h\"\nint explain(void) { return (EXPLAIN); }\n");
+    fclose(fd);
+    remove(MACE_TEST_OBJ_DIR"/explained.flags");
+
+    /* -- Build, change header, then flags -- */
+    for (run = 0; run < 3; run++) {
+        fd = fopen(MACE_TEST_OBJ_DIR"/explain/explain.h", "w");
+        fprintf(fd, "#define EXPLAIN %d\n", run > 0);
+        fclose(fd);
+
+        args            = Mace_Args_default;
+        args.silent     = true;
+        args.explain    = true;
+        mace_post_build(NULL);
+        test_fixture(&args);
+        explained.sources   = MACE_TEST_OBJ_DIR"/explain/*.c";
+        explained.kind      = MACE_STATIC_LIBRARY;
+        explained.flags     = (run == 2) ? "-DEXPLAINED" : NULL;
+        MACE_ADD_TARGET(explained);
+        test_fixture_prebuild(&args, 0);
+        nourstest_true(targets[0].private._recompiles[0]);
+        if (run == 1)
+            nourstest_true(targets[0].private._reasons[0] == MACE_REASON_HEADER);
+        if (run == 2)
+            nourstest_true(targets[0].private._reasons[0] == MACE_REASON_FLAGS);
+        mace_build();
+        mace_post_build(&args);
+    }
+    silent  = false;
+    explain = false;
+}
+
+void test_plan(void) {
+    Target planned      = {0};
+    Mace_Args args      = Mace_Args_default;
+    struct utimbuf old;
+    FILE *fd;
+    int   run;
+
+    mace_mkdir(MACE_TEST_OBJ_DIR);
+    mace_mkdir(MACE_TEST_OBJ_DIR"/plan");
+    fd = fopen(MACE_TEST_OBJ_DIR"/plan/plan.c", "w");
+    fprintf(fd, "int plan(void) { return (1); }\n");
+    fclose(fd);
+    /* Edits in second plan written are stale */
+    old.actime  = time(NULL) - 60;
+    old.modtime = old.actime;
+    utime(MACE_TEST_OBJ_DIR"/plan/plan.c", &old);
+    utime(MACE_TEST_OBJ_DIR"/plan", &old);
+
+    /* -- Build, no-op, source edited, no-op -- */
+    for (run = 0; run < 4; run++) {
+        if (run == 2) {
+            fd = fopen(MACE_TEST_OBJ_DIR"/plan/plan.c", "w");
+            fprintf(fd, "int plan(void) { return (2); }\n");
+            fclose(fd);
+            old.modtime++;
+            utime(MACE_TEST_OBJ_DIR"/plan/plan.c", &old);
+        }
+        args            = Mace_Args_default;
+        args.silent     = true;
+        mace_post_build(NULL);
+        test_fixture(&args);
+        planned.sources = MACE_TEST_OBJ_DIR"/plan/*.c";
+        planned.kind    = MACE_STATIC_LIBRARY;
+        MACE_ADD_TARGET(planned);
+        test_fixture_prebuild(&args, 0);
+        nourstest_true(stats.plan_fresh == (run % 2));
+        nourstest_true((stats.plan_checks > 0) == (run > 0));
+        mace_build();
+        nourstest_true((stats.processes == 0) == (run % 2));
+        mace_post_build(&args);
+    }
+
+    /* -- Macefile changed: key differs -- */
+    args            = Mace_Args_default;
+    args.silent     = true;
+    mace_pre_user(&args);
+    mace_set_obj_dir(MACE_TEST_OBJ_DIR);
+    mace_set_build_dir(MACE_TEST_BUILD_DIR);
+    planned.flags   = "-DPLANNED";
+    MACE_ADD_TARGET(planned);
+    test_fixture_prebuild(&args, 0);
+    nourstest_true(!stats.plan_fresh);
+    nourstest_true(stats.plan_checks == 0);
+    mace_build();
+    mace_post_build(&args);
+
+    /* -- Source edited during build, seconds before plan written: stale -- */
+    for (run = 0; run < 3; run++) {
+        if (run == 0) {
+            fd = fopen(MACE_TEST_OBJ_DIR"/plan/plan.c", "w");
+            fprintf(fd, "int plan(void) { return (3); }\n");
+            fclose(fd);
+            old.modtime++;
+            utime(MACE_TEST_OBJ_DIR"/plan/plan.c", &old);
+        }
+        args            = Mace_Args_default;
+        args.silent     = true;
+        mace_post_build(NULL);
+        test_fixture(&args);
+        MACE_ADD_TARGET(planned);
+        test_fixture_prebuild(&args, 0);
+        nourstest_true(stats.plan_fresh == (run == 2));
+        if (run == 0) {
+            /* Build started 10s ago, edited 9s ago */
+            stats.plan_time -= 10;
+            fd = fopen(MACE_TEST_OBJ_DIR"/plan/plan.c", "w");
+            fprintf(fd, "int plan(void) { return (4); }\n");
+            fclose(fd);
+            old.modtime = (time_t)stats.plan_time + 1;
+            utime(MACE_TEST_OBJ_DIR"/plan/plan.c", &old);
+        }
+        mace_build();
+        mace_post_build(&args);
+    }
+    silent = false;
+}
+
+void test_staged(void) {
+    Target staged       = {0};
+    Mace_Args args      = Mace_Args_default;
+    struct utimbuf old;
+    u8    hash[SHA1DC_LEN];
+    FILE *fd;
+    int   run;
+
+    mace_pre_user(NULL);
+    mace_mkdir(MACE_TEST_OBJ_DIR);
+    mace_mkdir(MACE_TEST_OBJ_DIR"/staged");
+    fd = fopen(MACE_TEST_OBJ_DIR"/staged/staged.h", "w");
+    fprintf(fd, "#define STAGED 1\n");
+    fclose(fd);
+    fd = fopen(MACE_TEST_OBJ_DIR"/staged/staged.c", "w");
+    fprintf(fd, "#include \"staged.h\"\nint staged(void) { return (STAGED); }\n");
+    fclose(fd);
+
+    /* -- Changed checksum staged, not written -- */
+    remove(MACE_TEST_OBJ_DIR"/staged.sha1");
+    nourstest_true(mace_file_changed(MACE_TEST_OBJ_DIR"/staged.sha1",
+                                     MACE_TEST_OBJ_DIR"/staged/staged.c", hash));
+    nourstest_true(access(MACE_TEST_OBJ_DIR"/staged.sha1", F_OK) != 0);
+    mace_checksum_write(MACE_TEST_OBJ_DIR"/staged.sha1", hash);
+    nourstest_true(access(MACE_TEST_OBJ_DIR"/staged.sha1", F_OK) == 0);
+    nourstest_true(access(MACE_TEST_OBJ_DIR"/staged.sha1.tmp", F_OK) != 0);
+    nourstest_true(!mace_file_changed(MACE_TEST_OBJ_DIR"/staged.sha1",
+                                      MACE_TEST_OBJ_DIR"/staged/staged.c", NULL));
+    mace_post_build(NULL);
+
+    /* -- Build, header edited with old mtime, -- */
+    /* -- build stopped after object compiled -- */
+    for (run = 0; run < 4; run++) {
+        if ((run == 1) || (run == 2)) {
+            fd = fopen(MACE_TEST_OBJ_DIR"/staged/staged.h", "w");
+            fprintf(fd, "#define STAGED %d\n", run + 1);
+            fclose(fd);
+            /* Restored header, e.g. cp -p: mtime older than object */
+            old.actime  = time(NULL) - 3600;
+            old.modtime = old.actime;
+            utime(MACE_TEST_OBJ_DIR"/staged/staged.h", &old);
+        }
+        args            = Mace_Args_default;
+        args.silent     = true;
+        test_fixture(&args);
+        staged.sources  = MACE_TEST_OBJ_DIR"/staged";
+        staged.includes = MACE_TEST_OBJ_DIR"/staged";
+        staged.kind     = MACE_STATIC_LIBRARY;
+        MACE_ADD_TARGET(staged);
+        test_fixture_prebuild(&args, 0);
+        /* Object has digest of current headers: skipped */
+        nourstest_true(targets[0].private._recompiles[0] == (run != 3));
+        if (run == 2) {
+            /* Interrupted: object compiled, headers not written */
+            mace_Target_Checksum_Commit(&targets[0], 0);
+        } else {
+            mace_build();
+        }
+        mace_post_build(&args);
+    }
+    silent = false;
+}
+
+void test_archive(void) {
+    Target archive      = {0};
+    Target archived     = {0};
+    Mace_Args args      = Mace_Args_default;
+    Mace_Ar_Previous previous = {0};
+    Mace_Ar          ar       = {0};
+    Mace_Ar_Member   member   = {0};
+    struct utimbuf old;
+    struct stat    st;
+    char  cmd[PATH_MAX * 2];
+    char *object;
+    char *lib;
+    char *exec;
+    u8   *buf;
+    size_t len;
+    FILE *fd;
+    int   i;
+    int   run;
+
+    mace_mkdir(MACE_TEST_OBJ_DIR);
+    mace_mkdir(MACE_TEST_OBJ_DIR"/archive");
+    mace_mkdir(MACE_TEST_OBJ_DIR"/archived");
+    fd = fopen(MACE_TEST_OBJ_DIR"/archive/a.c", "w");
+    fprintf(fd, "int archive_a(void) { return (1); }\n");
+    fprintf(fd, "int archive_w __attribute__((weak)) = 2;\n");
+    fclose(fd);
+    fd = fopen(MACE_TEST_OBJ_DIR"/archive/archive_long_name.c", "w");
+    fprintf(fd, "static int archive_s(void) { return (2); }\n");
+    fprintf(fd, "int archive_b(void) { return (archive_s()); }\n");
+    fclose(fd);
+    fd = fopen(MACE_TEST_OBJ_DIR"/archived/main.c", "w");
+    fprintf(fd, "int archive_a(void);\nint archive_b(void);\n");
+    fprintf(fd, "int main(void) { return (archive_a() + archive_b() - 3); }\n");
+    fclose(fd);
+
+    /* -- Archive in-process, then thin: relinked -- */
+    for (run = 0; run < 2; run++) {
+        args                = Mace_Args_default;
+        args.silent         = true;
+        test_fixture(&args);
+        archive.sources     = MACE_TEST_OBJ_DIR"/archive";
+        archive.kind        = MACE_STATIC_LIBRARY;
+        archive.thin        = run;
+        MACE_ADD_TARGET(archive);
+        archived.sources    = MACE_TEST_OBJ_DIR"/archived";
+        archived.links      = "archive";
+        archived.kind       = MACE_EXECUTABLE;
+        MACE_ADD_TARGET(archived);
+        test_fixture_prebuild(&args, 1);
+        mace_build();
+
+        lib  = mace_library_path("archive", MACE_STATIC_LIBRARY);
+        exec = mace_executable_path("archived");
+        nourstest_true(mace_ar_thin(lib) == run);
+        nourstest_true(mace_ar_previous(&previous, lib, run));
+        nourstest_true(previous.num == 2);
+        /* archive_a, archive_w, archive_b */
+        nourstest_true(previous.symbols_num == 3);
+        for (i = 0; i < previous.num; i++) {
+            if (strstr(previous.members[i].name, "archive_long_name.o") != NULL)
+                break;
+        }
+        nourstest_true(i < previous.num);
+        nourstest_true(previous.members[i].syms_num == 1);
+        mace_ar_previous_free(&previous);
+        nourstest_true(system(exec) == 0);
+        free(lib);
+        free(exec);
+        mace_post_build(&args);
+    }
+
+    /* -- Not ELF: external archiver -- */
+    nourstest_true(mace_ar_elf_symbols(&ar, &member, (const u8 *)"not an object", 13) == -1);
+    mace_ar_free(&ar);
+
+    /* -- Recompiled, same size and second as member: content compared -- */
+    args                = Mace_Args_default;
+    args.silent         = true;
+    test_fixture(&args);
+    archive.thin        = false;
+    MACE_ADD_TARGET(archive);
+    test_fixture_prebuild(&args, 0);
+    mace_build();
+    lib  = mace_library_path("archive", MACE_STATIC_LIBRARY);
+    for (i = 0; i < targets[0].private._argc_sources; i++) {
+        if (strstr(targets[0].private._argv_objects[i], "/a.o") != NULL)
+            break;
+    }
+    nourstest_true(i < targets[0].private._argc_sources);
+    object = targets[0].private._argv_objects[i] + strlen("-o");
+    for (run = 0; run < 2; run++) {
+        fd = fopen(MACE_TEST_OBJ_DIR"/archive/a.c", "w");
+        fprintf(fd, "int archive_a(void) { return (%d); }\n", run + 1);
+        fprintf(fd, "int archive_w __attribute__((weak)) = 2;\n");
+        fclose(fd);
+        sprintf(cmd, "gcc -c "MACE_TEST_OBJ_DIR"/archive/a.c -o %s", object);
+        nourstest_true(system(cmd) == 0);
+        nourstest_true(mace_ar_previous(&previous, lib, false));
+        old.actime  = (time_t)previous.members[i].mtime;
+        old.modtime = old.actime;
+        stat(object, &st);
+        nourstest_true((run == 0) || (previous.members[i].size == (u64)st.st_size));
+        utime(object, &old);
+        mace_ar_previous_free(&previous);
+        targets[0].private._recompiles[i] = true;
+        nourstest_true(mace_ar_write(&targets[0], lib));
+
+        nourstest_true(mace_ar_previous(&previous, lib, false));
+        buf = mace_ar_file_read(object, &len);
+        nourstest_true(mace_ar_previous_same(&previous, i, buf, len));
+        free(buf);
+        mace_ar_previous_free(&previous);
+    }
+    free(lib);
+    mace_post_build(&args);
+    silent = false;
+}
+
+void test_object_library(void) {
+    Target objects      = {0};
+    Target objected     = {0};
+    Mace_Args args      = Mace_Args_default;
+    struct utimbuf old;
+    char *lib;
+    char *exec;
+    FILE *fd;
+    int   run;
+
+    mace_mkdir(MACE_TEST_OBJ_DIR);
+    mace_mkdir(MACE_TEST_OBJ_DIR"/objects");
+    mace_mkdir(MACE_TEST_OBJ_DIR"/objected");
+    fd = fopen(MACE_TEST_OBJ_DIR"/objected/main.c", "w");
+    fprintf(fd, "int objects(void);\nint main(void) { return (objects()); }\n");
+    fclose(fd);
+
+    /* Inputs older than build: plan can be fresh */
+    old.actime  = time(NULL) - 60;
+    old.modtime = old.actime;
+    utime(MACE_TEST_OBJ_DIR"/objected/main.c", &old);
+    utime(MACE_TEST_OBJ_DIR"/objected", &old);
+
+    /* -- Objects linked, no-op, then edited through plan: relinked -- */
+    for (run = 0; run < 3; run++) {
+        if (run != 1) {
+            fd = fopen(MACE_TEST_OBJ_DIR"/objects/objects.c", "w");
+            fprintf(fd, "int objects(void) { return (%d); }\n", run);
+            fclose(fd);
+            old.modtime += run;
+            utime(MACE_TEST_OBJ_DIR"/objects/objects.c", &old);
+            utime(MACE_TEST_OBJ_DIR"/objects", &old);
+        }
+        args                = Mace_Args_default;
+        args.silent         = true;
+        test_fixture(&args);
+        objects.sources     = MACE_TEST_OBJ_DIR"/objects";
+        objects.kind        = MACE_OBJECT_LIBRARY;
+        MACE_ADD_TARGET(objects);
+        objected.sources    = MACE_TEST_OBJ_DIR"/objected";
+        objected.links      = "objects";
+        objected.kind       = MACE_EXECUTABLE;
+        MACE_ADD_TARGET(objected);
+        test_fixture_prebuild(&args, 1);
+        nourstest_true(stats.plan_fresh == (run == 1));
+        mace_build();
+        nourstest_true(targets[0].private._relinked == (run != 1));
+        nourstest_true(targets[1].private._relinked == (run != 1));
+
+        /* No archive, objects in executable */
+        lib  = mace_library_path("objects", MACE_STATIC_LIBRARY);
+        exec = mace_executable_path("objected");
+        nourstest_true(access(lib, F_OK) != 0);
+        nourstest_true(WEXITSTATUS(system(exec)) == (run / 2) * 2);
+        free(lib);
+        free(exec);
+        mace_post_build(&args);
+    }
+    silent = false;
+}
+
+void test_linker(void) {
+    Target linked       = {0};
+    Config fast         = {0};
+    Mace_Args args      = Mace_Args_default;
+    const char *linkers[2] = {"gold", "notalinker"};
+    char *exec;
+    FILE *fd;
+    int   run;
+
+    mace_mkdir(MACE_TEST_OBJ_DIR);
+    mace_mkdir(MACE_TEST_OBJ_DIR"/linked");
+    fd = fopen(MACE_TEST_OBJ_DIR"/linked/main.c", "w");
+    fprintf(fd, "int main(void) { return (3); }\n");
+    fclose(fd);
+
+    /* -- Linker available, then default linker -- */
+    for (run = 0; run < 2; run++) {
+        args                = Mace_Args_default;
+        args.silent         = true;
+        test_fixture(&args);
+        fast.flags          = "-g";
+        fast.linker         = linkers[run];
+        fast.split_dwarf    = true;
+        MACE_ADD_CONFIG(fast);
+        linked.sources      = MACE_TEST_OBJ_DIR"/linked";
+        linked.kind         = MACE_EXECUTABLE;
+        MACE_ADD_TARGET(linked);
+        exec = mace_executable_path("linked");
+        remove(exec);
+        test_fixture_prebuild(&args, 0);
+        mace_build();
+        nourstest_true(linker_ok == (run == 0));
+
+        /* -gsplit-dwarf: debug info next to object */
+        nourstest_true(access(MACE_TEST_OBJ_DIR"/main.dwo", F_OK) == 0);
+        nourstest_true(WEXITSTATUS(system(exec)) == 3);
+        free(exec);
+        mace_post_build(&args);
+    }
+    silent = false;
+}
+
+void test_partial(void) {
+    Target parted       = {0};
+    Mace_Args args      = Mace_Args_default;
+    struct utimbuf old;
+    glob_t partials;
+    char *exec;
+    FILE *fd;
+    int   run;
+    int   stale;
+    size_t i;
+
+    mace_mkdir(MACE_TEST_OBJ_DIR);
+    mace_mkdir(MACE_TEST_OBJ_DIR"/parted");
+    mace_mkdir(MACE_TEST_OBJ_DIR"/parted/a");
+    mace_mkdir(MACE_TEST_OBJ_DIR"/parted/b");
+    fd = fopen(MACE_TEST_OBJ_DIR"/parted/a/a.c", "w");
+    fprintf(fd, "int b(void);\nint main(void) { return (1 + b()); }\n");
+    fclose(fd);
+
+    /* -- Build, then b edited: a not relinked -- */
+    /* -- Then a gains a source: b not relinked, old a removed -- */
+    for (run = 0; run < 3; run++) {
+        if (run < 2) {
+            fd = fopen(MACE_TEST_OBJ_DIR"/parted/b/b.c", "w");
+            fprintf(fd, "int b(void) { return (%d); }\n", run + 2);
+            fclose(fd);
+        } else {
+            fd = fopen(MACE_TEST_OBJ_DIR"/parted/a/c.c", "w");
+            fprintf(fd, "int c(void) { return (0); }\n");
+            fclose(fd);
+        }
+        args                = Mace_Args_default;
+        args.silent         = true;
+        test_fixture(&args);
+        parted.sources      = MACE_TEST_OBJ_DIR"/parted/a "MACE_TEST_OBJ_DIR"/parted/b";
+        parted.partial      = true;
+        parted.kind         = MACE_EXECUTABLE;
+        MACE_ADD_TARGET(parted);
+        test_fixture_prebuild(&args, 0);
+        mace_build();
+        exec = mace_executable_path("parted");
+        nourstest_true(WEXITSTATUS(system(exec)) == ((run < 2) ? run + 3 : 4));
+        free(exec);
+
+        /* One partial object per directory */
+        stale = 0;
+        nourstest_true(glob(MACE_TEST_OBJ_DIR"/parted_partial*.o", 0, NULL, &partials) == 0);
+        nourstest_true(partials.gl_pathc == 2);
+        for (i = 0; i < partials.gl_pathc; i++) {
+            struct stat st;
+            stat(partials.gl_pathv[i], &st);
+            stale += (run > 0) && (st.st_mtime == old.modtime);
+        }
+        nourstest_true(stale == (run > 0));
+
+        /* Objects older than partial objects */
+        old.actime  = time(NULL) - 60;
+        old.modtime = old.actime;
+        for (i = 0; i < (size_t)targets[0].private._argc_sources; i++)
+            utime(targets[0].private._argv_objects[i] + 2, &old);
+        old.modtime += 30;
+        for (i = 0; i < partials.gl_pathc; i++)
+            utime(partials.gl_pathv[i], &old);
+        globfree(&partials);
+        mace_post_build(&args);
+    }
+    silent = false;
+}
+
+void test_lto(void) {
+    Target ltolib       = {0};
+    Target ltoexec      = {0};
+    Config release      = {0};
+    Mace_Args args      = Mace_Args_default;
+    char **argv;
+    char *exec;
+    FILE *fd;
+    int   i;
+    int   poll;
+    int   argc    = 0;
+    int   arg_len = 4;
+    b32   flto = false;
+
+    mace_mkdir(MACE_TEST_OBJ_DIR);
+    mace_mkdir(MACE_TEST_OBJ_DIR"/ltolib");
+    mace_mkdir(MACE_TEST_OBJ_DIR"/ltoexec");
+    fd = fopen(MACE_TEST_OBJ_DIR"/ltolib/lib.c", "w");
+    fprintf(fd, "int lib(void) { return (4); }\n");
+    fclose(fd);
+    fd = fopen(MACE_TEST_OBJ_DIR"/ltoexec/main.c", "w");
+    fprintf(fd, "int lib(void);\nint main(void) { return (lib()); }\n");
+    fclose(fd);
+
+    args                = Mace_Args_default;
+    args.silent         = true;
+    args.jobs           = 4;
+    args.pools          = "link=2";
+    test_fixture(&args);
+    release.flags       = "-O2";
+    release.lto         = true;
+    MACE_ADD_CONFIG(release);
+    ltolib.sources      = MACE_TEST_OBJ_DIR"/ltolib";
+    ltolib.kind         = MACE_STATIC_LIBRARY;
+    MACE_ADD_TARGET(ltolib);
+    ltoexec.sources     = MACE_TEST_OBJ_DIR"/ltoexec";
+    ltoexec.links       = "ltolib";
+    ltoexec.kind        = MACE_EXECUTABLE;
+    MACE_ADD_TARGET(ltoexec);
+    test_fixture_prebuild(&args, 1);
+    mace_build();
+
+    /* -- Objects compiled with -flto -- */
+    for (i = MACE_ARGV_OTHER; i < targets[0].private._argc; i++) {
+        if (targets[0].private._argv[i] != NULL)
+            flto |= (strcmp(targets[0].private._argv[i], "-flto") == 0);
+    }
+    nourstest_true(flto);
+
+    /* -- LTO archive by gcc-ar, linked -- */
+    exec = mace_executable_path("ltoexec");
+    nourstest_true(WEXITSTATUS(system(exec)) == 4);
+    free(exec);
+
+    /* -- No jobserver: 4 jobs split between 2 links -- */
+    poll            = jobserver.poll;
+    jobserver.poll  = -1;
+    argv            = calloc(arg_len, sizeof(*argv));
+    mace_argv_add_lto(&argv, &argc, &arg_len, true);
+    nourstest_true((argc == 1) && (strcmp(argv[0], "-flto=2") == 0));
+    mace_argv_free(argv, argc);
+    jobserver.poll  = poll;
+    args.pools      = NULL;
+    mace_post_build(&args);
+    silent = false;
+}
+
+void test_pgo(void) {
+    Target pgoed        = {0};
+    Config gen          = {0};
+    Config use          = {0};
+    Mace_Args args      = Mace_Args_default;
+    const char *names[5] = {"gen", "use", "use", "use", "use"};
+    char *exec;
+    FILE *fd;
+    int   run;
+
+    mace_mkdir(MACE_TEST_OBJ_DIR);
+    mace_mkdir(MACE_TEST_OBJ_DIR"/pgoed");
+    fd = fopen(MACE_TEST_OBJ_DIR"/pgoed/main.c", "w");
+    fprintf(fd, "int main(int argc, char *argv[]) {\n"
+                "    int i, sum = 0;\n"
+                "    for (i = 0; i < 1000; i++)\n"
+                "        sum += (i %% 3) ? argc : 1;\n"
+                "    return (sum == 0);\n}\n");
+    fclose(fd);
+
+    /* -- Instrumented, use, no-op, profile removed, build stopped -- */
+    for (run = 0; run < 5; run++) {
+        if (run == 3)
+            remove(MACE_TEST_OBJ_DIR"/pgo/main.gcda");
+        args                    = Mace_Args_default;
+        args.silent             = true;
+        args.user_config_hash   = mace_hash(names[run]);
+        test_fixture(&args);
+        gen.flags       = "-O2";
+        gen.pgo         = MACE_PGO_GENERATE;
+        gen.train       = MACE_TEST_BUILD_DIR"/pgo/pgoed";
+        use.flags       = "-O2";
+        use.pgo         = MACE_PGO_USE;
+        MACE_ADD_CONFIG(gen);
+        MACE_ADD_CONFIG(use);
+        pgoed.sources   = MACE_TEST_OBJ_DIR"/pgoed";
+        pgoed.kind      = MACE_EXECUTABLE;
+        MACE_ADD_TARGET(pgoed);
+        test_fixture_prebuild(&args, 0);
+        /* Stopped before compile: still recompiles */
+        if (run == 3) {
+            nourstest_true(targets[0].private._compile_num == 1);
+            mace_post_build(&args);
+            continue;
+        }
+        mace_build();
+
+        if (run == 0) {
+            /* Instrumented executable apart, trained */
+            nourstest_true(access(MACE_TEST_BUILD_DIR"/pgo/pgoed", F_OK) == 0);
+            nourstest_true(access(MACE_TEST_BUILD_DIR"/pgoed", F_OK) != 0);
+            nourstest_true(access(MACE_TEST_OBJ_DIR"/pgo/main.gcda", F_OK) == 0);
+        } else if (run == 1) {
+            /* Profile copied next to object */
+            nourstest_true(targets[0].private._compile_num == 1);
+            nourstest_true(access(MACE_TEST_OBJ_DIR"/main.gcda", F_OK) == 0);
+        } else if (run == 2) {
+            nourstest_true(targets[0].private._compile_num == 0);
+        } else {
+            nourstest_true(targets[0].private._compile_num == 1);
+            nourstest_true(targets[0].private._reasons[0] == MACE_REASON_PROFILE);
+            nourstest_true(access(MACE_TEST_OBJ_DIR"/main.gcda", F_OK) != 0);
+        }
+        if (run > 0) {
+            exec = mace_executable_path("pgoed");
+            nourstest_true(WEXITSTATUS(system(exec)) == 0);
+            free(exec);
+        }
+        mace_post_build(&args);
+    }
+    silent = false;
+}
+
+void test_object_diamond(void) {
+    Target bottom       = {0};
+    Target left         = {0};
+    Target right        = {0};
+    Target top          = {0};
+    Mace_Args args      = Mace_Args_default;
+    char *exec;
+    FILE *fd;
+    int   run;
+
+    mace_mkdir(MACE_TEST_OBJ_DIR);
+    mace_mkdir(MACE_TEST_OBJ_DIR"/bottom");
+    mace_mkdir(MACE_TEST_OBJ_DIR"/left");
+    mace_mkdir(MACE_TEST_OBJ_DIR"/right");
+    mace_mkdir(MACE_TEST_OBJ_DIR"/top");
+    fd = fopen(MACE_TEST_OBJ_DIR"/left/left.c", "w");
+    fprintf(fd, "int bottom(void);\nint left(void) { return (bottom()); }\n");
+    fclose(fd);
+    fd = fopen(MACE_TEST_OBJ_DIR"/right/right.c", "w");
+    fprintf(fd, "int bottom(void);\nint right(void) { return (bottom()); }\n");
+    fclose(fd);
+    fd = fopen(MACE_TEST_OBJ_DIR"/top/main.c", "w");
+    fprintf(fd, "int left(void);\nint right(void);\n");
+    fprintf(fd, "int main(void) { return (left() + right()); }\n");
+    fclose(fd);
+
+    /* -- Objects of bottom linked once into top -- */
+    /* -- bottom edited: top relinked through left, right -- */
+    for (run = 0; run < 2; run++) {
+        fd = fopen(MACE_TEST_OBJ_DIR"/bottom/bottom.c", "w");
+        fprintf(fd, "int bottom(void) { return (%d); }\n", run + 1);
+        fclose(fd);
+        args                = Mace_Args_default;
+        args.silent         = true;
+        test_fixture(&args);
+        bottom.sources      = MACE_TEST_OBJ_DIR"/bottom";
+        bottom.kind         = MACE_OBJECT_LIBRARY;
+        MACE_ADD_TARGET(bottom);
+        left.sources        = MACE_TEST_OBJ_DIR"/left";
+        left.links          = "bottom";
+        left.kind           = MACE_OBJECT_LIBRARY;
+        MACE_ADD_TARGET(left);
+        right.sources       = MACE_TEST_OBJ_DIR"/right";
+        right.links         = "bottom";
+        right.kind          = MACE_OBJECT_LIBRARY;
+        MACE_ADD_TARGET(right);
+        top.sources         = MACE_TEST_OBJ_DIR"/top";
+        top.links           = "left right";
+        top.kind            = MACE_EXECUTABLE;
+        MACE_ADD_TARGET(top);
+        test_fixture_prebuild(&args, 3);
+        mace_build();
+        nourstest_true(targets[1].private._relinked);
+        nourstest_true(targets[3].private._relinked);
+
+        exec = mace_executable_path("top");
+        nourstest_true(WEXITSTATUS(system(exec)) == 2 * (run + 1));
+        free(exec);
+        mace_post_build(&args);
+    }
+    silent = false;
+}
+
 /* TODO: flags disappearing after 128 flags
 **      Flags get printed
 **      Flags DON'T get executed
@@ -1574,6 +3231,7 @@ int mace(int argc, char *argv[]) {
     nourstest_run("argv ",          test_argv);
     nourstest_run("argline ",       test_argline);
     nourstest_run("post_user ",     test_post_user);
+    nourstest_run("pid_status ",    test_pid_status);
     nourstest_run("separator ",     test_separator);
     nourstest_run("parse_args ",    test_parse_args);
     nourstest_run("build_order ",   test_build_order);
@@ -1583,6 +3241,28 @@ int mace(int argc, char *argv[]) {
     nourstest_run("config_global ", test_config_global);
     nourstest_run("config_spec ",   test_config_specific);
     nourstest_run("no_includes ",   test_target_no_includes);
+    nourstest_run("schedule ",      test_schedule);
+    nourstest_run("pools ",         test_pools);
+    nourstest_run("jobs ",          test_jobs);
+    nourstest_run("jobserver ",     test_jobserver);
+    nourstest_run("batch ",         test_batch);
+    nourstest_run("unity ",         test_unity);
+    nourstest_run("pch ",           test_pch);
+    nourstest_run("trace ",         test_trace);
+    nourstest_run("stats ",         test_stats);
+    nourstest_run("relink ",        test_relink);
+    nourstest_run("report ",        test_report);
+    nourstest_run("fanout ",        test_fanout);
+    nourstest_run("explain ",       test_explain);
+    nourstest_run("plan ",          test_plan);
+    nourstest_run("staged ",        test_staged);
+    nourstest_run("archive ",       test_archive);
+    nourstest_run("object_library ", test_object_library);
+    nourstest_run("linker ",        test_linker);
+    nourstest_run("partial ",       test_partial);
+    nourstest_run("lto ",           test_lto);
+    nourstest_run("pgo ",           test_pgo);
+    nourstest_run("object_diamond ", test_object_diamond);
     nourstest_results();
 
     printf("A warning about self dependency should print now:\n \n");